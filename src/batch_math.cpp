@@ -0,0 +1,321 @@
+#include "batch_math.h"
+#include <cmath>
+#include <type_traits>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BATCH_AVX
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BATCH_SSE
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define BATCH_NEON
+#endif
+
+using namespace std;
+using namespace glm;
+
+namespace {
+    // Kernels are written once against a lane type and instantiated for the widest vector
+    // the target has, then for single floats to finish the tail.
+    struct TScalar {
+        static constexpr size_t Width = 1;
+        float V;
+
+        static TScalar Load(const float *p) { return {*p}; }
+        static TScalar Splat(float v) { return {v}; }
+        void Store(float *p) const { *p = V; }
+        friend TScalar operator+(TScalar a, TScalar b) { return {a.V + b.V}; }
+        friend TScalar operator-(TScalar a, TScalar b) { return {a.V - b.V}; }
+        friend TScalar operator*(TScalar a, TScalar b) { return {a.V * b.V}; }
+        friend TScalar operator/(TScalar a, TScalar b) { return {a.V / b.V}; }
+        friend TScalar Abs(TScalar a) { return {std::abs(a.V)}; }
+    };
+
+#if defined(BATCH_AVX)
+    struct TLane {
+        static constexpr size_t Width = 8;
+        __m256 V;
+
+        static TLane Load(const float *p) { return {_mm256_loadu_ps(p)}; }
+        static TLane Splat(float v) { return {_mm256_set1_ps(v)}; }
+        void Store(float *p) const { _mm256_storeu_ps(p, V); }
+        friend TLane operator+(TLane a, TLane b) { return {_mm256_add_ps(a.V, b.V)}; }
+        friend TLane operator-(TLane a, TLane b) { return {_mm256_sub_ps(a.V, b.V)}; }
+        friend TLane operator*(TLane a, TLane b) { return {_mm256_mul_ps(a.V, b.V)}; }
+        friend TLane operator/(TLane a, TLane b) { return {_mm256_div_ps(a.V, b.V)}; }
+        friend TLane Abs(TLane a) { return {_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.V)}; }
+    };
+#elif defined(BATCH_SSE)
+    struct TLane {
+        static constexpr size_t Width = 4;
+        __m128 V;
+
+        static TLane Load(const float *p) { return {_mm_loadu_ps(p)}; }
+        static TLane Splat(float v) { return {_mm_set1_ps(v)}; }
+        void Store(float *p) const { _mm_storeu_ps(p, V); }
+        friend TLane operator+(TLane a, TLane b) { return {_mm_add_ps(a.V, b.V)}; }
+        friend TLane operator-(TLane a, TLane b) { return {_mm_sub_ps(a.V, b.V)}; }
+        friend TLane operator*(TLane a, TLane b) { return {_mm_mul_ps(a.V, b.V)}; }
+        friend TLane operator/(TLane a, TLane b) { return {_mm_div_ps(a.V, b.V)}; }
+        friend TLane Abs(TLane a) { return {_mm_andnot_ps(_mm_set1_ps(-0.0f), a.V)}; }
+    };
+#elif defined(BATCH_NEON)
+    struct TLane {
+        static constexpr size_t Width = 4;
+        float32x4_t V;
+
+        static TLane Load(const float *p) { return {vld1q_f32(p)}; }
+        static TLane Splat(float v) { return {vdupq_n_f32(v)}; }
+        void Store(float *p) const { vst1q_f32(p, V); }
+        friend TLane operator+(TLane a, TLane b) { return {vaddq_f32(a.V, b.V)}; }
+        friend TLane operator-(TLane a, TLane b) { return {vsubq_f32(a.V, b.V)}; }
+        friend TLane operator*(TLane a, TLane b) { return {vmulq_f32(a.V, b.V)}; }
+        friend TLane operator/(TLane a, TLane b) { return {vdivq_f32(a.V, b.V)}; }
+        friend TLane Abs(TLane a) { return {vabsq_f32(a.V)}; }
+    };
+#else
+    using TLane = TScalar;
+#endif
+
+    // Runs kernel over [0, size) with full lanes first and single floats for the rest.
+    template<typename TKernel>
+    void ForEachLane(size_t size, TKernel &&kernel) {
+        size_t i = 0;
+        for (; i + TLane::Width <= size; i += TLane::Width) {
+            kernel(TLane{}, i);
+        }
+        for (; i < size; ++i) {
+            kernel(TScalar{}, i);
+        }
+    }
+
+    template<typename L>
+    void MultiplyLane(const array<L, 16> &left, const TMat4Array &right, TMat4Array &result, size_t i) {
+        array<L, 16> r;
+        for (size_t k = 0; k < 16; ++k) {
+            r[k] = L::Load(&right.M[k][i]);
+        }
+        for (size_t column = 0; column < 4; ++column) {
+            for (size_t row = 0; row < 4; ++row) {
+                L sum = left[row] * r[column * 4];
+                for (size_t k = 1; k < 4; ++k) {
+                    sum = sum + left[k * 4 + row] * r[column * 4 + k];
+                }
+                sum.Store(&result.M[column * 4 + row][i]);
+            }
+        }
+    }
+
+    template<typename L>
+    array<L, 16> SplatMatrix(const mat4 &matrix) {
+        array<L, 16> result;
+        for (size_t k = 0; k < 16; ++k) {
+            result[k] = L::Splat(matrix[static_cast<int>(k / 4)][static_cast<int>(k % 4)]);
+        }
+        return result;
+    }
+
+    template<typename L>
+    array<L, 16> LoadMatrix(const TMat4Array &matrices, size_t i) {
+        array<L, 16> result;
+        for (size_t k = 0; k < 16; ++k) {
+            result[k] = L::Load(&matrices.M[k][i]);
+        }
+        return result;
+    }
+
+    template<typename L>
+    void TransformPointLane(const array<L, 16> &m, const TVec3Array &points, TVec3Array &result, size_t i) {
+        L x = L::Load(&points.X[i]);
+        L y = L::Load(&points.Y[i]);
+        L z = L::Load(&points.Z[i]);
+        (m[0] * x + m[4] * y + m[8] * z + m[12]).Store(&result.X[i]);
+        (m[1] * x + m[5] * y + m[9] * z + m[13]).Store(&result.Y[i]);
+        (m[2] * x + m[6] * y + m[10] * z + m[14]).Store(&result.Z[i]);
+    }
+
+    template<typename L>
+    void TransformBoundsLane(const array<L, 16> &m,
+                             const TVec3Array &centers,
+                             const TVec3Array &extents,
+                             TVec3Array &resultCenters,
+                             TVec3Array &resultExtents,
+                             size_t i) {
+        TransformPointLane(m, centers, resultCenters, i);
+        L x = L::Load(&extents.X[i]);
+        L y = L::Load(&extents.Y[i]);
+        L z = L::Load(&extents.Z[i]);
+        (Abs(m[0]) * x + Abs(m[4]) * y + Abs(m[8]) * z).Store(&resultExtents.X[i]);
+        (Abs(m[1]) * x + Abs(m[5]) * y + Abs(m[9]) * z).Store(&resultExtents.Y[i]);
+        (Abs(m[2]) * x + Abs(m[6]) * y + Abs(m[10]) * z).Store(&resultExtents.Z[i]);
+    }
+}
+
+void TVec3Array::Resize(size_t size) {
+    X.resize(size);
+    Y.resize(size);
+    Z.resize(size);
+}
+
+void TVec3Array::Set(size_t index, vec3 value) {
+    X[index] = value.x;
+    Y[index] = value.y;
+    Z[index] = value.z;
+}
+
+void TVec3Array::Push(vec3 value) {
+    X.push_back(value.x);
+    Y.push_back(value.y);
+    Z.push_back(value.z);
+}
+
+vec3 TVec3Array::Get(size_t index) const {
+    return {X[index], Y[index], Z[index]};
+}
+
+void TMat3Array::Resize(size_t size) {
+    for (auto &plane : M) {
+        plane.resize(size);
+    }
+}
+
+void TMat3Array::Set(size_t index, const mat3 &value) {
+    for (int k = 0; k < 9; ++k) {
+        M[k][index] = value[k / 3][k % 3];
+    }
+}
+
+mat3 TMat3Array::Get(size_t index) const {
+    mat3 result;
+    for (int k = 0; k < 9; ++k) {
+        result[k / 3][k % 3] = M[k][index];
+    }
+    return result;
+}
+
+void TMat4Array::Resize(size_t size) {
+    for (auto &plane : M) {
+        plane.resize(size);
+    }
+}
+
+void TMat4Array::Set(size_t index, const mat4 &value) {
+    for (int k = 0; k < 16; ++k) {
+        M[k][index] = value[k / 4][k % 4];
+    }
+}
+
+void TMat4Array::Push(const mat4 &value) {
+    for (int k = 0; k < 16; ++k) {
+        M[k].push_back(value[k / 4][k % 4]);
+    }
+}
+
+mat4 TMat4Array::Get(size_t index) const {
+    mat4 result;
+    for (int k = 0; k < 16; ++k) {
+        result[k / 4][k % 4] = M[k][index];
+    }
+    return result;
+}
+
+namespace NBatchMath {
+    void Multiply(const mat4 &left, const TMat4Array &right, TMat4Array &result) {
+        result.Resize(right.Size());
+        auto lane = SplatMatrix<TLane>(left);
+        auto scalar = SplatMatrix<TScalar>(left);
+        ForEachLane(right.Size(), [&](auto tag, size_t i) {
+            using L = decltype(tag);
+            if constexpr (std::is_same_v<L, TScalar>) {
+                MultiplyLane(scalar, right, result, i);
+            } else {
+                MultiplyLane(lane, right, result, i);
+            }
+        });
+    }
+
+    void Multiply(const TMat4Array &left, const TMat4Array &right, TMat4Array &result) {
+        result.Resize(right.Size());
+        ForEachLane(right.Size(), [&](auto tag, size_t i) {
+            using L = decltype(tag);
+            MultiplyLane(LoadMatrix<L>(left, i), right, result, i);
+        });
+    }
+
+    void NormalMatrices(const TMat4Array &models, TMat3Array &result) {
+        result.Resize(models.Size());
+        ForEachLane(models.Size(), [&](auto tag, size_t i) {
+            using L = decltype(tag);
+            auto m = LoadMatrix<L>(models, i);
+            // Columns a, b, c of the upper 3x3: the inverse transpose is
+            // (b x c, c x a, a x b) / det.
+            L ax = m[0], ay = m[1], az = m[2];
+            L bx = m[4], by = m[5], bz = m[6];
+            L cx = m[8], cy = m[9], cz = m[10];
+            array<L, 9> cofactors{
+                by * cz - bz * cy, bz * cx - bx * cz, bx * cy - by * cx,
+                cy * az - cz * ay, cz * ax - cx * az, cx * ay - cy * ax,
+                ay * bz - az * by, az * bx - ax * bz, ax * by - ay * bx,
+            };
+            L invDet = L::Splat(1.0f) / (ax * cofactors[0] + ay * cofactors[1] + az * cofactors[2]);
+            for (size_t k = 0; k < 9; ++k) {
+                (cofactors[k] * invDet).Store(&result.M[k][i]);
+            }
+        });
+    }
+
+    void TransformPoints(const mat4 &matrix, const TVec3Array &points, TVec3Array &result) {
+        result.Resize(points.Size());
+        auto lane = SplatMatrix<TLane>(matrix);
+        auto scalar = SplatMatrix<TScalar>(matrix);
+        ForEachLane(points.Size(), [&](auto tag, size_t i) {
+            using L = decltype(tag);
+            if constexpr (std::is_same_v<L, TScalar>) {
+                TransformPointLane(scalar, points, result, i);
+            } else {
+                TransformPointLane(lane, points, result, i);
+            }
+        });
+    }
+
+    void TransformPoints(const TMat4Array &matrices, const TVec3Array &points, TVec3Array &result) {
+        result.Resize(points.Size());
+        ForEachLane(points.Size(), [&](auto tag, size_t i) {
+            using L = decltype(tag);
+            TransformPointLane(LoadMatrix<L>(matrices, i), points, result, i);
+        });
+    }
+
+    void TransformBounds(const mat4 &matrix,
+                         const TVec3Array &centers,
+                         const TVec3Array &extents,
+                         TVec3Array &resultCenters,
+                         TVec3Array &resultExtents) {
+        resultCenters.Resize(centers.Size());
+        resultExtents.Resize(centers.Size());
+        auto lane = SplatMatrix<TLane>(matrix);
+        auto scalar = SplatMatrix<TScalar>(matrix);
+        ForEachLane(centers.Size(), [&](auto tag, size_t i) {
+            using L = decltype(tag);
+            if constexpr (std::is_same_v<L, TScalar>) {
+                TransformBoundsLane(scalar, centers, extents, resultCenters, resultExtents, i);
+            } else {
+                TransformBoundsLane(lane, centers, extents, resultCenters, resultExtents, i);
+            }
+        });
+    }
+
+    void TransformBounds(const TMat4Array &matrices,
+                         const TVec3Array &centers,
+                         const TVec3Array &extents,
+                         TVec3Array &resultCenters,
+                         TVec3Array &resultExtents) {
+        resultCenters.Resize(centers.Size());
+        resultExtents.Resize(centers.Size());
+        ForEachLane(centers.Size(), [&](auto tag, size_t i) {
+            using L = decltype(tag);
+            TransformBoundsLane(LoadMatrix<L>(matrices, i), centers, extents, resultCenters, resultExtents, i);
+        });
+    }
+}
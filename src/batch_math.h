@@ -0,0 +1,66 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <array>
+#include <vector>
+
+// Structure of arrays of 3D vectors, kernels process one SIMD lane of elements at a time.
+struct TVec3Array {
+    std::vector<float> X, Y, Z;
+
+    void Resize(size_t size);
+    void Set(size_t index, glm::vec3 value);
+    void Push(glm::vec3 value);
+    [[nodiscard]] glm::vec3 Get(size_t index) const;
+    [[nodiscard]] size_t Size() const { return X.size(); }
+};
+
+// Matrices split into planes, M[column * 3 + row] holds that element of every matrix.
+struct TMat3Array {
+    std::array<std::vector<float>, 9> M;
+
+    void Resize(size_t size);
+    void Set(size_t index, const glm::mat3 &value);
+    [[nodiscard]] glm::mat3 Get(size_t index) const;
+    [[nodiscard]] size_t Size() const { return M[0].size(); }
+};
+
+// Matrices split into planes, M[column * 4 + row] holds that element of every matrix.
+struct TMat4Array {
+    std::array<std::vector<float>, 16> M;
+
+    void Resize(size_t size);
+    void Set(size_t index, const glm::mat4 &value);
+    void Push(const glm::mat4 &value);
+    [[nodiscard]] glm::mat4 Get(size_t index) const;
+    [[nodiscard]] size_t Size() const { return M[0].size(); }
+};
+
+// Batched counterparts of the per-object glm math, vectorized with AVX2, SSE2 or NEON when
+// the target has it. Results are resized to the input size.
+namespace NBatchMath {
+    // result[i] = left * right[i]
+    void Multiply(const glm::mat4 &left, const TMat4Array &right, TMat4Array &result);
+    // result[i] = left[i] * right[i]
+    void Multiply(const TMat4Array &left, const TMat4Array &right, TMat4Array &result);
+
+    // Inverse transpose of the upper 3x3 of every model matrix, from cofactors.
+    void NormalMatrices(const TMat4Array &models, TMat3Array &result);
+
+    // result[i] = matrix * vec4(points[i], 1), without the perspective divide.
+    void TransformPoints(const glm::mat4 &matrix, const TVec3Array &points, TVec3Array &result);
+    // result[i] = matrices[i] * vec4(points[i], 1)
+    void TransformPoints(const TMat4Array &matrices, const TVec3Array &points, TVec3Array &result);
+
+    // Axis aligned boxes given by center and half extent, transformed and re-fitted to the axes:
+    // the center goes through the matrix and the extent through its absolute upper 3x3.
+    void TransformBounds(const glm::mat4 &matrix,
+                         const TVec3Array &centers,
+                         const TVec3Array &extents,
+                         TVec3Array &resultCenters,
+                         TVec3Array &resultExtents);
+    void TransformBounds(const TMat4Array &matrices,
+                         const TVec3Array &centers,
+                         const TVec3Array &extents,
+                         TVec3Array &resultCenters,
+                         TVec3Array &resultExtents);
+}
@@ -0,0 +1,182 @@
+#include "bounds.h"
+#include <algorithm>
+#include <bitset>
+#include <limits>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BOUNDS_SSE
+#endif
+
+using namespace std;
+using namespace glm;
+
+namespace {
+    constexpr size_t MaxFrusta = 8;
+
+    unsigned VisibleOne(const vector<array<vec4, 6>> &frusta, vec3 rangeCenter, float range,
+                        vec3 center, vec3 extent) {
+        // Squared distance from the range center to the nearest point of the box.
+        vec3 outside = max(abs(center - rangeCenter) - extent, vec3(0.0f));
+        if (dot(outside, outside) > range * range) {
+            return 0;
+        }
+        unsigned mask = 0;
+        for (size_t f = 0; f < frusta.size(); ++f) {
+            bool inside = true;
+            for (auto &plane : frusta[f]) {
+                inside = inside && dot(vec3(plane), center) + plane.w + dot(abs(vec3(plane)), extent) >= 0;
+            }
+            mask |= static_cast<unsigned>(inside) << f;
+        }
+        return mask;
+    }
+
+    void Count(TCullStats &stats, unsigned all, const uint8_t *masks, size_t size) {
+        size_t frusta = bitset<MaxFrusta>(all).count();
+        for (size_t i = 0; i < size; ++i) {
+            if (masks[i] == 0) {
+                stats.Culled++;
+            } else {
+                stats.FacesCulled += frusta - bitset<MaxFrusta>(masks[i]).count();
+            }
+        }
+        stats.Tested += size;
+    }
+}
+
+TBounds ComputeBounds(const vector<GLfloat> &vertices, unsigned stride) {
+    if (vertices.size() < stride) {
+        return {};
+    }
+    vec3 low(numeric_limits<float>::max());
+    vec3 high(-numeric_limits<float>::max());
+    for (size_t i = 0; i + 2 < vertices.size(); i += stride) {
+        vec3 p(vertices[i], vertices[i + 1], vertices[i + 2]);
+        low = min(low, p);
+        high = max(high, p);
+    }
+    TBounds bounds{(low + high) * 0.5f, (high - low) * 0.5f, 0.0f};
+    float radius2 = 0;
+    for (size_t i = 0; i + 2 < vertices.size(); i += stride) {
+        vec3 d = vec3(vertices[i], vertices[i + 1], vertices[i + 2]) - bounds.Center;
+        radius2 = std::max(radius2, dot(d, d));
+    }
+    bounds.Radius = std::sqrt(radius2);
+    return bounds;
+}
+
+TBounds MergeBounds(const TBounds &left, const TBounds &right) {
+    vec3 low = min(left.Center - left.Extent, right.Center - right.Extent);
+    vec3 high = max(left.Center + left.Extent, right.Center + right.Extent);
+    vec3 center = (low + high) * 0.5f;
+    float radius = std::max(length(left.Center - center) + left.Radius, length(right.Center - center) + right.Radius);
+    return {center, (high - low) * 0.5f, std::min(radius, length(high - low) * 0.5f)};
+}
+
+array<vec4, 6> FrustumPlanes(const mat4 &m) {
+    auto row = [&](int i) { return vec4(m[0][i], m[1][i], m[2][i], m[3][i]); };
+    array<vec4, 6> planes{
+        row(3) + row(0), row(3) - row(0),
+        row(3) + row(1), row(3) - row(1),
+        row(3) + row(2), row(3) - row(2)};
+    for (auto &plane : planes) {
+        plane = plane / length(vec3(plane));
+    }
+    return planes;
+}
+
+bool SphereVisible(const array<vec4, 6> &planes, vec3 center, float radius) {
+    return all_of(planes.begin(), planes.end(), [&](const vec4 &plane) {
+        return dot(vec3(plane), center) + plane.w >= -radius;
+    });
+}
+
+TFrustumCuller::TFrustumCuller(vector<array<vec4, 6>> frusta)
+    : Frusta(std::move(frusta)) {
+    if (Frusta.size() > MaxFrusta) {
+        throw TGlBaseError("Too many frusta for one pass");
+    }
+}
+
+unsigned TFrustumCuller::Visible(const TBounds &bounds, const mat4 &model) {
+    if (Frusta.empty()) {
+        return AllFrusta();
+    }
+    vec3 center(model * vec4(bounds.Center, 1.0f));
+    mat3 absolute(abs(vec3(model[0])), abs(vec3(model[1])), abs(vec3(model[2])));
+    auto mask = static_cast<uint8_t>(VisibleOne(Frusta, RangeCenter, Range, center, absolute * bounds.Extent));
+    Count(Stats, AllFrusta(), &mask, 1);
+    return mask;
+}
+
+void TFrustumCuller::Cull(const TVec3Array &centers, const TVec3Array &extents, vector<uint8_t> &visible) {
+    size_t size = centers.Size();
+    visible.resize(size);
+    if (Frusta.empty()) {
+        std::fill(visible.begin(), visible.end(), AllFrusta());
+        return;
+    }
+    size_t i = 0;
+#ifdef BOUNDS_SSE
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 rx = _mm_set1_ps(RangeCenter.x);
+    const __m128 ry = _mm_set1_ps(RangeCenter.y);
+    const __m128 rz = _mm_set1_ps(RangeCenter.z);
+    const __m128 range = _mm_set1_ps(Range * Range);
+    for (; i + 4 <= size; i += 4) {
+        __m128 cx = _mm_loadu_ps(&centers.X[i]);
+        __m128 cy = _mm_loadu_ps(&centers.Y[i]);
+        __m128 cz = _mm_loadu_ps(&centers.Z[i]);
+        __m128 ex = _mm_loadu_ps(&extents.X[i]);
+        __m128 ey = _mm_loadu_ps(&extents.Y[i]);
+        __m128 ez = _mm_loadu_ps(&extents.Z[i]);
+        __m128 ox = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(sign, _mm_sub_ps(cx, rx)), ex), zero);
+        __m128 oy = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(sign, _mm_sub_ps(cy, ry)), ey), zero);
+        __m128 oz = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(sign, _mm_sub_ps(cz, rz)), ez), zero);
+        __m128 inRange = _mm_cmple_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz)), range);
+        unsigned masks[4]{};
+        for (size_t f = 0; f < Frusta.size(); ++f) {
+            __m128 frustum = inRange;
+            auto &planes = Frusta[f];
+            for (auto &plane : planes) {
+                __m128 px = _mm_set1_ps(plane.x);
+                __m128 py = _mm_set1_ps(plane.y);
+                __m128 pz = _mm_set1_ps(plane.z);
+                // Distance of the center plus the box's projected radius on the plane normal.
+                __m128 d = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(cx, px), _mm_mul_ps(cy, py)),
+                    _mm_add_ps(_mm_mul_ps(cz, pz), _mm_set1_ps(plane.w)));
+                __m128 r = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(ex, _mm_andnot_ps(sign, px)), _mm_mul_ps(ey, _mm_andnot_ps(sign, py))),
+                    _mm_mul_ps(ez, _mm_andnot_ps(sign, pz)));
+                frustum = _mm_and_ps(frustum, _mm_cmpge_ps(_mm_add_ps(d, r), zero));
+            }
+            auto bits = static_cast<unsigned>(_mm_movemask_ps(frustum));
+            for (unsigned k = 0; k < 4; ++k) {
+                masks[k] |= ((bits >> k) & 1U) << f;
+            }
+        }
+        for (size_t k = 0; k < 4; ++k) {
+            visible[i + k] = static_cast<uint8_t>(masks[k]);
+        }
+    }
+#endif
+    for (; i < size; ++i) {
+        visible[i] = static_cast<uint8_t>(VisibleOne(Frusta, RangeCenter, Range, centers.Get(i), extents.Get(i)));
+    }
+    Count(Stats, AllFrusta(), visible.data(), size);
+}
+
+void TFrustumCuller::Cull(const TMat4Array &models, const TVec3Array &centers, const TVec3Array &extents,
+                          vector<uint8_t> &visible) {
+    NBatchMath::TransformBounds(models, centers, extents, Centers, Extents);
+    Cull(Centers, Extents, visible);
+}
+
+void TFrustumCuller::Cull(const mat4 &model, const TVec3Array &centers, const TVec3Array &extents,
+                          vector<uint8_t> &visible) {
+    NBatchMath::TransformBounds(model, centers, extents, Centers, Extents);
+    Cull(Centers, Extents, visible);
+}
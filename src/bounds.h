@@ -0,0 +1,75 @@
+#pragma once
+#include "common.h"
+#include "batch_math.h"
+#include <array>
+#include <limits>
+#include <vector>
+
+// Axis aligned box given by center and half extent, with the radius of the sphere around
+// the same center that encloses every vertex.
+struct TBounds {
+    glm::vec3 Center{};
+    glm::vec3 Extent{};
+    float Radius{};
+};
+
+// Bounds of the positions in the first three floats of each vertex.
+TBounds ComputeBounds(const std::vector<GLfloat> &vertices, unsigned stride);
+TBounds MergeBounds(const TBounds &left, const TBounds &right);
+
+// Normalized planes of a view projection, pointing inwards: left, right, bottom, top, near, far.
+std::array<glm::vec4, 6> FrustumPlanes(const glm::mat4 &viewProjection);
+// Whether a sphere touches the frustum given by its planes.
+bool SphereVisible(const std::array<glm::vec4, 6> &planes, glm::vec3 center, float radius);
+
+struct TCullStats {
+    size_t Tested = 0;
+    size_t Culled = 0;
+    // Frusta skipped by boxes that touch some other frustum of the pass, e.g. cube map faces.
+    size_t FacesCulled = 0;
+
+    TCullStats &operator+=(const TCullStats &other) {
+        Tested += other.Tested;
+        Culled += other.Culled;
+        FacesCulled += other.FacesCulled;
+        return *this;
+    }
+};
+
+// Tests world space boxes against the frusta of one pass and reports a bit per frustum the box
+// touches, up to eight frusta. A box outside the pass range, a sphere around the light, touches
+// none. Counts every test for the pass statistics.
+class TFrustumCuller {
+private:
+    std::vector<std::array<glm::vec4, 6>> Frusta;
+    glm::vec3 RangeCenter{};
+    float Range = std::numeric_limits<float>::infinity();
+    TVec3Array Centers;
+    TVec3Array Extents;
+    TCullStats Stats;
+
+public:
+    TFrustumCuller() = default;
+    explicit TFrustumCuller(std::vector<std::array<glm::vec4, 6>> frusta);
+
+    void SetRange(glm::vec3 center, float radius) {
+        RangeCenter = center;
+        Range = radius;
+    }
+
+    // Mask of a box touching everything, a single bit when there are no frusta.
+    [[nodiscard]] unsigned AllFrusta() const { return Frusta.empty() ? 1U : (1U << Frusta.size()) - 1; }
+
+    // Local bounds placed by the model matrix, zero when culled. Without frusta everything is
+    // visible.
+    unsigned Visible(const TBounds &bounds, const glm::mat4 &model);
+    // Writes the frustum mask of every box of the batch.
+    void Cull(const TVec3Array &centers, const TVec3Array &extents, std::vector<uint8_t> &visible);
+    // Local bounds of every mesh placed by its own model matrix.
+    void Cull(const TMat4Array &models, const TVec3Array &centers, const TVec3Array &extents,
+              std::vector<uint8_t> &visible);
+    void Cull(const glm::mat4 &model, const TVec3Array &centers, const TVec3Array &extents,
+              std::vector<uint8_t> &visible);
+
+    [[nodiscard]] const TCullStats &GetStats() const { return Stats; }
+};
@@ -1,9 +1,21 @@
 #include "buffer.h"
+#include "gl_state.h"
 
 namespace {
     void FreeBuffer(GLuint *buf) {
+        TGlState::Get().ForgetBuffer(*buf);
         glDeleteBuffers(1, buf);
     }
+
+    // Index buffer bindings belong to the bound VAO, so they are filled through VAO 0 and no
+    // mesh loses its indices.
+    void BindForUpload(GLenum type, GLuint buffer) {
+        auto &state = TGlState::Get();
+        if (type == GL_ELEMENT_ARRAY_BUFFER) {
+            state.BindVertexArray(0);
+        }
+        state.BindBuffer(type, buffer);
+    }
 }
 
 namespace Impl {
@@ -11,46 +23,33 @@ namespace Impl {
         GLuint buffer;
         GL_ASSERT(glGenBuffers(1, &buffer));
         try {
-            GL_ASSERT(glBindBuffer(type, buffer));
+            BindForUpload(type, buffer);
             GL_ASSERT(glBufferData(type, size, data, static_cast<GLenum>(usage)));
-            GL_ASSERT(glBindBuffer(type, 0));
             return std::shared_ptr<GLuint>(new GLuint(buffer), FreeBuffer);
         } catch (...) {
-            glBindBuffer(type, 0);
+            TGlState::Get().ForgetBuffer(buffer);
             glDeleteBuffers(1, &buffer);
             throw;
         }
     }
 
     void Change(GLenum type, GLuint buffer, EBufferUsage usage, const void *data, size_t size) {
-        GL_ASSERT(glBindBuffer(type, buffer));
-        try {
-            GL_ASSERT(glBufferData(type, size, data, static_cast<GLenum>(usage)));
-            GL_ASSERT(glBindBuffer(type, 0));
-        } catch (...) {
-            glBindBuffer(type, 0);
-            throw;
-        }
+        BindForUpload(type, buffer);
+        GL_ASSERT(glBufferData(type, size, data, static_cast<GLenum>(usage)));
     }
 
     void Write(GLenum type, GLuint buffer, const void *data, size_t offset, size_t size) {
-        GL_ASSERT(glBindBuffer(type, buffer));
-        try {
-            GL_ASSERT(glBufferSubData(type, offset, size, data));
-            GL_ASSERT(glBindBuffer(type, 0));
-        } catch (...) {
-            glBindBuffer(type, 0);
-            throw;
-        }
+        BindForUpload(type, buffer);
+        GL_ASSERT(glBufferSubData(type, offset, size, data));
     }
 
     void *MapBuffer(GLenum type, GLuint buffer, bool write) {
-        GL_ASSERT(glBindBuffer(type, buffer));
+        BindForUpload(type, buffer);
         return GL_ASSERTR(glMapBuffer(type, write ? GL_WRITE_ONLY : GL_READ_ONLY));
     }
 
     void *MapBuffer(GLenum type, GLuint buffer, size_t offset, size_t size, bool write) {
-        GL_ASSERT(glBindBuffer(type, buffer));
+        BindForUpload(type, buffer);
         return GL_ASSERTR(glMapBufferRange(type, offset, size, write ? GL_MAP_WRITE_BIT : GL_MAP_READ_BIT));
     }
 
@@ -60,12 +59,7 @@ namespace Impl {
     }
 
     void BindBuffer(GLenum type, GLuint buffer) {
-        GL_ASSERT(glBindBuffer(type, buffer));
-    }
-
-    void UnBindBuffer(GLenum type) {
-        glBindBuffer(type, 0);
-        TGlError::Skip();
+        TGlState::Get().BindBuffer(type, buffer);
     }
 }
 
@@ -21,7 +21,6 @@ namespace Impl {
     void *MapBuffer(GLenum type, GLuint buffer, size_t offset, size_t size, bool write = true);
     void UnmapBuffer(GLenum type);
     void BindBuffer(GLenum type, GLuint buffer);
-    void UnBindBuffer(GLenum type);
 }
 
 template<EBufferType Type>
@@ -112,23 +111,15 @@ public:
     }
 };
 
+// Binds a buffer unless it is empty, it stays bound until something else is.
 template<EBufferType Type>
 class TBufferBinder {
-private:
-    bool Bound;
-
 public:
-    explicit TBufferBinder(const TBuffer<Type> &buffer)
-        : Bound(!buffer.Empty()) {
-        if (Bound) {
+    explicit TBufferBinder(const TBuffer<Type> &buffer) {
+        if (!buffer.Empty()) {
             Impl::BindBuffer(static_cast<GLenum>(Type), *buffer.Buffer);
         }
     }
-    ~TBufferBinder() {
-        if (Bound) {
-            Impl::UnBindBuffer(static_cast<GLenum>(Type));
-        }
-    }
     TBufferBinder(const TBufferBinder &) = delete;
     TBufferBinder &operator=(const TBufferBinder &) = delete;
 };
@@ -0,0 +1,108 @@
+#include "cascades.h"
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <algorithm>
+#include <cmath>
+
+using namespace glm;
+
+namespace {
+    // Slice radii are rounded up to this fraction of a unit so float noise in the corners
+    // doesn't change the cascade size between frames.
+    constexpr float RadiusStep = 1.0f / 16;
+}
+
+TShadowCascades::TShadowCascades(const TCascadeBuilder &builder)
+    : Settings(builder) {
+    if (Settings.Count_ < 1 || Settings.Count_ > MaxCascades) {
+        throw TGlBaseError("Shadow cascade count must be 1 to 4");
+    }
+    auto atlas = vec2(GetAtlasSize());
+    for (int i = 0; i < Settings.Count_; ++i) {
+        int size = Settings.Resolution_;
+        ivec2 origin(i % 2 * size, i / 2 * size);
+        Cascades[i].Viewport = ivec4(origin.x, origin.y, size, size);
+        Cascades[i].Rect = vec4(origin.x / atlas.x, origin.y / atlas.y, size / atlas.x, size / atlas.y);
+        Rects[i] = Cascades[i].Rect;
+    }
+}
+
+glm::ivec2 TShadowCascades::GetAtlasSize() const {
+    return {Settings.Resolution_ * (Settings.Count_ > 1 ? 2 : 1), Settings.Resolution_ * (Settings.Count_ > 2 ? 2 : 1)};
+}
+
+void TShadowCascades::Fit(const mat4 &projection, const mat4 &view, vec3 direction) {
+    bool perspective = projection[3][3] == 0;
+    float nearPlane = perspective ? projection[3][2] / (projection[2][2] - 1.0f)
+                             : (projection[3][2] + 1.0f) / projection[2][2];
+    float farPlane = perspective ? projection[3][2] / (projection[2][2] + 1.0f)
+                            : (projection[3][2] - 1.0f) / projection[2][2];
+    float shadowFar = std::min(farPlane, Settings.Distance_);
+
+    // Frustum edges in world space, points at any view depth are interpolated along them.
+    mat4 inverseViewProjection = inverse(projection * view);
+    std::array<vec3, 4> nearCorners{};
+    std::array<vec3, 4> farCorners{};
+    for (int k = 0; k < 4; ++k) {
+        float x = k & 1 ? 1.0f : -1.0f;
+        float y = k & 2 ? 1.0f : -1.0f;
+        vec4 n = inverseViewProjection * vec4(x, y, -1.0f, 1.0f);
+        vec4 f = inverseViewProjection * vec4(x, y, 1.0f, 1.0f);
+        nearCorners[k] = vec3(n) / n.w;
+        farCorners[k] = vec3(f) / f.w;
+    }
+    auto corner = [&](int k, float depth) {
+        return mix(nearCorners[k], farCorners[k], (depth - nearPlane) / (farPlane - nearPlane));
+    };
+
+    direction = normalize(direction);
+    bool turned = direction != Direction;
+    Direction = direction;
+    vec3 up = std::abs(direction.y) > 0.99f ? vec3(0, 0, 1) : vec3(0, 1, 0);
+    mat4 lightView = lookAt(vec3(0.0f), direction, up);
+    int count = Settings.Count_;
+    float begin = nearPlane;
+    for (int i = 0; i < count; ++i) {
+        float t = static_cast<float>(i + 1) / static_cast<float>(count);
+        float logarithmic = nearPlane * std::pow(shadowFar / nearPlane, t);
+        float uniform = nearPlane + (shadowFar - nearPlane) * t;
+        float end = mix(uniform, logarithmic, Settings.Lambda_);
+
+        std::array<vec3, 8> points{};
+        vec3 center(0.0f);
+        for (int k = 0; k < 4; ++k) {
+            points[k] = corner(k, begin);
+            points[k + 4] = corner(k, end);
+        }
+        for (auto &point : points) {
+            center += point / 8.0f;
+        }
+        float radius = 0;
+        for (auto &point : points) {
+            radius = std::max(radius, length(point - center));
+        }
+        radius = std::ceil(radius / RadiusStep) * RadiusStep;
+        begin = end;
+
+        vec3 slice(lightView * vec4(center, 1.0f));
+        float half = radius * (1.0f + Settings.Margin_);
+        vec3 offset = abs(slice - Origins[i]);
+        bool covered = std::max(offset.x, std::max(offset.y, offset.z)) + radius <= half;
+        if (!turned && SliceRadii[i] == radius && covered) {
+            continue;
+        }
+        // The depth range is snapped too, so the region is a function of the slice position
+        // alone and equal slices give equal matrices.
+        float texel = 2.0f * half / static_cast<float>(Settings.Resolution_);
+        vec3 origin = floor(slice / texel) * texel;
+        mat4 ortho = glm::ortho(origin.x - half, origin.x + half,
+                                origin.y - half, origin.y + half,
+                                -origin.z - half - Settings.CasterReach_, -origin.z + half);
+        Origins[i] = origin;
+        SliceRadii[i] = radius;
+        Cascades[i].Matrix = ortho * lightView;
+        Cascades[i].Projection = ortho;
+        Cascades[i].Radius = half;
+        Matrices[i] = Cascades[i].Matrix;
+    }
+}
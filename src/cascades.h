@@ -0,0 +1,71 @@
+#pragma once
+#include "common.h"
+#include <array>
+
+class TCascadeBuilder {
+public:
+    BUILDER_PROPERTY(int, Count){3};
+    // Split scheme: 0 divides the shadowed depth range uniformly, 1 logarithmically, values in
+    // between blend the two.
+    BUILDER_PROPERTY(float, Lambda){0.8f};
+    // Shadows end this far from the camera, or at its far plane when that is closer.
+    BUILDER_PROPERTY(float, Distance){150.0f};
+    // Casters up to this far beyond a cascade towards the light still land in its depth range.
+    BUILDER_PROPERTY(float, CasterReach){100.0f};
+    // Texels per cascade side, cascades are packed two per row into one atlas.
+    BUILDER_PROPERTY(int, Resolution){1024};
+    // Part of a cascade next to its border that fades into the next cascade, in NDC units.
+    BUILDER_PROPERTY(float, Blend){0.1f};
+    // Cascades cover this much more than their slice, relative to its radius, so the camera can
+    // move and turn a little before a cascade has to follow it.
+    BUILDER_PROPERTY(float, Margin){0.25f};
+};
+
+struct TCascade {
+    // World space to the cascade's light clip space.
+    glm::mat4 Matrix{1.0f};
+    // Its orthographic part alone, for detail level selection.
+    glm::mat4 Projection{1.0f};
+    // Atlas region as offset and scale of texture coordinates.
+    glm::vec4 Rect{};
+    // The same region in texels.
+    glm::ivec4 Viewport{};
+    // Half the side of the covered region.
+    float Radius{};
+};
+
+// Directional shadow cascades covering consecutive depth slices of the camera frustum. Each
+// cascade is fitted to a sphere around its slice, so its size doesn't change as the camera
+// turns, and its origin is snapped to whole texels, so shadow edges don't crawl as it moves.
+// A cascade only moves when its slice leaves the covered region, the slice size changes or the
+// light turns, so its matrix stays the same over most frames.
+class TShadowCascades {
+public:
+    static constexpr int MaxCascades = 4;
+
+private:
+    TCascadeBuilder Settings;
+    std::array<TCascade, MaxCascades> Cascades;
+    std::array<glm::mat4, MaxCascades> Matrices{};
+    std::array<glm::vec4, MaxCascades> Rects{};
+    // Light direction the cascades were placed for, with each cascade's light space center and
+    // the slice radius it was fitted to.
+    glm::vec3 Direction{};
+    std::array<glm::vec3, MaxCascades> Origins{};
+    std::array<float, MaxCascades> SliceRadii{};
+
+public:
+    explicit TShadowCascades(const TCascadeBuilder &builder);
+
+    // Moves the cascades that no longer cover their slice of the camera frustum.
+    void Fit(const glm::mat4 &projection, const glm::mat4 &view, glm::vec3 direction);
+
+    [[nodiscard]] glm::ivec2 GetAtlasSize() const;
+    [[nodiscard]] int GetCount() const { return Settings.Count_; }
+    [[nodiscard]] const TCascade &Get(int index) const { return Cascades.at(index); }
+    // Per cascade values laid out for the scene shader's uniform arrays.
+    [[nodiscard]] const std::array<glm::mat4, MaxCascades> &GetMatrices() const { return Matrices; }
+    [[nodiscard]] const std::array<glm::vec4, MaxCascades> &GetRects() const { return Rects; }
+    [[nodiscard]] float GetBlend() const { return Settings.Blend_; }
+    [[nodiscard]] int GetResolution() const { return Settings.Resolution_; }
+};
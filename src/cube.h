@@ -1,6 +1,10 @@
 #pragma once
 #include "common.h"
 #include "const_math.h"
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <utility>
 
 class TGeomBuilder {
 public:
@@ -10,249 +14,402 @@ public:
     BUILDER_PROPERTY3(float, float, float, Position){0.0f, 0.0f, 0.0f};
     BUILDER_PROPERTY2(float, float, TextureMul){1.0f, 1.0f};
     BUILDER_PROPERTY2(float, float, TextureOffset){0.0f, 0.0f};
+    // Quads along each edge of a cube face. Projections that bend straight lines, like dual
+    // paraboloid shadows, need large faces split into smaller ones.
+    BUILDER_PROPERTY(unsigned, Segments){1};
+};
+
+// Indexed generators share every vertex between the triangles using it. The *Geometry
+// functions build vectors at run time with exact math, for meshes of any size. IndexedSphere,
+// IndexedQuad, IndexedDoubleQuad and IndexedCube run the same code through the constexpr
+// approximations of const_math.h into fixed arrays, with 16 bit indices when they can address
+// every vertex, so small meshes can be built at compile time.
+struct TGeometry {
+    std::vector<GLfloat> Vertices;
+    std::vector<GLuint> Indices;
+};
+
+template<typename TVertices, typename TIndices>
+struct TFixedGeometry {
+    TVertices Vertices;
+    TIndices Indices;
 };
 
 namespace Impl {
-    constexpr std::array<std::tuple<glm::vec2, glm::vec2>, 6> QuadPoints = {
+    constexpr std::array<std::tuple<glm::vec2, glm::vec2>, 4> QuadCorners = {
         std::tuple{glm::vec2{1.0f, 1.0f}, glm::vec2{1, 0}}, // upper right
         std::tuple{glm::vec2{-1.0f, 1.0f}, glm::vec2{0, 0}}, // upper left
         std::tuple{glm::vec2{1.0f, -1.0f}, glm::vec2{1, 1}}, // lower right
-
-        std::tuple{glm::vec2{1.0f, -1.0f}, glm::vec2{1, 1}}, // lower right
-        std::tuple{glm::vec2{-1.0f, 1.0f}, glm::vec2{0, 0}}, // upper left
         std::tuple{glm::vec2{-1.0f, -1.0f}, glm::vec2{0, 1}}, // lower left
     };
+    constexpr std::array<GLuint, 6> QuadIndices = {0, 1, 2, 2, 1, 3};
+    constexpr std::array<GLuint, 6> BackQuadIndices = {0, 2, 1, 2, 3, 1};
 
-    constexpr std::array<std::tuple<glm::vec2, glm::vec2>, 6> BackQuadPoints = {
-        std::tuple{glm::vec2{1.0f, 1.0f}, glm::vec2{1, 0}}, // upper right
-        std::tuple{glm::vec2{1.0f, -1.0f}, glm::vec2{1, 1}}, // lower right
-        std::tuple{glm::vec2{-1.0f, 1.0f}, glm::vec2{0, 0}}, // upper left
+    // Frame of the front quad, the tangent follows u and the bitangent v.
+    constexpr glm::vec3 Normal{0, 0, 1};
+    constexpr glm::vec3 Tangent{1, 0, 0};
+    constexpr glm::vec3 BiTangent{0, -1, 0};
 
-        std::tuple{glm::vec2{1.0f, -1.0f}, glm::vec2{1, 1}}, // lower right
-        std::tuple{glm::vec2{-1.0f, -1.0f}, glm::vec2{0, 1}}, // lower left
-        std::tuple{glm::vec2{-1.0f, 1.0f}, glm::vec2{0, 0}}, // upper left
+    // Rotation given by the images of the x, y and z axes. Applying it takes vector arithmetic
+    // only, so it works in constant expressions.
+    struct TFrame {
+        glm::vec3 X, Y, Z;
     };
 
-    constexpr std::array<glm::vec3, 6> Octo = {
-        glm::vec3{0.0f, 1.0f, 0.0f},
-        glm::vec3{0.0f, 0.0f, 1.0f},
-        glm::vec3{1.0f, 0.0f, 0.0f},
+    constexpr glm::vec3 Rotate(const TFrame &frame, glm::vec3 v) {
+        return frame.X * v.x + frame.Y * v.y + frame.Z * v.z;
+    }
+
+    // The front quad turned onto the cube faces: front, top, back, bottom, right and left.
+    constexpr std::array<TFrame, 6> CubeFaces = {{
+        {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}},
+        {{1, 0, 0}, {0, 0, 1}, {0, -1, 0}},
+        {{1, 0, 0}, {0, -1, 0}, {0, 0, -1}},
+        {{1, 0, 0}, {0, 0, -1}, {0, 1, 0}},
+        {{0, 0, -1}, {0, 1, 0}, {1, 0, 0}},
+        {{0, 0, 1}, {0, 1, 0}, {-1, 0, 0}},
+    }};
 
-        glm::vec3{0.0f, -1.0f, 0.0f},
-        glm::vec3{1.0f, 0.0f, 0.0f},
-        glm::vec3{0.0f, 0.0f, 1.0f},
+    constexpr double Phi = 1.61803398874989484820;
+    constexpr std::array<glm::vec3, 12> Icosahedron = {
+        glm::vec3{-1, Phi, 0}, glm::vec3{1, Phi, 0}, glm::vec3{-1, -Phi, 0}, glm::vec3{1, -Phi, 0},
+        glm::vec3{0, -1, Phi}, glm::vec3{0, 1, Phi}, glm::vec3{0, -1, -Phi}, glm::vec3{0, 1, -Phi},
+        glm::vec3{Phi, 0, -1}, glm::vec3{Phi, 0, 1}, glm::vec3{-Phi, 0, -1}, glm::vec3{-Phi, 0, 1},
     };
+    constexpr std::array<std::array<GLuint, 3>, 20> IcosahedronFaces = {{
+        {0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11},
+        {1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+        {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9},
+        {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1},
+    }};
 
-    constexpr glm::vec3 Tangent{NConstMath::Normalize(std::get<0>(QuadPoints[0]) - std::get<0>(QuadPoints[1])), 0};
-    constexpr glm::vec3 BiTangent{NConstMath::Normalize(std::get<0>(QuadPoints[5]) - std::get<0>(QuadPoints[1])), 0};
-    constexpr glm::vec3 Normal{0, 0, 1};
-}
+    // Exact math of the run time generators.
+    struct TRuntimeMath {
+        static glm::vec3 Normalize(glm::vec3 v) { return glm::normalize(v); }
 
-template<int Level>
-constexpr auto SphereMesh() {
-    if constexpr (Level == 0) {
-        std::array<glm::vec3, Impl::Octo.size() * 4> result{};
-        size_t k = 0;
-        for (size_t i = 0; i < 4; i++) {
-            auto rot = NConstMath::RotateY3(i * M_PI_2);
-            for (auto v : Impl::Octo) {
-                result[k++] = rot * v;
-            }
+        // Turns around +Y from +Z towards +X, in [0, 1).
+        static float Longitude(glm::vec3 point) {
+            double u = std::atan2(point.x, point.z) / (2 * M_PI);
+            return static_cast<float>(u < 0 ? u + 1 : u);
         }
-        return result;
-    } else {
-        auto up = SphereMesh<Level - 1>();
-        std::array<glm::vec3, up.size() * 4> result{};
-        size_t k = 0;
-        for (size_t i = 0; i < up.size(); i += 3) {
-            glm::vec3 center[3]{
-                NConstMath::Normalize(up[i] + up[i + 1]),
-                NConstMath::Normalize(up[i + 1] + up[i + 2]),
-                NConstMath::Normalize(up[i + 2] + up[i])};
-            result[k++] = center[0];
-            result[k++] = center[1];
-            result[k++] = center[2];
-            result[k++] = up[i];
-            result[k++] = center[0];
-            result[k++] = center[2];
-            result[k++] = up[i + 1];
-            result[k++] = center[1];
-            result[k++] = center[0];
-            result[k++] = up[i + 2];
-            result[k++] = center[2];
-            result[k++] = center[1];
+
+        static float Latitude(float y) {
+            return static_cast<float>(0.5 + std::asin(std::clamp(y, -1.0f, 1.0f)) / M_PI);
         }
-        return result;
-    }
-}
 
-#include <iostream>
-
-template<bool Normals = true, bool Texture = true, bool Tangents = false, int Level = 3>
-constexpr auto Sphere(TGeomBuilder builder = {}) {
-    using namespace std;
-    using namespace glm;
-    auto mesh = SphereMesh<Level>();
-    constexpr int stride = (Normals ? 3 : 0) + (Texture ? 2 : 0) + (Tangents ? 6 : 0) + 3 * 1.0f;
-    std::array<GLfloat, mesh.size() * stride> vertices{};
-    size_t k = 0;
-    for (int i = 0; i < mesh.size(); i += 3) {
-        for (int j = 0; j < 3; ++j) {
-            auto point = mesh[i + j];
-            vertices[k++] = builder.Size_ * point.x;
-            vertices[k++] = builder.Size_ * point.y;
-            vertices[k++] = builder.Size_ * point.z;
-            if (Normals) {
-                vertices[k++] = point.x;
-                vertices[k++] = point.y;
-                vertices[k++] = point.z;
-            }
-            vec2 radial = NConstMath::Normalize(glm::vec2(point.x, point.z));
-            if (Texture) {
-                double x = 0;
-                if (point.z < 0) x = 0.5 - NConstMath::Asin(radial.x) / M_PI / 2.0;
-                else if (point.x < 0) x = 1.0 + NConstMath::Asin(radial.x) / M_PI / 2.0;
-                else x = NConstMath::Asin(radial.x) / M_PI / 2.0;
-                if (x == 0) {
-                    for (size_t l = 0; l < 3; ++l) {
-                        if (mesh[i + l].x < 0)
-                            x = 1.0;
-                    }
-                }
-                double y = 0.5 + NConstMath::Asin(point.y) / M_PI;
-                vertices[k++] = static_cast<float>(x);
-                vertices[k++] = static_cast<float>(y);
-            }
-            if (Tangents) {
-                vec3 tg {-radial.y, 0, radial.x};
-                vec3 btg = glm::cross(point, tg);
-                vertices[k++] = tg.x;
-                vertices[k++] = tg.y;
-                vertices[k++] = tg.z;
-                vertices[k++] = btg.x;
-                vertices[k++] = btg.y;
-                vertices[k++] = btg.z;
-            }
+        static double Sin(double x) { return std::sin(x); }
+        static double Cos(double x) { return std::cos(x); }
+    };
+
+    // The constexpr approximations, for the fixed array generators.
+    struct TConstMath {
+        static constexpr glm::vec3 Normalize(glm::vec3 v) { return NConstMath::Normalize(v); }
+
+        static constexpr float Longitude(glm::vec3 point) {
+            glm::vec2 radial = NConstMath::Normalize(glm::vec2(point.x, point.z));
+            double u = NConstMath::Asin(radial.x) / M_PI / 2.0;
+            if (point.z < 0) return static_cast<float>(0.5 - u);
+            if (point.x < 0) return static_cast<float>(1.0 + u);
+            return static_cast<float>(u);
         }
-    }
-    return vertices;
-}
 
-template<bool Normals = true, bool Texture = true, bool Tangents = false>
-constexpr auto Quad(TGeomBuilder builder = {}) {
-    using namespace std;
-    const glm::vec3 pos{get<0>(builder.Position_), get<1>(builder.Position_), get<2>(builder.Position_)};
-    constexpr int stride = (Normals ? 3 : 0) + (Texture ? 2 : 0) + (Tangents ? 6 : 0) + 3 * 1.0f;
-    std::array<GLfloat, 6 * stride> vertices{};
-    size_t k = 0;
-    for (auto point : Impl::QuadPoints) {
-        auto r = glm::vec3(std::get<0>(point), 0.0f) * builder.Size_ + pos;
-        vertices[k++] = r.x;
-        vertices[k++] = r.y;
-        vertices[k++] = r.z;
+        static constexpr float Latitude(float y) {
+            return static_cast<float>(0.5 + NConstMath::Asin(y) / M_PI);
+        }
+
+        static constexpr double Sin(double x) { return NConstMath::Sin(x); }
+        static constexpr double Cos(double x) { return NConstMath::Cos(x); }
+    };
+
+    template<bool Normals, bool Texture, bool Tangents>
+    constexpr unsigned GeomStride = 3 + (Normals ? 3 : 0) + (Texture ? 2 : 0) + (Tangents ? 6 : 0);
+
+    template<bool Normals, bool Texture, bool Tangents>
+    constexpr void AppendVertex(std::vector<GLfloat> &vertices,
+                                const TGeomBuilder &builder,
+                                glm::vec3 point,
+                                glm::vec3 normal,
+                                glm::vec2 texture,
+                                glm::vec3 tangent,
+                                glm::vec3 bitangent) {
+        using namespace std;
+        vertices.push_back(point.x * builder.Size_ + get<0>(builder.Position_));
+        vertices.push_back(point.y * builder.Size_ + get<1>(builder.Position_));
+        vertices.push_back(point.z * builder.Size_ + get<2>(builder.Position_));
         if (Normals) {
-            vertices[k++] = Impl::Normal.x;
-            vertices[k++] = Impl::Normal.y;
-            vertices[k++] = Impl::Normal.z;
+            vertices.insert(vertices.end(), {normal.x, normal.y, normal.z});
         }
         if (Texture) {
-            auto t = std::get<1>(point);
-            vertices[k++] = t.x * get<0>(builder.TextureMul_) + get<0>(builder.TextureOffset_);
-            vertices[k++] = t.y * get<1>(builder.TextureMul_) + get<1>(builder.TextureOffset_);
+            vertices.push_back(texture.x * get<0>(builder.TextureMul_) + get<0>(builder.TextureOffset_));
+            vertices.push_back(texture.y * get<1>(builder.TextureMul_) + get<1>(builder.TextureOffset_));
         }
         if (Tangents) {
-            vertices[k++] = Impl::Tangent.x;
-            vertices[k++] = Impl::Tangent.y;
-            vertices[k++] = Impl::Tangent.z;
-            vertices[k++] = Impl::BiTangent.x;
-            vertices[k++] = Impl::BiTangent.y;
-            vertices[k++] = Impl::BiTangent.z;
+            vertices.insert(vertices.end(), {tangent.x, tangent.y, tangent.z, bitangent.x, bitangent.y, bitangent.z});
         }
     }
-    return vertices;
-}
 
-template<bool Normals = true, bool Texture = true, bool Tangents = false>
-constexpr auto DoubleQuad(TGeomBuilder builder = {}) {
-    using namespace std;
-    using namespace glm;
-    const glm::vec3 pos{get<0>(builder.Position_), get<1>(builder.Position_), get<2>(builder.Position_)};
-    constexpr int stride = (Normals ? 3 : 0) + (Texture ? 2 : 0) + (Tangents ? 6 : 0) + 3 * 1.0f;
-    std::array<GLfloat, 12 * stride> vertices{};
-    size_t k = 0;
-    for (auto pset : {tuple(Impl::QuadPoints, vec3(0, 0, 1)), tuple(Impl::BackQuadPoints, vec3(0, 0, -1))}) {
-        for (auto point : get<0>(pset)) {
-            auto r = glm::vec3(std::get<0>(point), 0.0f) * builder.Size_ + pos;
-            vertices[k++] = r.x;
-            vertices[k++] = r.y;
-            vertices[k++] = r.z;
-            if (Normals) {
-                auto n = get<1>(pset);
-                vertices[k++] = n.x;
-                vertices[k++] = n.y;
-                vertices[k++] = n.z;
+    constexpr glm::vec3 Cross(glm::vec3 a, glm::vec3 b) {
+        return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+    }
+
+    // Subdivided icosahedron with (1 << level) segments per edge: 10 * 4^level + 2 shared
+    // vertices plus the copies texture coordinates need along the seam and at the poles.
+    template<typename TMath, bool Normals, bool Texture, bool Tangents>
+    constexpr TGeometry SphereGeometry(unsigned level, const TGeomBuilder &builder) {
+        using namespace std;
+        using namespace glm;
+        const GLuint n = 1U << level;
+        const GLuint corners = Icosahedron.size();
+
+        // Edge ids by corner pair, interior edge vertices are stored from the lower corner up.
+        array<array<GLuint, 12>, 12> edges{};
+        vector<array<GLuint, 2>> edgeCorners;
+        for (auto &face : IcosahedronFaces) {
+            for (size_t k = 0; k < 3; ++k) {
+                GLuint a = face[k], b = face[(k + 1) % 3];
+                if (a < b) {
+                    edges[a][b] = edges[b][a] = static_cast<GLuint>(edgeCorners.size());
+                    edgeCorners.push_back({a, b});
+                }
+            }
+        }
+
+        vector<vec3> points;
+        points.reserve(10 * n * n + 2);
+        for (auto corner : Icosahedron) {
+            points.push_back(TMath::Normalize(corner));
+        }
+        for (auto [a, b] : edgeCorners) {
+            for (GLuint k = 1; k < n; ++k) {
+                float t = static_cast<float>(k) / static_cast<float>(n);
+                points.push_back(TMath::Normalize(points[a] + (points[b] - points[a]) * t));
+            }
+        }
+        auto edgeVertex = [&](GLuint a, GLuint b, GLuint k) {
+            GLuint step = a < b ? k : n - k;
+            return corners + edges[a][b] * (n - 1) + step - 1;
+        };
+
+        vector<GLuint> indices;
+        indices.reserve(60 * n * n);
+        for (GLuint f = 0; f < IcosahedronFaces.size(); ++f) {
+            GLuint a = IcosahedronFaces[f][0];
+            GLuint b = IcosahedronFaces[f][1];
+            GLuint c = IcosahedronFaces[f][2];
+            GLuint interior = static_cast<GLuint>(points.size());
+            for (GLuint i = 1; i + 1 < n; ++i) {
+                for (GLuint j = 1; i + j < n; ++j) {
+                    vec3 p = points[a] + (points[b] - points[a]) * (static_cast<float>(i) / static_cast<float>(n))
+                        + (points[c] - points[a]) * (static_cast<float>(j) / static_cast<float>(n));
+                    points.push_back(TMath::Normalize(p));
+                }
+            }
+            // Point i steps along ab and j steps along ac.
+            auto vertex = [&](GLuint i, GLuint j) {
+                if (i == 0 && j == 0) return a;
+                if (i == n) return b;
+                if (j == n) return c;
+                if (j == 0) return edgeVertex(a, b, i);
+                if (i == 0) return edgeVertex(a, c, j);
+                if (i + j == n) return edgeVertex(b, c, j);
+                return interior + (i - 1) * (n - 1) - i * (i - 1) / 2 + j - 1;
+            };
+            for (GLuint i = 0; i < n; ++i) {
+                for (GLuint j = 0; i + j < n; ++j) {
+                    indices.insert(indices.end(), {vertex(i, j), vertex(i + 1, j), vertex(i, j + 1)});
+                    if (i + j + 1 < n) {
+                        indices.insert(indices.end(), {vertex(i + 1, j), vertex(i + 1, j + 1), vertex(i, j + 1)});
+                    }
+                }
             }
-            if (Texture) {
-                auto t = std::get<1>(point);
-                vertices[k++] = t.x * get<0>(builder.TextureMul_) + get<0>(builder.TextureOffset_);
-                vertices[k++] = t.y * get<1>(builder.TextureMul_) + get<1>(builder.TextureOffset_);
+        }
+
+        auto pole = [](vec3 p) { return p.x * p.x + p.z * p.z < 1e-12f; };
+        vector<vec2> uvs(points.size());
+        for (size_t i = 0; i < points.size(); ++i) {
+            auto p = points[i];
+            uvs[i] = vec2(pole(p) ? 0.0f : TMath::Longitude(p), TMath::Latitude(p.y));
+        }
+        if (Texture) {
+            // Triangles crossing the seam take copies of their low side vertices shifted by one
+            // turn, pole vertices get a copy per triangle centered between the other two.
+            vector<GLuint> shifted(points.size(), 0);
+            for (size_t t = 0; t < indices.size(); t += 3) {
+                GLuint *triangle = &indices[t];
+                float low = 1, high = 0;
+                for (size_t k = 0; k < 3; ++k) {
+                    if (pole(points[triangle[k]])) continue;
+                    low = std::min(low, uvs[triangle[k]].x);
+                    high = std::max(high, uvs[triangle[k]].x);
+                }
+                if (high - low > 0.5f) {
+                    for (size_t k = 0; k < 3; ++k) {
+                        GLuint v = triangle[k];
+                        if (uvs[v].x >= 0.5f || pole(points[v])) continue;
+                        if (shifted[v] == 0) {
+                            shifted[v] = static_cast<GLuint>(points.size());
+                            points.push_back(points[v]);
+                            uvs.push_back(uvs[v] + vec2(1, 0));
+                        }
+                        triangle[k] = shifted[v];
+                    }
+                }
+                for (size_t k = 0; k < 3; ++k) {
+                    auto p = points[triangle[k]];
+                    if (!pole(p)) continue;
+                    float u = (uvs[triangle[(k + 1) % 3]].x + uvs[triangle[(k + 2) % 3]].x) / 2;
+                    triangle[k] = static_cast<GLuint>(points.size());
+                    points.push_back(p);
+                    uvs.push_back(vec2(u, p.y > 0 ? 1.0f : 0.0f));
+                }
             }
-            if (Tangents) {
-                vertices[k++] = Impl::Tangent.x;
-                vertices[k++] = Impl::Tangent.y;
-                vertices[k++] = Impl::Tangent.z;
-                vertices[k++] = Impl::BiTangent.x;
-                vertices[k++] = Impl::BiTangent.y;
-                vertices[k++] = Impl::BiTangent.z;
+        }
+
+        TGeometry result;
+        result.Vertices.reserve(points.size() * GeomStride<Normals, Texture, Tangents>);
+        for (size_t i = 0; i < points.size(); ++i) {
+            auto p = points[i];
+            double angle = 2 * M_PI * uvs[i].x;
+            vec3 tangent(TMath::Cos(angle), 0, -TMath::Sin(angle));
+            AppendVertex<Normals, Texture, Tangents>(result.Vertices, builder, p, p, uvs[i], tangent,
+                                                     Cross(p, tangent));
+        }
+        if (builder.Backward_) {
+            for (size_t t = 0; t < indices.size(); t += 3) {
+                std::swap(indices[t + 1], indices[t + 2]);
             }
         }
+        result.Indices = std::move(indices);
+        return result;
     }
-    return vertices;
-}
 
-template<bool Normals = true, bool Texture = true, bool Tangents = false>
-constexpr auto Cube(TGeomBuilder builder = {}) {
-    using namespace std;
-    const glm::vec3 pos{get<0>(builder.Position_), get<1>(builder.Position_), get<2>(builder.Position_)};
-    constexpr int stride = (Normals ? 3 : 0) + (Texture ? 2 : 0) + (Tangents ? 6 : 0) + 3 * 1.0f;
-    std::array<glm::mat3, 6> rotations = {
-        NConstMath::RotateX3(0),
-        NConstMath::RotateX3(M_PI_2),
-        NConstMath::RotateX3(M_PI),
-        NConstMath::RotateX3(-M_PI_2),
-        NConstMath::RotateY3(M_PI_2),
-        NConstMath::RotateY3(-M_PI_2)
-    };
-    std::array<GLfloat, stride * rotations.size() * 6> vertices{};
-    size_t k = 0;
-    for (auto rotation : rotations) {
-        for (auto point : builder.Backward_ ? Impl::BackQuadPoints : Impl::QuadPoints) {
-            auto r = rotation * glm::vec3(std::get<0>(point), 1.0f) * builder.Size_ + pos;
-            vertices[k++] = r.x;
-            vertices[k++] = r.y;
-            vertices[k++] = r.z;
-            if (Normals) {
-                auto n = rotation * Impl::Normal;
-                vertices[k++] = n.x;
-                vertices[k++] = n.y;
-                vertices[k++] = n.z;
+    template<bool Normals, bool Texture, bool Tangents>
+    constexpr TGeometry QuadGeometry(const TGeomBuilder &builder) {
+        TGeometry result;
+        for (auto [point, texture] : QuadCorners) {
+            AppendVertex<Normals, Texture, Tangents>(result.Vertices, builder, glm::vec3(point, 0.0f),
+                                                     Normal, texture, Tangent, BiTangent);
+        }
+        auto &indices = builder.Backward_ ? BackQuadIndices : QuadIndices;
+        result.Indices.assign(indices.begin(), indices.end());
+        return result;
+    }
+
+    template<bool Normals, bool Texture, bool Tangents>
+    constexpr TGeometry DoubleQuadGeometry(const TGeomBuilder &builder) {
+        TGeometry result;
+        for (auto normal : {Normal, -Normal}) {
+            for (auto [point, texture] : QuadCorners) {
+                AppendVertex<Normals, Texture, Tangents>(result.Vertices, builder, glm::vec3(point, 0.0f),
+                                                         normal, texture, Tangent, BiTangent);
             }
-            if (Texture) {
-                auto t = std::get<1>(point);
-                vertices[k++] = t.x * get<0>(builder.TextureMul_) + get<0>(builder.TextureOffset_);
-                vertices[k++] = t.y * get<1>(builder.TextureMul_) + get<1>(builder.TextureOffset_);
+        }
+        result.Indices.assign(QuadIndices.begin(), QuadIndices.end());
+        for (auto index : BackQuadIndices) {
+            result.Indices.push_back(index + 4);
+        }
+        return result;
+    }
+
+    template<bool Normals, bool Texture, bool Tangents>
+    constexpr TGeometry CubeGeometry(const TGeomBuilder &builder) {
+        TGeometry result;
+        auto &indices = builder.Backward_ ? BackQuadIndices : QuadIndices;
+        GLuint segments = std::max(builder.Segments_, 1U);
+        GLuint side = segments + 1;
+        for (GLuint face = 0; face < CubeFaces.size(); ++face) {
+            auto &frame = CubeFaces[face];
+            GLuint first = face * side * side;
+            // A grid per face with texture coordinates spanning the whole face, cells are split
+            // like the single quad.
+            for (GLuint row = 0; row < side; ++row) {
+                for (GLuint column = 0; column < side; ++column) {
+                    float u = static_cast<float>(column) / static_cast<float>(segments);
+                    float v = static_cast<float>(row) / static_cast<float>(segments);
+                    glm::vec2 point{2.0f * u - 1.0f, 1.0f - 2.0f * v};
+                    AppendVertex<Normals, Texture, Tangents>(result.Vertices, builder,
+                                                             Rotate(frame, glm::vec3(point, 1.0f)),
+                                                             Rotate(frame, Normal), glm::vec2(u, v),
+                                                             Rotate(frame, Tangent), Rotate(frame, BiTangent));
+                }
             }
-            if (Tangents) {
-                auto t = rotation * Impl::Tangent;
-                auto b = rotation * Impl::BiTangent;
-                vertices[k++] = t.x;
-                vertices[k++] = t.y;
-                vertices[k++] = t.z;
-                vertices[k++] = b.x;
-                vertices[k++] = b.y;
-                vertices[k++] = b.z;
+            for (GLuint row = 0; row < segments; ++row) {
+                for (GLuint column = 0; column < segments; ++column) {
+                    GLuint upperLeft = first + row * side + column;
+                    // Corners in the order of QuadCorners: upper right, upper left, lower right, lower left.
+                    std::array<GLuint, 4> corners{upperLeft + 1, upperLeft, upperLeft + side + 1, upperLeft + side};
+                    for (auto index : indices) {
+                        result.Indices.push_back(corners[index]);
+                    }
+                }
             }
         }
+        return result;
     }
-    return vertices;
+
+    template<size_t VertexSize, size_t IndexCount, unsigned Stride>
+    constexpr auto ToArrays(const TGeometry &geometry) {
+        using TIndex = std::conditional_t<(VertexSize / Stride <= 0x10000), GLushort, GLuint>;
+        TFixedGeometry<std::array<GLfloat, VertexSize>, std::array<TIndex, IndexCount>> result{};
+        for (size_t i = 0; i < VertexSize; ++i) {
+            result.Vertices[i] = geometry.Vertices[i];
+        }
+        for (size_t i = 0; i < IndexCount; ++i) {
+            result.Indices[i] = static_cast<TIndex>(geometry.Indices[i]);
+        }
+        return result;
+    }
+}
+
+template<bool Normals = true, bool Texture = true, bool Tangents = false>
+TGeometry IndexedSphereGeometry(unsigned level, TGeomBuilder builder = {}) {
+    return Impl::SphereGeometry<Impl::TRuntimeMath, Normals, Texture, Tangents>(level, builder);
+}
+
+template<bool Normals = true, bool Texture = true, bool Tangents = false>
+TGeometry IndexedQuadGeometry(TGeomBuilder builder = {}) {
+    return Impl::QuadGeometry<Normals, Texture, Tangents>(builder);
+}
+
+// Two sided quad, the back face has its own vertices facing -Z.
+template<bool Normals = true, bool Texture = true, bool Tangents = false>
+TGeometry IndexedDoubleQuadGeometry(TGeomBuilder builder = {}) {
+    return Impl::DoubleQuadGeometry<Normals, Texture, Tangents>(builder);
+}
+
+template<bool Normals = true, bool Texture = true, bool Tangents = false>
+TGeometry IndexedCubeGeometry(TGeomBuilder builder = {}) {
+    return Impl::CubeGeometry<Normals, Texture, Tangents>(builder);
+}
+
+template<bool Normals = true, bool Texture = true, bool Tangents = false, unsigned Level = 1>
+constexpr auto IndexedSphere(TGeomBuilder builder = {}) {
+    constexpr auto sizes = [] {
+        auto geometry = Impl::SphereGeometry<Impl::TConstMath, Normals, Texture, Tangents>(Level, {});
+        return std::pair(geometry.Vertices.size(), geometry.Indices.size());
+    }();
+    return Impl::ToArrays<sizes.first, sizes.second, Impl::GeomStride<Normals, Texture, Tangents>>(
+        Impl::SphereGeometry<Impl::TConstMath, Normals, Texture, Tangents>(Level, builder));
+}
+
+template<bool Normals = true, bool Texture = true, bool Tangents = false>
+constexpr auto IndexedQuad(TGeomBuilder builder = {}) {
+    constexpr unsigned stride = Impl::GeomStride<Normals, Texture, Tangents>;
+    return Impl::ToArrays<4 * stride, 6, stride>(Impl::QuadGeometry<Normals, Texture, Tangents>(builder));
+}
+
+template<bool Normals = true, bool Texture = true, bool Tangents = false>
+constexpr auto IndexedDoubleQuad(TGeomBuilder builder = {}) {
+    constexpr unsigned stride = Impl::GeomStride<Normals, Texture, Tangents>;
+    return Impl::ToArrays<8 * stride, 12, stride>(Impl::DoubleQuadGeometry<Normals, Texture, Tangents>(builder));
+}
+
+// The array sizes follow from Segments, which replaces the one of the builder.
+template<bool Normals = true, bool Texture = true, bool Tangents = false, unsigned Segments = 1>
+constexpr auto IndexedCube(TGeomBuilder builder = {}) {
+    constexpr unsigned stride = Impl::GeomStride<Normals, Texture, Tangents>;
+    constexpr size_t side = Segments + 1;
+    builder.Segments_ = Segments;
+    return Impl::ToArrays<6 * side * side * stride, 36 * Segments * Segments, stride>(
+        Impl::CubeGeometry<Normals, Texture, Tangents>(builder));
 }
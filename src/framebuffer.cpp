@@ -1,5 +1,6 @@
 #include "framebuffer.h"
 #include "cube.h"
+#include "gl_state.h"
 
 void FreeRenderBuffer(GLuint *buffer) {
     glDeleteRenderbuffers(1, buffer);
@@ -32,6 +33,7 @@ TRenderBuffer::TRenderBuffer(ETextureUsage usage, unsigned width, unsigned heigh
 }
 
 void FreeFrameBuffer(GLuint *framebuffer) {
+    TGlState::Get().ForgetFrameBuffer(*framebuffer);
     glDeleteFramebuffers(1, framebuffer);
 }
 
@@ -67,9 +69,12 @@ struct TTargetVisitor<const TTexture<Type> &> {
 
 std::shared_ptr<GLuint> CreateFrameBuffer(TFrameBufferTarget &screen, TFrameBufferTarget &depth) {
     GLuint framebuffer;
+    auto &state = TGlState::Get();
+    // Draws keep going to the framebuffer bound before.
+    GLuint previous = state.GetFrameBuffer();
     try {
         GL_ASSERT(glGenFramebuffers(1, &framebuffer));
-        GL_ASSERT(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer));
+        state.BindFrameBuffer(GL_FRAMEBUFFER, framebuffer);
         std::visit([](const auto &arg) {
             TTargetVisitor<decltype(arg)>::Bind(arg, GL_COLOR_ATTACHMENT0);
         }, screen);
@@ -79,10 +84,10 @@ std::shared_ptr<GLuint> CreateFrameBuffer(TFrameBufferTarget &screen, TFrameBuff
         if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
             throw TGlBaseError("Framebuffer Incomplete");
         }
-        GL_ASSERT(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+        state.BindFrameBuffer(GL_FRAMEBUFFER, previous);
         return std::shared_ptr<GLuint>(new GLuint(framebuffer), FreeFrameBuffer);
     } catch (...) {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        state.ForgetFrameBuffer(framebuffer);
         glDeleteFramebuffers(1, &framebuffer);
         throw;
     }
@@ -108,37 +113,62 @@ void TFrameBuffer::CopyTo(TFrameBuffer &target) {
         src = std::visit([](const auto &arg) { return TTargetVisitor<decltype(arg)>::Size(arg); }, Depth);
         dst = std::visit([](const auto &arg) { return TTargetVisitor<decltype(arg)>::Size(arg); }, target.Depth);
     }
-    GL_ASSERT(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, *target.FrameBuffer));
-    GL_ASSERT(glBindFramebuffer(GL_READ_FRAMEBUFFER, *FrameBuffer));
+    auto &state = TGlState::Get();
+    GLuint previous = state.GetFrameBuffer();
+    state.BindFrameBuffer(GL_DRAW_FRAMEBUFFER, *target.FrameBuffer);
+    state.BindFrameBuffer(GL_READ_FRAMEBUFFER, *FrameBuffer);
     GL_ASSERT(glBlitFramebuffer(0, 0, dst.x, dst.y, 0, 0, src.x, src.y, copy, GL_NEAREST));
-    GL_ASSERT(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0));
-    GL_ASSERT(glBindFramebuffer(GL_READ_FRAMEBUFFER, 0));
-    GL_ASSERT(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    state.BindFrameBuffer(GL_FRAMEBUFFER, previous);
 }
 
-TFrameBufferBinder::TFrameBufferBinder(const TFrameBuffer &framebuffer)
+TFrameBufferBinder::TFrameBufferBinder(const TFrameBuffer &framebuffer, bool clear)
     : Bound(true) {
-    GLint current;
-    GL_ASSERT(glGetIntegerv(GL_FRAMEBUFFER_BINDING, &current));
-    GLint viewport[4];
-    GL_ASSERT(glGetIntegerv(GL_VIEWPORT, viewport));
-    OldBuffer = current;
-    OldViewport = glm::ivec4(viewport[0], viewport[1], viewport[2], viewport[3]);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, *framebuffer.FrameBuffer);
-    GLenum what = 0;
+    // The cache knows the previous binding, so no state is read back from GL.
+    auto &state = TGlState::Get();
+    OldBuffer = state.GetFrameBuffer();
+    OldViewport = state.GetViewport();
+
+    state.BindFrameBuffer(GL_FRAMEBUFFER, *framebuffer.FrameBuffer);
     glm::ivec2 size;
     if (framebuffer.Depth.index() != 0) {
-        what |= GL_DEPTH_BUFFER_BIT;
+        Targets |= GL_DEPTH_BUFFER_BIT;
         size = std::visit([](const auto &arg) { return TTargetVisitor<decltype(arg)>::Size(arg); }, framebuffer.Depth);
     }
     if (framebuffer.Screen.index() != 0) {
-        what |= GL_COLOR_BUFFER_BIT;
+        Targets |= GL_COLOR_BUFFER_BIT;
         size = std::visit([](const auto &arg) { return TTargetVisitor<decltype(arg)>::Size(arg); }, framebuffer.Screen);
     }
-    GL_ASSERT(glViewport(0, 0, size.x, size.y));
-    GL_ASSERT(glClearColor(0, 0, 0, 0));
-    GL_ASSERT(glClear(what));
+    state.SetViewport(glm::ivec4(0, 0, size.x, size.y));
+    if (clear) {
+        Clear();
+    }
+}
+
+TFrameBufferBinder::TFrameBufferBinder(const TFrameBuffer &framebuffer, glm::ivec4 viewport, bool clear)
+    : TFrameBufferBinder(framebuffer, false) {
+    Region = viewport;
+    TGlState::Get().SetViewport(viewport);
+    if (clear) {
+        Clear();
+    }
+}
+
+void TFrameBufferBinder::Clear(glm::vec4 color) {
+    if (Region) {
+        ClearRegion(*Region, color);
+        return;
+    }
+    GL_ASSERT(glClearColor(color.x, color.y, color.z, color.w));
+    GL_ASSERT(glClear(Targets));
+}
+
+void TFrameBufferBinder::ClearRegion(glm::ivec4 region, glm::vec4 color) {
+    auto &state = TGlState::Get();
+    state.SetEnabled(GL_SCISSOR_TEST, true);
+    GL_ASSERT(glScissor(region.x, region.y, region.z, region.w));
+    GL_ASSERT(glClearColor(color.x, color.y, color.z, color.w));
+    GL_ASSERT(glClear(Targets));
+    state.SetEnabled(GL_SCISSOR_TEST, false);
 }
 
 TFrameBufferBinder::~TFrameBufferBinder() {
@@ -148,7 +178,11 @@ TFrameBufferBinder::~TFrameBufferBinder() {
 void TFrameBufferBinder::Unbind() {
     if (Bound) {
         Bound = false;
-        glBindFramebuffer(GL_FRAMEBUFFER, OldBuffer);
-        glViewport(OldViewport[0], OldViewport[1], OldViewport[2], OldViewport[3]);
+        try {
+            auto &state = TGlState::Get();
+            state.BindFrameBuffer(GL_FRAMEBUFFER, OldBuffer);
+            state.SetViewport(OldViewport);
+        } catch (...) {
+        }
     }
 }
@@ -4,6 +4,7 @@
 #include "mesh.h"
 #include "texture.h"
 #include <GL/glew.h>
+#include <optional>
 
 class TRenderBuffer {
 private:
@@ -44,8 +45,19 @@ class TFrameBufferBinder {
     bool Bound;
     GLuint OldBuffer{};
     glm::ivec4 OldViewport{};
+    GLenum Targets{};
+    std::optional<glm::ivec4> Region;
 public:
-    explicit TFrameBufferBinder(const TFrameBuffer &framebuffer);
+    // Keeping the contents lets a pass draw on top of a copied cache.
+    explicit TFrameBufferBinder(const TFrameBuffer &framebuffer, bool clear = true);
+    // Draws into a region of the framebuffer given as x, y, width and height, e.g. a tile of an
+    // atlas. Only that region is cleared.
+    TFrameBufferBinder(const TFrameBuffer &framebuffer, glm::ivec4 viewport, bool clear = true);
+    // Clears the bound region, color targets to the given value and depth to the far plane.
+    void Clear(glm::vec4 color = glm::vec4(0));
+    // Clears a region given as x, y, width and height, e.g. one atlas tile, the rest keeps its
+    // contents.
+    void ClearRegion(glm::ivec4 region, glm::vec4 color = glm::vec4(0));
     ~TFrameBufferBinder();
 
     TFrameBufferBinder(const TFrameBufferBinder &) = delete;
@@ -0,0 +1,87 @@
+#include "geometry_pool.h"
+
+namespace {
+    // The fixed array generators run at compile time, these keep them that way.
+    constexpr bool OnSphere(const auto &vertices, unsigned stride, float radius) {
+        for (size_t i = 0; i < vertices.size(); i += stride) {
+            float length = vertices[i] * vertices[i] + vertices[i + 1] * vertices[i + 1] + vertices[i + 2] * vertices[i + 2];
+            if (length < radius * radius * 0.99f || length > radius * radius * 1.01f) return false;
+        }
+        return true;
+    }
+
+    constexpr auto Icosahedron = IndexedSphere<true, false, false, 0>();
+    static_assert(Icosahedron.Vertices.size() == 12 * 6 && Icosahedron.Indices.size() == 60);
+    static_assert(OnSphere(Icosahedron.Vertices, 6, 0.5f));
+
+    constexpr auto Sphere = IndexedSphere<true, true, false, 1>();
+    static_assert(Sphere.Indices.size() == 240);
+    static_assert(std::is_same_v<decltype(Sphere.Indices)::value_type, GLushort>);
+    static_assert(OnSphere(Sphere.Vertices, 8, 0.5f));
+
+    constexpr auto Quad = IndexedQuad<false, true>();
+    static_assert(Quad.Vertices[0] == 0.5f && Quad.Vertices[1] == 0.5f && Quad.Vertices[2] == 0.0f);
+    static_assert(Quad.Vertices[3] == 1.0f && Quad.Vertices[4] == 0.0f);
+
+    constexpr auto Cube = IndexedCube<true, false, false>();
+    static_assert(Cube.Vertices.size() == 24 * 6 && Cube.Indices.size() == 36);
+    static_assert(Cube.Vertices[0] == -0.5f && Cube.Vertices[1] == 0.5f && Cube.Vertices[2] == 0.5f);
+    static_assert(Cube.Vertices[3] == 0.0f && Cube.Vertices[4] == 0.0f && Cube.Vertices[5] == 1.0f);
+}
+
+TGeometryPool::TGeometryPool(size_t vertexCapacity, size_t indexCapacity)
+    : Vertices(EBufferUsage::Static, nullptr, vertexCapacity)
+      , Indices(EBufferUsage::Static, nullptr, indexCapacity * sizeof(GLuint))
+      , VertexCapacity(vertexCapacity)
+      , IndexCapacity(indexCapacity) {
+}
+
+const TMesh &TGeometryPool::Layout(unsigned flags) {
+    auto found = Layouts.find(flags);
+    if (found == Layouts.end()) {
+        TMeshBuilder builder;
+        builder
+            .SetVertices(Vertices, 0)
+            .SetIndices(Indices, 0)
+            .SetIndexType(EDataType::UInt)
+            .AddLayout(EDataType::Float, 3);
+        if (flags & 1U) builder.AddLayout(EDataType::Float, 3);
+        if (flags & 2U) builder.AddLayout(EDataType::Float, 2);
+        if (flags & 4U) builder.AddLayout(EDataType::Float, 3).AddLayout(EDataType::Float, 3);
+        found = Layouts.emplace(flags, TMesh(builder)).first;
+    }
+    return found->second;
+}
+
+TMesh TGeometryPool::Get(EGeometry geometry, unsigned flags, unsigned level, const TGeomBuilder &builder,
+                         const std::function<TGeometry()> &generate) {
+    TKey key{geometry, flags, level, builder.Size_, builder.Backward_,
+             builder.Position_, builder.TextureMul_, builder.TextureOffset_, builder.Segments_};
+    auto found = Meshes.find(key);
+    if (found != Meshes.end()) {
+        return found->second;
+    }
+
+    auto data = generate();
+    size_t stride = sizeof(GLfloat) * (3 + (flags & 1U ? 3 : 0) + (flags & 2U ? 2 : 0) + (flags & 4U ? 6 : 0));
+    // Base vertices count in whole vertices of the layout, so each range starts at a multiple
+    // of its own stride.
+    size_t offset = (VertexBytes + stride - 1) / stride * stride;
+    size_t size = data.Vertices.size() * sizeof(GLfloat);
+    if (offset + size > VertexCapacity || IndexCount + data.Indices.size() > IndexCapacity) {
+        throw TGlBaseError("Geometry pool is full");
+    }
+    Vertices.Write(data.Vertices.data(), static_cast<int>(offset), static_cast<int>(size));
+    Indices.Write(data.Indices.data(), static_cast<int>(IndexCount * sizeof(GLuint)),
+                  static_cast<int>(data.Indices.size() * sizeof(GLuint)));
+
+    TMesh mesh(Layout(flags),
+               TMeshRangeBuilder()
+                   .SetIndices(static_cast<unsigned>(IndexCount), static_cast<unsigned>(data.Indices.size()))
+                   .SetVertices(static_cast<GLint>(offset / stride), static_cast<unsigned>(size / stride))
+                   .SetBounds(ComputeBounds(data.Vertices, static_cast<unsigned>(stride / sizeof(GLfloat)))));
+    VertexBytes = offset + size;
+    IndexCount += data.Indices.size();
+    Meshes.emplace(key, mesh);
+    return mesh;
+}
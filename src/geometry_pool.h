@@ -0,0 +1,73 @@
+#pragma once
+#include "mesh.h"
+#include "cube.h"
+#include <functional>
+#include <map>
+
+enum class EGeometry {
+    Quad,
+    DoubleQuad,
+    Cube,
+    Sphere,
+};
+
+// One vertex and one index buffer shared by small generated meshes. Every vertex layout gets
+// a VAO over the same buffers and meshes are base vertex ranges of it, so drawing them one
+// after another doesn't rebind. Geometry requested again with equal generator parameters is
+// returned from the pool instead of being uploaded twice.
+class TGeometryPool {
+private:
+    using TKey = std::tuple<EGeometry, unsigned, unsigned, float, bool,
+                            std::tuple<float, float, float>,
+                            std::tuple<float, float>,
+                            std::tuple<float, float>,
+                            unsigned>;
+
+    TArrayBuffer Vertices;
+    TIndexBuffer Indices;
+    size_t VertexCapacity;
+    size_t IndexCapacity;
+    size_t VertexBytes{};
+    size_t IndexCount{};
+    std::map<unsigned, TMesh> Layouts;
+    std::map<TKey, TMesh> Meshes;
+
+    template<bool Normals, bool Texture, bool Tangents>
+    static constexpr unsigned Flags = (Normals ? 1U : 0U) | (Texture ? 2U : 0U) | (Tangents ? 4U : 0U);
+
+    const TMesh &Layout(unsigned flags);
+    TMesh Get(EGeometry geometry, unsigned flags, unsigned level, const TGeomBuilder &builder,
+              const std::function<TGeometry()> &generate);
+
+public:
+    // Capacities are in bytes of vertex data and in 32 bit indices.
+    explicit TGeometryPool(size_t vertexCapacity = 4 << 20, size_t indexCapacity = 1 << 20);
+
+    template<bool Normals = true, bool Texture = true, bool Tangents = false>
+    TMesh Quad(TGeomBuilder builder = {}) {
+        return Get(EGeometry::Quad, Flags<Normals, Texture, Tangents>, 0, builder,
+                   [&] { return IndexedQuadGeometry<Normals, Texture, Tangents>(builder); });
+    }
+
+    template<bool Normals = true, bool Texture = true, bool Tangents = false>
+    TMesh DoubleQuad(TGeomBuilder builder = {}) {
+        return Get(EGeometry::DoubleQuad, Flags<Normals, Texture, Tangents>, 0, builder,
+                   [&] { return IndexedDoubleQuadGeometry<Normals, Texture, Tangents>(builder); });
+    }
+
+    template<bool Normals = true, bool Texture = true, bool Tangents = false>
+    TMesh Cube(TGeomBuilder builder = {}) {
+        return Get(EGeometry::Cube, Flags<Normals, Texture, Tangents>, 0, builder,
+                   [&] { return IndexedCubeGeometry<Normals, Texture, Tangents>(builder); });
+    }
+
+    template<bool Normals = true, bool Texture = true, bool Tangents = false>
+    TMesh Sphere(unsigned level = 3, TGeomBuilder builder = {}) {
+        return Get(EGeometry::Sphere, Flags<Normals, Texture, Tangents>, level, builder,
+                   [&] { return IndexedSphereGeometry<Normals, Texture, Tangents>(level, builder); });
+    }
+
+    [[nodiscard]] size_t GetVertexBytes() const { return VertexBytes; }
+    [[nodiscard]] size_t GetIndexCount() const { return IndexCount; }
+    [[nodiscard]] size_t GetMeshCount() const { return Meshes.size(); }
+};
@@ -0,0 +1,221 @@
+#include "gl_state.h"
+#include <algorithm>
+
+TGlState::TGlState() {
+    for (auto &unit : Textures) {
+        unit.fill(Unknown);
+    }
+}
+
+TGlState &TGlState::Get() {
+    static TGlState state;
+    return state;
+}
+
+GLuint *TGlState::Buffer(GLenum target) {
+    switch (target) {
+        case GL_ARRAY_BUFFER: return &ArrayBuffer;
+        case GL_ELEMENT_ARRAY_BUFFER: return &ElementBuffer;
+        case GL_UNIFORM_BUFFER: return &UniformBuffer;
+        default: return nullptr;
+    }
+}
+
+void TGlState::ActiveTexture(int unit) {
+    if (Change(ActiveUnit, static_cast<GLuint>(unit))) {
+        GL_ASSERT(glActiveTexture(GL_TEXTURE0 + unit));
+    }
+}
+
+void TGlState::UseProgram(GLuint program) {
+    if (Change(Program, program)) {
+        GL_ASSERT(glUseProgram(program));
+    }
+}
+
+void TGlState::BindVertexArray(GLuint vertexArray) {
+    if (Change(VertexArray, vertexArray)) {
+        ElementBuffer = Unknown;
+        GL_ASSERT(glBindVertexArray(vertexArray));
+    }
+}
+
+void TGlState::BindBuffer(GLenum target, GLuint buffer) {
+    auto cached = Buffer(target);
+    if (cached == nullptr) {
+        Stats.Calls++;
+        GL_ASSERT(glBindBuffer(target, buffer));
+    } else if (Change(*cached, buffer)) {
+        GL_ASSERT(glBindBuffer(target, buffer));
+    }
+}
+
+void TGlState::BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    if (target != GL_UNIFORM_BUFFER) {
+        Stats.Calls++;
+        GL_ASSERT(glBindBufferRange(target, index, buffer, offset, size));
+        return;
+    }
+    if (UniformRanges.size() <= index) {
+        UniformRanges.resize(index + 1);
+    }
+    auto &range = UniformRanges[index];
+    Stats.Calls++;
+    if (range.Buffer == buffer && range.Offset == offset && range.Size == size) {
+        Stats.Skipped++;
+        return;
+    }
+    // The indexed binding also replaces the generic one.
+    GL_ASSERT(glBindBufferRange(target, index, buffer, offset, size));
+    range = {buffer, offset, size};
+    UniformBuffer = buffer;
+}
+
+void TGlState::BindTexture(int unit, GLenum target, GLuint texture) {
+    auto slot = std::find(TextureTargets.begin(), TextureTargets.end(), target) - TextureTargets.begin();
+    if (slot == static_cast<ptrdiff_t>(TextureTargets.size())) {
+        ActiveTexture(unit);
+        Stats.Calls++;
+        GL_ASSERT(glBindTexture(target, texture));
+    } else if (Change(Textures.at(unit)[slot], texture)) {
+        ActiveTexture(unit);
+        GL_ASSERT(glBindTexture(target, texture));
+    }
+}
+
+void TGlState::BindTexture(GLenum target, GLuint texture) {
+    if (ActiveUnit == Unknown) {
+        ActiveTexture(0);
+    }
+    BindTexture(static_cast<int>(ActiveUnit), target, texture);
+}
+
+void TGlState::BindFrameBuffer(GLenum target, GLuint frameBuffer) {
+    if (target == GL_DRAW_FRAMEBUFFER) {
+        if (Change(DrawFrameBuffer, frameBuffer)) {
+            GL_ASSERT(glBindFramebuffer(target, frameBuffer));
+        }
+    } else if (target == GL_READ_FRAMEBUFFER) {
+        if (Change(ReadFrameBuffer, frameBuffer)) {
+            GL_ASSERT(glBindFramebuffer(target, frameBuffer));
+        }
+    } else {
+        bool same = DrawFrameBuffer == frameBuffer && ReadFrameBuffer == frameBuffer;
+        Stats.Calls++;
+        if (same) {
+            Stats.Skipped++;
+            return;
+        }
+        DrawFrameBuffer = frameBuffer;
+        ReadFrameBuffer = frameBuffer;
+        GL_ASSERT(glBindFramebuffer(target, frameBuffer));
+    }
+}
+
+void TGlState::SetViewport(glm::ivec4 viewport) {
+    if (Change(Viewport, viewport)) {
+        GL_ASSERT(glViewport(viewport.x, viewport.y, viewport.z, viewport.w));
+    }
+}
+
+void TGlState::SetEnabled(GLenum capability, bool enabled) {
+    auto found = Capabilities.find(capability);
+    Stats.Calls++;
+    if (found != Capabilities.end() && found->second == enabled) {
+        Stats.Skipped++;
+        return;
+    }
+    if (enabled) {
+        GL_ASSERT(glEnable(capability));
+    } else {
+        GL_ASSERT(glDisable(capability));
+    }
+    Capabilities[capability] = enabled;
+}
+
+void TGlState::SetCullFace(GLenum face) {
+    if (Change(CullFace, face)) {
+        GL_ASSERT(glCullFace(face));
+    }
+}
+
+void TGlState::SetDepthFunc(GLenum func) {
+    if (Change(DepthFunc, func)) {
+        GL_ASSERT(glDepthFunc(func));
+    }
+}
+
+void TGlState::SetDepthMask(bool mask) {
+    if (Change(DepthMask, mask)) {
+        GL_ASSERT(glDepthMask(mask ? GL_TRUE : GL_FALSE));
+    }
+}
+
+void TGlState::SetBlendFunc(GLenum source, GLenum destination) {
+    if (Change(BlendFunc, std::make_pair(source, destination))) {
+        GL_ASSERT(glBlendFunc(source, destination));
+    }
+}
+
+void TGlState::ForgetProgram(GLuint program) {
+    if (Program == program) {
+        Program = Unknown;
+    }
+}
+
+void TGlState::ForgetVertexArray(GLuint vertexArray) {
+    if (VertexArray == vertexArray) {
+        VertexArray = Unknown;
+        ElementBuffer = Unknown;
+    }
+}
+
+void TGlState::ForgetBuffer(GLuint buffer) {
+    for (auto cached : {&ArrayBuffer, &ElementBuffer, &UniformBuffer}) {
+        if (*cached == buffer) {
+            *cached = Unknown;
+        }
+    }
+    for (auto &range : UniformRanges) {
+        if (range.Buffer == buffer) {
+            range = {};
+        }
+    }
+}
+
+void TGlState::ForgetTexture(GLuint texture) {
+    for (auto &unit : Textures) {
+        for (auto &bound : unit) {
+            if (bound == texture) {
+                bound = Unknown;
+            }
+        }
+    }
+}
+
+void TGlState::ForgetFrameBuffer(GLuint frameBuffer) {
+    if (DrawFrameBuffer == frameBuffer) {
+        DrawFrameBuffer = Unknown;
+    }
+    if (ReadFrameBuffer == frameBuffer) {
+        ReadFrameBuffer = Unknown;
+    }
+}
+
+GLuint TGlState::GetFrameBuffer() {
+    if (DrawFrameBuffer == Unknown) {
+        GLint current{};
+        GL_ASSERT(glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &current));
+        DrawFrameBuffer = static_cast<GLuint>(current);
+    }
+    return DrawFrameBuffer;
+}
+
+glm::ivec4 TGlState::GetViewport() {
+    if (!Viewport) {
+        GLint viewport[4];
+        GL_ASSERT(glGetIntegerv(GL_VIEWPORT, viewport));
+        Viewport = glm::ivec4(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+    return *Viewport;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include "common.h"
+#include <optional>
+
+// Calls asked of the state cache and how many of them it dropped as redundant.
+struct TGlStateStats {
+    size_t Calls{};
+    size_t Skipped{};
+};
+
+// Shadow of the context's bindings and fixed function state. A call setting what is already
+// set never reaches GL, so binders leave their objects bound instead of restoring defaults.
+// Every change of the tracked state goes through here, and deleted objects are forgotten
+// since GL may hand out their names again. State nothing has set yet is unknown.
+class TGlState {
+public:
+    static constexpr int Units = 32;
+
+private:
+    static constexpr GLuint Unknown = ~GLuint{0};
+    static constexpr std::array<GLenum, 3> TextureTargets{GL_TEXTURE_2D, GL_TEXTURE_2D_MULTISAMPLE,
+                                                          GL_TEXTURE_CUBE_MAP};
+
+    struct TRange {
+        GLuint Buffer = Unknown;
+        GLintptr Offset{};
+        GLsizeiptr Size{};
+    };
+
+    GLuint Program = Unknown;
+    GLuint VertexArray = Unknown;
+    GLuint ArrayBuffer = Unknown;
+    // Part of the bound VAO, unknown again whenever that changes.
+    GLuint ElementBuffer = Unknown;
+    GLuint UniformBuffer = Unknown;
+    std::vector<TRange> UniformRanges;
+    GLuint ActiveUnit = Unknown;
+    std::array<std::array<GLuint, TextureTargets.size()>, Units> Textures;
+    GLuint DrawFrameBuffer = Unknown;
+    GLuint ReadFrameBuffer = Unknown;
+    std::optional<glm::ivec4> Viewport;
+    std::map<GLenum, bool> Capabilities;
+    GLenum CullFace = Unknown;
+    GLenum DepthFunc = Unknown;
+    std::optional<bool> DepthMask;
+    std::optional<std::pair<GLenum, GLenum>> BlendFunc;
+    TGlStateStats Stats;
+
+    TGlState();
+
+    // Counts the call and stores the value, false when it was set already.
+    template<typename T, typename TValue>
+    bool Change(T &cached, const TValue &value) {
+        Stats.Calls++;
+        if (cached == value) {
+            Stats.Skipped++;
+            return false;
+        }
+        cached = value;
+        return true;
+    }
+
+    GLuint *Buffer(GLenum target);
+    void ActiveTexture(int unit);
+
+public:
+    // The state of the one context the program renders with.
+    static TGlState &Get();
+
+    TGlState(const TGlState &) = delete;
+    TGlState &operator=(const TGlState &) = delete;
+
+    void UseProgram(GLuint program);
+    void BindVertexArray(GLuint vertexArray);
+    // Array, element array and uniform buffers are tracked, other targets are passed on.
+    void BindBuffer(GLenum target, GLuint buffer);
+    void BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    void BindTexture(int unit, GLenum target, GLuint texture);
+    // Binds to whichever unit is active, for creating and filling textures.
+    void BindTexture(GLenum target, GLuint texture);
+    // GL_FRAMEBUFFER binds for both drawing and reading.
+    void BindFrameBuffer(GLenum target, GLuint frameBuffer);
+    void SetViewport(glm::ivec4 viewport);
+    void SetEnabled(GLenum capability, bool enabled);
+    void SetCullFace(GLenum face);
+    void SetDepthFunc(GLenum func);
+    void SetDepthMask(bool mask);
+    void SetBlendFunc(GLenum source, GLenum destination);
+
+    // Objects about to be deleted.
+    void ForgetProgram(GLuint program);
+    void ForgetVertexArray(GLuint vertexArray);
+    void ForgetBuffer(GLuint buffer);
+    void ForgetTexture(GLuint texture);
+    void ForgetFrameBuffer(GLuint frameBuffer);
+
+    // Framebuffer bound for drawing and the viewport, read back from GL while unknown.
+    [[nodiscard]] GLuint GetFrameBuffer();
+    [[nodiscard]] glm::ivec4 GetViewport();
+
+    [[nodiscard]] const TGlStateStats &GetStats() const { return Stats; }
+    void ResetStats() { Stats = {}; }
+};
@@ -0,0 +1,298 @@
+#include "gltf_loader.h"
+#include "mapped_file.h"
+#include "json.h"
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+    constexpr uint32_t GlbMagic = 0x46546C67;
+    constexpr uint32_t JsonChunk = 0x4E4F534A;
+    constexpr uint32_t BinChunk = 0x004E4942;
+    constexpr int TrianglesMode = 4;
+
+    // Shader locations of the attributes the scene shaders read.
+    const array<pair<const char *, unsigned>, 4> AttributeLocations{{
+        {"POSITION", 0}, {"NORMAL", 1}, {"TEXCOORD_0", 2}, {"TANGENT", 3}
+    }};
+
+    uint32_t ReadUInt(const char *p) {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    unsigned Components(const string &type) {
+        if (type == "SCALAR") return 1;
+        if (type == "VEC2") return 2;
+        if (type == "VEC3") return 3;
+        if (type == "VEC4") return 4;
+        throw TGlBaseError("unsupported accessor type " + type);
+    }
+
+    unsigned ComponentSize(int componentType) {
+        switch (componentType) {
+            case GL_BYTE:
+            case GL_UNSIGNED_BYTE: return 1;
+            case GL_SHORT:
+            case GL_UNSIGNED_SHORT: return 2;
+            case GL_UNSIGNED_INT:
+            case GL_FLOAT: return 4;
+        }
+        throw TGlBaseError("unsupported component type " + to_string(componentType));
+    }
+
+    mat4 NodeTransform(const TJson &node) {
+        if (node.Has("matrix")) {
+            mat4 matrix;
+            for (int i = 0; i < 16; ++i) {
+                matrix[i / 4][i % 4] = static_cast<float>(node["matrix"][i].Number());
+            }
+            return matrix;
+        }
+        auto &t = node["translation"];
+        auto &r = node["rotation"];
+        auto &s = node["scale"];
+        vec3 translation(t[0].Number(), t[1].Number(), t[2].Number());
+        quat rotation(static_cast<float>(r[3].Number(1)), r[0].Number(), r[1].Number(), r[2].Number());
+        vec3 scale(s[0].Number(1), s[1].Number(1), s[2].Number(1));
+        return glm::translate(mat4(1.0f), translation) * mat4_cast(rotation) * glm::scale(mat4(1.0f), scale);
+    }
+}
+
+struct TGltfScene {
+    TMappedFile File;
+    TJson Json;
+    const char *Bin{};
+    size_t BinSize{};
+    string Directory;
+    map<pair<int, ETextureUsage>, shared_ptr<const TTextureImage>> Images;
+
+    TGltfScene(const string &path, string directory)
+        : File(path)
+          , Directory(std::move(directory)) {
+    }
+
+    [[nodiscard]] pair<const char *, size_t> View(int index) const {
+        auto &view = Json["bufferViews"][index];
+        if (view["buffer"].Int() != 0 || Json["buffers"][0].Has("uri")) {
+            throw TGlBaseError("only the embedded glb buffer is supported");
+        }
+        auto offset = static_cast<size_t>(view["byteOffset"].Number());
+        auto length = static_cast<size_t>(view["byteLength"].Number());
+        if (offset + length > BinSize) {
+            throw TGlBaseError("buffer view out of range");
+        }
+        return {Bin + offset, length};
+    }
+
+    void DecodeImage(const TJson &textureInfo, ETextureUsage usage) {
+        if (!textureInfo.Has("index")) {
+            return;
+        }
+        int source = Json["textures"][textureInfo["index"].Int()]["source"].Int();
+        auto &image = Images[make_pair(source, usage)];
+        if (image) {
+            return;
+        }
+        auto &json = Json["images"][source];
+        if (json.Has("bufferView")) {
+            auto [data, size] = View(json["bufferView"].Int());
+            image = DecodeTextureImage(data, size, usage);
+        } else if (json["uri"].String().rfind("data:", 0) == 0) {
+            throw TGlBaseError("data uri images are not supported");
+        } else {
+            image = DecodeTextureImage(Directory + "/" + json["uri"].String(), usage);
+        }
+    }
+
+    [[nodiscard]] TTextureBuilder Texture(const TJson &textureInfo, ETextureUsage usage) const {
+        int source = Json["textures"][textureInfo["index"].Int()]["source"].Int();
+        return TTextureBuilder().SetUsage(usage).SetImage(Images.at(make_pair(source, usage)));
+    }
+};
+
+shared_ptr<const TGltfScene> ImportGlb(const string &path, const string &directory) {
+    auto scene = make_shared<TGltfScene>(path, directory);
+    const char *p = scene->File.Begin();
+    const char *end = scene->File.End();
+    if (end - p < 20 || ReadUInt(p) != GlbMagic || ReadUInt(p + 4) != 2) {
+        throw TGlBaseError("not a glTF 2.0 binary file");
+    }
+    for (p += 12; end - p >= 8;) {
+        uint32_t length = ReadUInt(p);
+        uint32_t type = ReadUInt(p + 4);
+        p += 8;
+        if (static_cast<size_t>(end - p) < length) {
+            throw TGlBaseError("truncated glb chunk");
+        }
+        if (type == JsonChunk) {
+            scene->Json = ParseJson(string_view(p, length));
+        } else if (type == BinChunk && scene->Bin == nullptr) {
+            scene->Bin = p;
+            scene->BinSize = length;
+        }
+        p += length;
+    }
+    auto &materials = scene->Json["materials"];
+    for (size_t i = 0; i < materials.Size(); ++i) {
+        scene->DecodeImage(materials[i]["pbrMetallicRoughness"]["baseColorTexture"], ETextureUsage::SRgba);
+        scene->DecodeImage(materials[i]["normalTexture"], ETextureUsage::Rgb);
+    }
+    return scene;
+}
+
+void BuildGltfModel(const TGltfScene &scene, TModel &model) {
+    auto &json = scene.Json;
+    auto &accessors = json["accessors"];
+
+    // Metallic-roughness is mapped onto the Blinn-Phong inputs the scene shader has.
+    auto &materials = json["materials"];
+    for (size_t i = 0; i < materials.Size(); ++i) {
+        auto &material = materials[i];
+        auto &pbr = material["pbrMetallicRoughness"];
+        TMaterialBuilder builder;
+        if (pbr["baseColorTexture"].Has("index")) {
+            builder.SetTexture(EMaterialProp::Diffuse, TFlatTexture(scene.Texture(pbr["baseColorTexture"], ETextureUsage::SRgba)));
+        } else {
+            auto &factor = pbr["baseColorFactor"];
+            builder.SetColor(EMaterialProp::Diffuse, vec4(factor[0].Number(1), factor[1].Number(1),
+                                                          factor[2].Number(1), factor[3].Number(1)));
+        }
+        if (material["normalTexture"].Has("index")) {
+            builder.SetTexture(EMaterialProp::Normal, TFlatTexture(scene.Texture(material["normalTexture"], ETextureUsage::Rgb)));
+        }
+        auto metallic = static_cast<float>(pbr["metallicFactor"].Number(1));
+        auto roughness = std::max(static_cast<float>(pbr["roughnessFactor"].Number(1)), 0.05f);
+        builder.SetColor(EMaterialProp::Specular, vec4(vec3(mix(0.04f, 1.0f, metallic)), 1.0f));
+        builder.SetConstant(EMaterialProp::Shininess, std::clamp(2.0f / pow(roughness, 4.0f) - 2.0f, 1.0f, 256.0f));
+        model.Material(builder);
+    }
+    int defaultMaterial = -1;
+
+    set<int> indexViews;
+    auto &meshes = json["meshes"];
+    for (size_t i = 0; i < meshes.Size(); ++i) {
+        auto &primitives = meshes[i]["primitives"];
+        for (size_t k = 0; k < primitives.Size(); ++k) {
+            if (primitives[k].Has("indices")) {
+                indexViews.insert(accessors[primitives[k]["indices"].Int()]["bufferView"].Int());
+            }
+        }
+    }
+    map<int, TArrayBuffer> arrayBuffers;
+    map<int, TIndexBuffer> indexBuffers;
+    auto arrayBuffer = [&](int view) -> const TArrayBuffer & {
+        auto found = arrayBuffers.find(view);
+        if (found == arrayBuffers.end()) {
+            auto [data, size] = scene.View(view);
+            found = arrayBuffers.emplace(view, TArrayBuffer(EBufferUsage::Static, data, size)).first;
+        }
+        return found->second;
+    };
+    auto indexBuffer = [&](int view) -> const TIndexBuffer & {
+        auto found = indexBuffers.find(view);
+        if (found == indexBuffers.end()) {
+            auto [data, size] = scene.View(view);
+            found = indexBuffers.emplace(view, TIndexBuffer(EBufferUsage::Static, data, size)).first;
+        }
+        return found->second;
+    };
+
+    vec3 low(numeric_limits<float>::max());
+    vec3 high(-numeric_limits<float>::max());
+    vector<pair<int, mat4>> nodes;
+    auto &roots = json["scenes"][json["scene"].Int(0)]["nodes"];
+    for (size_t i = 0; i < roots.Size(); ++i) {
+        nodes.emplace_back(roots[i].Int(), mat4(1.0f));
+    }
+    while (!nodes.empty()) {
+        auto [index, parent] = nodes.back();
+        nodes.pop_back();
+        auto &node = json["nodes"][index];
+        mat4 transform = parent * NodeTransform(node);
+        for (size_t i = 0; i < node["children"].Size(); ++i) {
+            nodes.emplace_back(node["children"][i].Int(), transform);
+        }
+        if (!node.Has("mesh")) {
+            continue;
+        }
+        auto &mesh = meshes[node["mesh"].Int()];
+        auto &primitives = mesh["primitives"];
+        for (size_t k = 0; k < primitives.Size(); ++k) {
+            auto &primitive = primitives[k];
+            auto &attributes = primitive["attributes"];
+            if (primitive["mode"].Int(TrianglesMode) != TrianglesMode || !attributes.Has("POSITION")) {
+                cerr << "skipping primitive of " << mesh["name"].String() << ": not triangles\n";
+                continue;
+            }
+            auto &position = accessors[attributes["POSITION"].Int()];
+            auto vertexCount = static_cast<unsigned>(position["count"].Number());
+            TMeshBuilder builder;
+            builder.SetVertices(TArrayBuffer(), vertexCount);
+            for (auto &[name, location] : AttributeLocations) {
+                if (!attributes.Has(name)) continue;
+                auto &accessor = accessors[attributes[name].Int()];
+                if (accessor.Has("sparse") || !accessor.Has("bufferView")) {
+                    throw TGlBaseError("sparse accessors are not supported");
+                }
+                int view = accessor["bufferView"].Int();
+                builder.AddLayout(location, arrayBuffer(view),
+                                  static_cast<EDataType>(accessor["componentType"].Int()),
+                                  Components(accessor["type"].String()),
+                                  accessor["normalized"].Bool(),
+                                  static_cast<size_t>(accessor["byteOffset"].Number()),
+                                  static_cast<unsigned>(json["bufferViews"][view]["byteStride"].Number()));
+            }
+            unsigned firstIndex = 0;
+            unsigned indexCount = 0;
+            if (primitive.Has("indices")) {
+                auto &accessor = accessors[primitive["indices"].Int()];
+                int componentType = accessor["componentType"].Int();
+                indexCount = static_cast<unsigned>(accessor["count"].Number());
+                firstIndex = static_cast<unsigned>(accessor["byteOffset"].Number()) / ComponentSize(componentType);
+                builder.SetIndices(indexBuffer(accessor["bufferView"].Int()), indexCount);
+                builder.SetIndexType(static_cast<EDataType>(componentType));
+            }
+            int material = primitive["material"].Int(-1);
+            if (material < 0) {
+                if (defaultMaterial < 0) {
+                    defaultMaterial = static_cast<int>(model.MaterialsCount());
+                    model.Material(TMaterialBuilder());
+                }
+                material = defaultMaterial;
+            }
+            // Position accessors are required to carry their bounds.
+            auto &min = position["min"];
+            auto &max = position["max"];
+            vec3 localLow(min[0].Number(), min[1].Number(), min[2].Number());
+            vec3 localHigh(max[0].Number(), max[1].Number(), max[2].Number());
+            TMesh whole(builder);
+            vector<TMesh> lods;
+            lods.emplace_back(whole, TMeshRangeBuilder()
+                .SetIndices(firstIndex, indexCount)
+                .SetVertices(0, vertexCount)
+                .SetBounds(TBounds{(localLow + localHigh) * 0.5f, (localHigh - localLow) * 0.5f,
+                                   glm::length(localHigh - localLow) * 0.5f}));
+            model.Mesh(mesh["name"].String(), std::move(lods), material, transform);
+
+            for (int corner = 0; corner < 8; ++corner) {
+                vec4 point((corner & 1) ? localHigh.x : localLow.x,
+                           (corner & 2) ? localHigh.y : localLow.y,
+                           (corner & 4) ? localHigh.z : localLow.z, 1.0f);
+                vec3 world(transform * point);
+                low = glm::min(low, world);
+                high = glm::max(high, world);
+            }
+        }
+    }
+    if (low.x <= high.x) {
+        model.Bounds((low + high) * 0.5f, glm::length(high - low) * 0.5f);
+    }
+}
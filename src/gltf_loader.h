@@ -0,0 +1,13 @@
+#pragma once
+#include "model.h"
+#include <memory>
+
+struct TGltfScene;
+
+// Reads a binary glTF file: maps it, parses the JSON chunk and decodes images. Touches no GL
+// state, so it can run on a worker thread.
+std::shared_ptr<const TGltfScene> ImportGlb(const std::string &path, const std::string &directory);
+
+// Uploads buffer views straight from the mapped file and adds a mesh per triangle primitive
+// with its node transform. Vertex data is never read on the CPU.
+void BuildGltfModel(const TGltfScene &scene, TModel &model);
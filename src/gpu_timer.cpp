@@ -0,0 +1,47 @@
+#include "gpu_timer.h"
+
+namespace {
+    void FreeQueries(std::array<GLuint, TGpuTimer::Depth> *queries) {
+        glDeleteQueries(static_cast<GLsizei>(queries->size()), queries->data());
+        delete queries;
+    }
+}
+
+TGpuTimer::TGpuTimer()
+    : Queries(new std::array<GLuint, Depth>{}, FreeQueries) {
+    GL_ASSERT(glGenQueries(static_cast<GLsizei>(Depth), Queries->data()));
+}
+
+bool TGpuTimer::Begin() {
+    if (Running || Pending == Depth) {
+        return false;
+    }
+    GL_ASSERT(glBeginQuery(GL_TIME_ELAPSED, (*Queries)[(First + Pending) % Depth]));
+    Running = true;
+    return true;
+}
+
+void TGpuTimer::End() {
+    if (Running) {
+        GL_ASSERT(glEndQuery(GL_TIME_ELAPSED));
+        Running = false;
+        Pending++;
+    }
+}
+
+std::optional<float> TGpuTimer::Poll() {
+    if (Pending == 0) {
+        return {};
+    }
+    GLuint query = (*Queries)[First];
+    GLint available = 0;
+    GL_ASSERT(glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available));
+    if (!available) {
+        return {};
+    }
+    GLuint64 nanoseconds = 0;
+    GL_ASSERT(glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds));
+    First = (First + 1) % Depth;
+    Pending--;
+    return static_cast<float>(nanoseconds) / 1e6f;
+}
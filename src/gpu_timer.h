@@ -0,0 +1,28 @@
+#pragma once
+#include "common.h"
+#include <array>
+#include <memory>
+#include <optional>
+
+// Measures the GPU time of command ranges with timer queries. Results are collected frames
+// later, so reading them never stalls the pipeline.
+class TGpuTimer {
+public:
+    static constexpr size_t Depth = 4;
+
+private:
+    std::shared_ptr<std::array<GLuint, Depth>> Queries;
+    // Oldest query still waiting for its result and the count of those.
+    size_t First = 0;
+    size_t Pending = 0;
+    bool Running = false;
+
+public:
+    TGpuTimer();
+
+    // Starts a measurement, false while every query still waits for its result.
+    bool Begin();
+    void End();
+    // Milliseconds of the oldest finished measurement.
+    std::optional<float> Poll();
+};
@@ -0,0 +1,209 @@
+#include "json.h"
+#include <cstdlib>
+
+using namespace std;
+
+namespace {
+    const TJson Null;
+    const string Empty;
+
+    class TJsonParser {
+    private:
+        string_view Text;
+        size_t Pos = 0;
+
+    public:
+        explicit TJsonParser(string_view text) : Text(text) {
+        }
+
+        TJson Parse() {
+            auto value = Value();
+            SkipSpaces();
+            if (Pos != Text.size()) {
+                Fail();
+            }
+            return value;
+        }
+
+    private:
+        [[noreturn]] void Fail() const {
+            throw TGlBaseError("invalid json at " + to_string(Pos));
+        }
+
+        void SkipSpaces() {
+            while (Pos < Text.size() && (Text[Pos] == ' ' || Text[Pos] == '\t' || Text[Pos] == '\n' || Text[Pos] == '\r')) {
+                Pos++;
+            }
+        }
+
+        char Peek() {
+            SkipSpaces();
+            if (Pos >= Text.size()) {
+                Fail();
+            }
+            return Text[Pos];
+        }
+
+        void Expect(char c) {
+            if (Peek() != c) {
+                Fail();
+            }
+            Pos++;
+        }
+
+        bool Literal(string_view literal) {
+            if (Text.substr(Pos, literal.size()) == literal) {
+                Pos += literal.size();
+                return true;
+            }
+            return false;
+        }
+
+        TJson Value() {
+            char c = Peek();
+            if (c == '{') {
+                map<string, TJson> object;
+                Pos++;
+                if (Peek() != '}') {
+                    do {
+                        auto key = String();
+                        Expect(':');
+                        object[std::move(key)] = Value();
+                    } while (Peek() == ',' && ++Pos);
+                }
+                Expect('}');
+                return TJson(std::move(object));
+            } else if (c == '[') {
+                vector<TJson> array;
+                Pos++;
+                if (Peek() != ']') {
+                    do {
+                        array.push_back(Value());
+                    } while (Peek() == ',' && ++Pos);
+                }
+                Expect(']');
+                return TJson(std::move(array));
+            } else if (c == '"') {
+                return TJson(String());
+            } else if (Literal("true")) {
+                return TJson(true);
+            } else if (Literal("false")) {
+                return TJson(false);
+            } else if (Literal("null")) {
+                return TJson();
+            }
+            return TJson(Number());
+        }
+
+        double Number() {
+            size_t start = Pos;
+            while (Pos < Text.size() && string_view("+-.eE0123456789").find(Text[Pos]) != string_view::npos) {
+                Pos++;
+            }
+            if (start == Pos) {
+                Fail();
+            }
+            string token(Text.substr(start, Pos - start));
+            return strtod(token.c_str(), nullptr);
+        }
+
+        void Utf8(string &out, unsigned code) {
+            if (code < 0x80) {
+                out += static_cast<char>(code);
+            } else if (code < 0x800) {
+                out += static_cast<char>(0xC0 | (code >> 6U));
+                out += static_cast<char>(0x80 | (code & 0x3FU));
+            } else {
+                out += static_cast<char>(0xE0 | (code >> 12U));
+                out += static_cast<char>(0x80 | ((code >> 6U) & 0x3FU));
+                out += static_cast<char>(0x80 | (code & 0x3FU));
+            }
+        }
+
+        string String() {
+            Expect('"');
+            string result;
+            while (Pos < Text.size() && Text[Pos] != '"') {
+                char c = Text[Pos++];
+                if (c != '\\') {
+                    result += c;
+                    continue;
+                }
+                if (Pos >= Text.size()) {
+                    Fail();
+                }
+                switch (char e = Text[Pos++]) {
+                    case 'n': result += '\n'; break;
+                    case 't': result += '\t'; break;
+                    case 'r': result += '\r'; break;
+                    case 'b': result += '\b'; break;
+                    case 'f': result += '\f'; break;
+                    case 'u': {
+                        if (Pos + 4 > Text.size()) {
+                            Fail();
+                        }
+                        Utf8(result, static_cast<unsigned>(stoul(string(Text.substr(Pos, 4)), nullptr, 16)));
+                        Pos += 4;
+                        break;
+                    }
+                    default: result += e;
+                }
+            }
+            Expect('"');
+            return result;
+        }
+    };
+}
+
+const TJson &TJson::operator[](const string &key) const {
+    if (auto object = get_if<map<string, TJson>>(&Value)) {
+        auto found = object->find(key);
+        if (found != object->end()) {
+            return found->second;
+        }
+    }
+    return Null;
+}
+
+const TJson &TJson::operator[](size_t index) const {
+    if (auto array = get_if<vector<TJson>>(&Value)) {
+        if (index < array->size()) {
+            return (*array)[index];
+        }
+    }
+    return Null;
+}
+
+bool TJson::Has(const string &key) const {
+    auto object = get_if<map<string, TJson>>(&Value);
+    return object != nullptr && object->count(key) > 0;
+}
+
+size_t TJson::Size() const {
+    if (auto array = get_if<vector<TJson>>(&Value)) {
+        return array->size();
+    }
+    if (auto object = get_if<map<string, TJson>>(&Value)) {
+        return object->size();
+    }
+    return 0;
+}
+
+double TJson::Number(double value) const {
+    auto number = get_if<double>(&Value);
+    return number != nullptr ? *number : value;
+}
+
+bool TJson::Bool(bool value) const {
+    auto flag = get_if<bool>(&Value);
+    return flag != nullptr ? *flag : value;
+}
+
+const string &TJson::String() const {
+    auto text = get_if<string>(&Value);
+    return text != nullptr ? *text : Empty;
+}
+
+TJson ParseJson(string_view text) {
+    return TJsonParser(text).Parse();
+}
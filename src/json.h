@@ -0,0 +1,28 @@
+#pragma once
+#include "common.h"
+#include <string_view>
+#include <variant>
+
+// Read-only JSON document, enough for glTF. Missing members and out of range elements read as null,
+// so optional properties can be queried with a default.
+class TJson {
+private:
+    std::variant<std::nullptr_t, bool, double, std::string, std::vector<TJson>, std::map<std::string, TJson>> Value;
+
+public:
+    TJson() = default;
+    template<typename T>
+    explicit TJson(T &&value) : Value(std::forward<T>(value)) {
+    }
+
+    [[nodiscard]] const TJson &operator[](const std::string &key) const;
+    [[nodiscard]] const TJson &operator[](size_t index) const;
+    [[nodiscard]] bool Has(const std::string &key) const;
+    [[nodiscard]] size_t Size() const;
+    [[nodiscard]] double Number(double value = 0) const;
+    [[nodiscard]] int Int(int value = 0) const { return static_cast<int>(Number(value)); }
+    [[nodiscard]] bool Bool(bool value = false) const;
+    [[nodiscard]] const std::string &String() const;
+};
+
+TJson ParseJson(std::string_view text);
@@ -1,5 +1,6 @@
 #include "errors.h"
 #include "scene.h"
+#include "gl_state.h"
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
@@ -78,12 +79,13 @@ void program() {
             throw TGlewError(initResult, "init");
         }
 
-        GL_ASSERT(glViewport(0, 0, width * 2, height * 2));
-        GL_ASSERT(glEnable(GL_DEPTH_TEST));
-        GL_ASSERT(glEnable(GL_CULL_FACE));
-        GL_ASSERT(glEnable(GL_BLEND));
-        GL_ASSERT(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
-        GL_ASSERT(glEnable(GL_MULTISAMPLE));
+        auto &state = TGlState::Get();
+        state.SetViewport(ivec4(0, 0, width * 2, height * 2));
+        state.SetEnabled(GL_DEPTH_TEST, true);
+        state.SetEnabled(GL_CULL_FACE, true);
+        state.SetEnabled(GL_BLEND, true);
+        state.SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        state.SetEnabled(GL_MULTISAMPLE, true);
 
         const float sensibility = .25f;
         const float speed = 10.0f;
@@ -101,6 +103,8 @@ void program() {
         TScene scene(width, height);
         bool useMap = false;
         bool spaceHit = false;
+        bool filterHit = false;
+        bool paraboloidHit = false;
         while (!glfwWindowShouldClose(window)) {
             if (!std::isnan(lastMouse.x) && !std::isnan(lastMouse.y)) {
                 auto rot = Mouse - lastMouse;
@@ -116,7 +120,22 @@ void program() {
             auto time = glfwGetTime();
             auto interval = static_cast<float>(time - lastTime);
             lastTime = time;
-            cout << static_cast<int>(1.0 / interval) << endl;
+            cout << static_cast<int>(1.0 / interval) << " culled";
+            for (size_t pass = 0; pass < static_cast<size_t>(EScenePass::Count); ++pass) {
+                auto &stats = scene.GetCullStats(static_cast<EScenePass>(pass));
+                cout << ' ' << stats.Culled << '/' << stats.Tested << '+' << stats.FacesCulled;
+            }
+            auto &scheduler = scene.GetShadowScheduler();
+            cout << " shadow faces " << scheduler.GetUpdatedFaces() << '/' << scheduler.GetPendingFaces();
+            auto models = scene.GetModelStats();
+            cout << " welded " << models.WeldedVertices << '/' << models.LoadedVertices;
+            // State calls and uniform uploads of the last frame the caches dropped.
+            cout << " state " << state.GetStats().Skipped << '/' << state.GetStats().Calls;
+            state.ResetStats();
+            auto &uniforms = TShaderProgram::GetUniformStats();
+            cout << " uniforms " << uniforms.Skipped << '/' << uniforms.Calls;
+            TShaderProgram::ResetUniformStats();
+            cout << endl;
 
             if (Keys[GLFW_KEY_ESCAPE]) {
                 glfwSetWindowShouldClose(window, GLFW_TRUE);
@@ -140,6 +159,17 @@ void program() {
                 useMap = !useMap;
             }
             spaceHit = Keys[GLFW_KEY_SPACE];
+            // Cycles PCF, variance and exponential variance shadows for comparison.
+            if (Keys[GLFW_KEY_F] && !filterHit) {
+                scene.SetShadowFilter(static_cast<EShadowFilter>((static_cast<int>(scene.GetShadowFilter()) + 1) % 3));
+            }
+            filterHit = Keys[GLFW_KEY_F];
+            // Switches spot shadows between cube faces and dual paraboloids.
+            if (Keys[GLFW_KEY_P] && !paraboloidHit) {
+                scene.SetOmniShadow(scene.GetOmniShadow() == EOmniShadow::Cube ? EOmniShadow::DualParaboloid
+                                                                               : EOmniShadow::Cube);
+            }
+            paraboloidHit = Keys[GLFW_KEY_P];
             if (movement != vec3(0, 0, 0)) {
                 position += normalize(movement) * interval * speed;
             }
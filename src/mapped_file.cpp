@@ -0,0 +1,53 @@
+#include "mapped_file.h"
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+TMappedFile::TMappedFile(const string &path) {
+#ifdef _WIN32
+    ifstream file(path, ios::binary);
+    if (!file) {
+        throw TGlBaseError("can't open file " + path);
+    }
+    Buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    Data = Buffer.data();
+    Size = Buffer.size();
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw TGlBaseError("can't open file " + path);
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw TGlBaseError("can't stat file " + path);
+    }
+    Size = static_cast<size_t>(info.st_size);
+    if (Size > 0) {
+        void *data = mmap(nullptr, Size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            throw TGlBaseError("can't map file " + path);
+        }
+        madvise(data, Size, MADV_SEQUENTIAL);
+        Data = static_cast<const char *>(data);
+    }
+    close(fd);
+#endif
+}
+
+TMappedFile::~TMappedFile() {
+#ifndef _WIN32
+    if (Data != nullptr) {
+        munmap(const_cast<char *>(Data), Size);
+    }
+#endif
+}
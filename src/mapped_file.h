@@ -0,0 +1,22 @@
+#pragma once
+#include "common.h"
+
+// File contents mapped read-only into memory.
+class TMappedFile {
+private:
+    const char *Data{};
+    size_t Size{};
+#ifdef _WIN32
+    std::vector<char> Buffer;
+#endif
+
+public:
+    explicit TMappedFile(const std::string &path);
+    ~TMappedFile();
+    TMappedFile(const TMappedFile &) = delete;
+    TMappedFile &operator=(const TMappedFile &) = delete;
+
+    [[nodiscard]] const char *Begin() const { return Data; }
+    [[nodiscard]] const char *End() const { return Data + Size; }
+    [[nodiscard]] size_t GetSize() const { return Size; }
+};
@@ -17,40 +17,14 @@ void TMaterial::DrawWith(IMaterialBound &bound, const TMesh &mesh) const {
     mesh.Draw();
 }
 
-TMaterialBinder::TMaterialBinder(const TMaterial &material, IMaterialBound &shader)
-    : Material(material)
-      , Shader(shader) {
+TMaterialBinder::TMaterialBinder(const TMaterial &material, IMaterialBound &shader) {
     for (int i = 0; i < material.Textures.size(); ++i) {
-        if (material.Textures[i].index() != 0) {
-            shader.SetTexture(static_cast<EMaterialProp>(i), material.Textures[i]);
-        }
+        shader.SetTexture(static_cast<EMaterialProp>(i), material.Textures[i]);
     }
     for (int i = 0; i < material.Colors.size(); ++i) {
-        if (material.Colors[i] != glm::vec4(0.0f)) {
-            shader.SetColor(static_cast<EMaterialProp>(i), material.Colors[i]);
-        }
+        shader.SetColor(static_cast<EMaterialProp>(i), material.Colors[i]);
     }
     for (int i = 0; i < material.Constants.size(); ++i) {
-        if (material.Constants[i] != 0.0f) {
-            shader.SetConstant(static_cast<EMaterialProp>(i), material.Constants[i]);
-        }
-    }
-}
-
-TMaterialBinder::~TMaterialBinder() {
-    for (int i = 0; i < Material.Textures.size(); ++i) {
-        if (Material.Textures[i].index() != 0) {
-            Shader.SetTexture(static_cast<EMaterialProp>(i), TMaterialTexture());
-        }
-    }
-    for (int i = 0; i < Material.Colors.size(); ++i) {
-        if (Material.Colors[i] != glm::vec4(0.0f)) {
-            Shader.SetColor(static_cast<EMaterialProp>(i), glm::vec4(0.0f));
-        }
-    }
-    for (int i = 0; i < Material.Constants.size(); ++i) {
-        if (Material.Constants[i] != 0.0f) {
-            Shader.SetConstant(static_cast<EMaterialProp>(i), 0.0f);
-        }
+        shader.SetConstant(static_cast<EMaterialProp>(i), material.Constants[i]);
     }
 }
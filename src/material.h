@@ -64,12 +64,9 @@ public:
     friend class TMaterialBinder;
 };
 
+// Sets every property of the shader, the ones the material lacks to their defaults, so
+// nothing is reset afterwards and values shared by consecutive materials stay uploaded.
 class TMaterialBinder {
-private:
-    const TMaterial &Material;
-    IMaterialBound &Shader;
-
 public:
     TMaterialBinder(const TMaterial &material, IMaterialBound &shader);
-    ~TMaterialBinder();
 };
\ No newline at end of file
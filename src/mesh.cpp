@@ -1,10 +1,14 @@
 #include "mesh.h"
 #include "errors.h"
+#include "gl_state.h"
+#include <limits>
+#include <algorithm>
 
 using namespace std;
 
 namespace {
     void FreeVertexArrayObject(GLuint *object) {
+        TGlState::Get().ForgetVertexArray(*object);
         glDeleteVertexArrays(1, object);
         TGlError::Skip();
     }
@@ -27,11 +31,12 @@ namespace {
         const TArrayBuffer &vertices,
         const TIndexBuffer &indices,
         const TArrayBuffer &instances,
-        const std::initializer_list<const std::vector<std::tuple<EDataType, unsigned, unsigned>> *> &layouts) {
+        const std::initializer_list<const std::vector<std::tuple<EDataType, unsigned, unsigned>> *> &layouts,
+        const std::vector<TVertexAttribute> &attributes) {
         GLuint vao;
         GL_ASSERT(glGenVertexArrays(1, &vao));
         try {
-            GL_ASSERT(glBindVertexArray(vao));
+            TGlState::Get().BindVertexArray(vao);
             GLubyte *vertexOffset = nullptr;
             GLubyte *instanceOffset = nullptr;
             size_t vertexStride = 0;
@@ -41,7 +46,17 @@ namespace {
                     (divisor > 0 ? instanceStride : vertexStride) += DataSize(dataType) * count;
                 }
             }
+            // Interleaved layouts continue after the locations taken by separate attributes.
             int location = 0;
+            for (auto &attribute : attributes) {
+                TArrayBinder arrayBinder(attribute.Buffer);
+                GL_ASSERT(glVertexAttribPointer(attribute.Location, attribute.Count,
+                                                static_cast<GLenum>(attribute.DataType),
+                                                attribute.Normalized ? GL_TRUE : GL_FALSE, attribute.Stride,
+                                                reinterpret_cast<const void *>(attribute.Offset)));
+                GL_ASSERT(glEnableVertexAttribArray(attribute.Location));
+                location = std::max(location, static_cast<int>(attribute.Location) + 1);
+            }
             for (auto &layout : layouts) {
                 for (auto[dataType, count, divisor] : *layout) {
                     if (divisor > 0) {
@@ -61,64 +76,141 @@ namespace {
                 }
             }
             TIndexBinder indexBinder(indices);
-            GL_ASSERT(glBindVertexArray(0));
         } catch (...) {
-            glBindVertexArray(0);
+            TGlState::Get().ForgetVertexArray(vao);
             glDeleteVertexArrays(1, &vao);
             throw;
         }
         return std::shared_ptr<GLuint>(new GLuint(vao), FreeVertexArrayObject);
     }
+
+    template<typename T>
+    std::vector<T> NarrowIndices(const std::vector<GLuint> &src) {
+        std::vector<T> result(src.size());
+        for (size_t i = 0; i < src.size(); ++i) {
+            result[i] = static_cast<T>(src[i]);
+        }
+        return result;
+    }
+}
+
+TMeshBuilder &TMeshBuilder::SetIndices(EBufferUsage usage, const std::vector<GLuint> &src, unsigned vertexCount) {
+    if (ByteIndices_ && vertexCount <= std::numeric_limits<GLubyte>::max() + 1) {
+        return SetIndices(usage, NarrowIndices<GLubyte>(src));
+    } else if (vertexCount <= std::numeric_limits<GLushort>::max() + 1) {
+        return SetIndices(usage, NarrowIndices<GLushort>(src));
+    }
+    return SetIndices(usage, src);
 }
 
 TMesh::TMesh(const TMeshBuilder &builder)
     : VertexArrayObject(CreateVertexArrayObject(std::get<0>(builder.Vertices_),
                                                 std::get<0>(builder.Indices_),
                                                 std::get<0>(builder.Instances_),
-                                                {&builder.Layouts_}))
+                                                {&builder.Layouts_},
+                                                builder.Attributes_))
       , Vertices(std::get<0>(builder.Vertices_))
       , Indices(std::get<0>(builder.Indices_))
       , Instances(std::get<0>(builder.Instances_))
       , VertexCount(std::get<1>(builder.Vertices_))
       , IndexCount(std::get<1>(builder.Indices_))
       , InstanceCount(std::get<1>(builder.Instances_))
-      , Layout(builder.Layouts_) {
+      , IndexType(builder.IndexType_)
+      , Meshlets(builder.Meshlets_)
+      , Bounds(builder.Bounds_)
+      , Layout(builder.Layouts_)
+      , Attributes(builder.Attributes_) {
 }
 
 TMesh::TMesh(const TMesh &mesh, const TInstanceMeshBuilder &builder)
     : VertexArrayObject(CreateVertexArrayObject(mesh.Vertices,
                                                 mesh.Indices,
                                                 std::get<0>(builder.Instances_),
-                                                {&mesh.Layout, &builder.Layouts_}))
+                                                {&mesh.Layout, &builder.Layouts_},
+                                                mesh.Attributes))
       , Vertices(mesh.Vertices)
       , Indices(mesh.Indices)
       , Instances(std::get<0>(builder.Instances_))
       , VertexCount(mesh.VertexCount)
       , IndexCount(mesh.IndexCount)
       , InstanceCount(std::get<1>(builder.Instances_))
-      , Layout(builder.Layouts_) {
+      , IndexType(mesh.IndexType)
+      , BaseVertex(mesh.BaseVertex)
+      , IndexOffset(mesh.IndexOffset)
+      , Layout(builder.Layouts_)
+      , Attributes(mesh.Attributes) {
+}
+
+TMesh::TMesh(const TMesh &mesh, const TMeshRangeBuilder &builder)
+    : VertexArrayObject(mesh.VertexArrayObject)
+      , Vertices(mesh.Vertices)
+      , Indices(mesh.Indices)
+      , Instances(mesh.Instances)
+      , VertexCount(std::get<1>(builder.Vertices_))
+      , IndexCount(std::get<1>(builder.Indices_))
+      , InstanceCount(mesh.InstanceCount)
+      , IndexType(mesh.IndexType)
+      , BaseVertex(mesh.BaseVertex + std::get<0>(builder.Vertices_))
+      , IndexOffset(mesh.IndexOffset + std::get<0>(builder.Indices_))
+      , Meshlets(builder.Meshlets_)
+      , Bounds(builder.Bounds_ ? builder.Bounds_ : mesh.Bounds)
+      , Layout(mesh.Layout)
+      , Attributes(mesh.Attributes) {
+}
+
+void TMeshBinder::Bind(const TMesh &mesh) {
+    TGlState::Get().BindVertexArray(*mesh.VertexArrayObject);
 }
 
 void TMesh::Draw(EDrawType type) const {
-    GL_ASSERT(glBindVertexArray(*VertexArrayObject));
+    TMeshBinder binder(*this);
+    Draw(binder, type);
+}
+
+void TMesh::Draw(const TMeshBinder &, EDrawType type) const {
     auto t = static_cast<GLenum>(type);
-    try {
-        if (IndexCount == 0) {
-            if (InstanceCount > 0) {
-                GL_ASSERT(glDrawArraysInstanced(t, 0, VertexCount, InstanceCount));
-            } else {
-                GL_ASSERT(glDrawArrays(t, 0, VertexCount));
-            }
+    auto indexType = static_cast<GLenum>(IndexType);
+    auto first = reinterpret_cast<const void *>(static_cast<uintptr_t>(IndexOffset) * DataSize(IndexType));
+    if (IndexCount == 0) {
+        if (InstanceCount > 0) {
+            GL_ASSERT(glDrawArraysInstanced(t, BaseVertex, VertexCount, InstanceCount));
         } else {
-            if (InstanceCount > 0) {
-                GL_ASSERT(glDrawElementsInstanced(t, IndexCount, GL_UNSIGNED_INT, nullptr, InstanceCount));
-            } else {
-                GL_ASSERT(glDrawElements(t, IndexCount, GL_UNSIGNED_INT, nullptr));
-            }
+            GL_ASSERT(glDrawArrays(t, BaseVertex, VertexCount));
+        }
+    } else {
+        if (InstanceCount > 0) {
+            GL_ASSERT(glDrawElementsInstancedBaseVertex(t, IndexCount, indexType, first, InstanceCount, BaseVertex));
+        } else {
+            GL_ASSERT(glDrawElementsBaseVertex(t, IndexCount, indexType, first, BaseVertex));
         }
-        GL_ASSERT(glBindVertexArray(0));
-    } catch (...) {
-        glBindVertexArray(0);
-        throw;
     }
 }
+
+void TMesh::Draw(TClusterCuller &culler, const glm::mat4 &model) const {
+    TMeshBinder binder(*this);
+    Draw(binder, culler, model);
+}
+
+void TMesh::Draw(const TMeshBinder &binder, TClusterCuller &culler, const glm::mat4 &model) const {
+    if (!Meshlets || IndexCount == 0 || InstanceCount > 0 || culler.Empty()) {
+        Draw(binder);
+        return;
+    }
+    thread_local std::vector<GLsizei> counts;
+    thread_local std::vector<GLuint> offsets;
+    thread_local std::vector<const void *> pointers;
+    thread_local std::vector<GLint> baseVertices;
+    culler.Cull(*Meshlets, model, counts, offsets);
+    if (counts.empty()) {
+        return;
+    }
+    auto indexSize = DataSize(IndexType);
+    pointers.resize(offsets.size());
+    for (size_t i = 0; i < offsets.size(); ++i) {
+        pointers[i] = reinterpret_cast<const void *>(static_cast<uintptr_t>(IndexOffset + offsets[i]) * indexSize);
+    }
+    baseVertices.assign(counts.size(), BaseVertex);
+    GL_ASSERT(glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), static_cast<GLenum>(IndexType),
+                                            pointers.data(), static_cast<GLsizei>(counts.size()),
+                                            baseVertices.data()));
+}
@@ -1,6 +1,9 @@
 #pragma once
 #include "common.h"
 #include "buffer.h"
+#include "meshlet.h"
+#include "bounds.h"
+#include <optional>
 
 enum struct EDataType {
     Byte = GL_BYTE,
@@ -18,12 +21,44 @@ enum struct EDrawType {
     Points = GL_POINTS,
 };
 
+template<typename T>
+constexpr EDataType IndexDataType() {
+    static_assert(std::is_unsigned_v<T>, "index type must be unsigned");
+    if constexpr (sizeof(T) == sizeof(GLubyte)) {
+        return EDataType::UByte;
+    } else if constexpr (sizeof(T) == sizeof(GLushort)) {
+        return EDataType::UShort;
+    } else {
+        static_assert(sizeof(T) == sizeof(GLuint), "index type must be 8, 16 or 32 bit");
+        return EDataType::UInt;
+    }
+}
+
+// Attribute read from its own buffer at an explicit offset and stride, the way glTF accessors
+// describe vertex data.
+struct TVertexAttribute {
+    unsigned Location;
+    TArrayBuffer Buffer;
+    EDataType DataType;
+    unsigned Count;
+    bool Normalized;
+    size_t Offset;
+    unsigned Stride;
+};
+
 class TMeshBuilder {
 public:
     BUILDER_PROPERTY2(TArrayBuffer, unsigned, Vertices);
     BUILDER_PROPERTY2(TIndexBuffer, unsigned, Indices);
+    BUILDER_PROPERTY(EDataType, IndexType){EDataType::UInt};
+    // Lets SetIndices with a vertex count pick 8 bit indices. Many drivers widen those on the
+    // CPU before drawing, so set it before SetIndices only where that is known not to happen.
+    BUILDER_PROPERTY(bool, ByteIndices){false};
+    BUILDER_PROPERTY(std::shared_ptr<const TMeshlets>, Meshlets){};
+    BUILDER_PROPERTY(std::optional<TBounds>, Bounds){};
     BUILDER_PROPERTY2(TArrayBuffer, unsigned, Instances);
     BUILDER_LIST3(EDataType, unsigned, unsigned, Layout);
+    BUILDER_LIST(TVertexAttribute, Attribute);
 
     template<typename T>
     TMeshBuilder &SetVertices(EBufferUsage usage, T &&src) {
@@ -34,9 +69,14 @@ public:
     template<typename T>
     TMeshBuilder &SetIndices(EBufferUsage usage, T &&src) {
         SetIndices({usage, std::forward<T>(src)}, src.size());
+        SetIndexType(IndexDataType<typename std::remove_reference<T>::type::value_type>());
         return *this;
     }
 
+    // Stores indices in the narrowest type able to address vertexCount vertices, at least 16 bit
+    // unless ByteIndices is set.
+    TMeshBuilder &SetIndices(EBufferUsage usage, const std::vector<GLuint> &src, unsigned vertexCount);
+
     template<typename T>
     TMeshBuilder &SetInstances(EBufferUsage usage, T &&src) {
         SetInstances({usage, std::forward<T>(src)}, src.size());
@@ -47,6 +87,12 @@ public:
         AddLayout(dataType, count, 0);
         return *this;
     }
+
+    TMeshBuilder &AddLayout(unsigned location, TArrayBuffer buffer, EDataType dataType, unsigned count,
+                            bool normalized, size_t offset, unsigned stride) {
+        AddAttribute({location, std::move(buffer), dataType, count, normalized, offset, stride});
+        return *this;
+    }
 };
 
 class TInstanceMeshBuilder {
@@ -66,7 +112,31 @@ public:
     }
 };
 
+// Part of another mesh's buffers: indices are offset by the first index and the vertex
+// buffer is addressed from the base vertex, so every range shares one VAO.
+class TMeshRangeBuilder {
+public:
+    BUILDER_PROPERTY2(unsigned, unsigned, Indices){0, 0};
+    BUILDER_PROPERTY2(GLint, unsigned, Vertices){0, 0};
+    BUILDER_PROPERTY(std::shared_ptr<const TMeshlets>, Meshlets){};
+    BUILDER_PROPERTY(std::optional<TBounds>, Bounds){};
+};
+
+class TMesh;
+
+// Binds a mesh's VAO for its draws, the state cache drops binds of the VAO already bound.
+class TMeshBinder {
+public:
+    TMeshBinder() = default;
+    explicit TMeshBinder(const TMesh &mesh) { Bind(mesh); }
+    TMeshBinder(const TMeshBinder &) = delete;
+    TMeshBinder &operator=(const TMeshBinder &) = delete;
+
+    void Bind(const TMesh &mesh);
+};
+
 class TMesh {
+    friend class TMeshBinder;
 private:
     std::shared_ptr<GLuint> VertexArrayObject;
     TArrayBuffer Vertices;
@@ -75,12 +145,24 @@ private:
     unsigned VertexCount;
     unsigned IndexCount;
     unsigned InstanceCount;
+    EDataType IndexType;
+    GLint BaseVertex{};
+    unsigned IndexOffset{};
+    std::shared_ptr<const TMeshlets> Meshlets;
+    // Object space bounds, meshes without them are never frustum culled.
+    std::optional<TBounds> Bounds;
     std::vector<std::tuple<EDataType, unsigned, unsigned>> Layout;
+    std::vector<TVertexAttribute> Attributes;
 
 public:
     TMesh(const TMeshBuilder &builder);
     TMesh(const TMesh &mesh, const TInstanceMeshBuilder &builder);
+    TMesh(const TMesh &mesh, const TMeshRangeBuilder &builder);
     void Draw(EDrawType type = EDrawType::Triangles) const;
+    void Draw(const TMeshBinder &binder, EDrawType type = EDrawType::Triangles) const;
+    // Draws only clusters passing the culler, meshes without clusters are drawn whole.
+    void Draw(TClusterCuller &culler, const glm::mat4 &model) const;
+    void Draw(const TMeshBinder &binder, TClusterCuller &culler, const glm::mat4 &model) const;
 
     [[nodiscard]] const TArrayBuffer &GetVertices() const { return Vertices; }
     [[nodiscard]] TArrayBuffer &GetVertices() { return Vertices; }
@@ -91,4 +173,9 @@ public:
     [[nodiscard]] unsigned GetVertexCount() const { return VertexCount; }
     [[nodiscard]] unsigned GetIndexCount() const { return IndexCount; }
     [[nodiscard]] unsigned GetInstanceCount() const { return InstanceCount; }
+    [[nodiscard]] EDataType GetIndexType() const { return IndexType; }
+    [[nodiscard]] GLint GetBaseVertex() const { return BaseVertex; }
+    [[nodiscard]] unsigned GetIndexOffset() const { return IndexOffset; }
+    [[nodiscard]] GLuint GetVertexArrayObject() const { return *VertexArrayObject; }
+    [[nodiscard]] const std::optional<TBounds> &GetBounds() const { return Bounds; }
 };
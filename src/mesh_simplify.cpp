@@ -0,0 +1,267 @@
+#include "mesh_simplify.h"
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <unordered_set>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+    constexpr float LodTargetError = 0.02f;
+    constexpr double LodMinReduction = 0.9;
+
+    struct TQuadric {
+        double A00{}, A01{}, A02{}, A11{}, A12{}, A22{};
+        double B0{}, B1{}, B2{};
+        double C{};
+
+        void AddPlane(vec3 n, float d, double weight) {
+            A00 += weight * n.x * n.x;
+            A01 += weight * n.x * n.y;
+            A02 += weight * n.x * n.z;
+            A11 += weight * n.y * n.y;
+            A12 += weight * n.y * n.z;
+            A22 += weight * n.z * n.z;
+            B0 += weight * n.x * d;
+            B1 += weight * n.y * d;
+            B2 += weight * n.z * d;
+            C += weight * d * d;
+        }
+
+        TQuadric &operator+=(const TQuadric &q) {
+            A00 += q.A00;
+            A01 += q.A01;
+            A02 += q.A02;
+            A11 += q.A11;
+            A12 += q.A12;
+            A22 += q.A22;
+            B0 += q.B0;
+            B1 += q.B1;
+            B2 += q.B2;
+            C += q.C;
+            return *this;
+        }
+
+        [[nodiscard]] double Error(vec3 p) const {
+            double x = p.x, y = p.y, z = p.z;
+            double result = A00 * x * x + A11 * y * y + A22 * z * z
+                + 2 * (A01 * x * y + A02 * x * z + A12 * y * z)
+                + 2 * (B0 * x + B1 * y + B2 * z) + C;
+            return std::abs(result);
+        }
+    };
+
+    struct TCollapse {
+        GLuint From;
+        GLuint To;
+        double Cost;
+    };
+
+    uint64_t EdgeKey(GLuint a, GLuint b) {
+        return (static_cast<uint64_t>(a) << 32U) | b;
+    }
+
+    vec3 Position(const vector<GLfloat> &vertices, unsigned stride, GLuint index) {
+        const GLfloat *v = &vertices[static_cast<size_t>(index) * stride];
+        return vec3(v[0], v[1], v[2]);
+    }
+
+    // Maps every vertex to the first vertex sharing its position.
+    vector<GLuint> PositionRemap(const vector<vec3> &positions) {
+        vector<GLuint> order(positions.size());
+        iota(order.begin(), order.end(), 0);
+        auto less = [&](GLuint a, GLuint b) {
+            auto &pa = positions[a];
+            auto &pb = positions[b];
+            if (pa.x != pb.x) return pa.x < pb.x;
+            if (pa.y != pb.y) return pa.y < pb.y;
+            if (pa.z != pb.z) return pa.z < pb.z;
+            return a < b;
+        };
+        sort(order.begin(), order.end(), less);
+        vector<GLuint> remap(positions.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (i > 0 && positions[order[i]] == positions[order[i - 1]]) {
+                remap[order[i]] = remap[order[i - 1]];
+            } else {
+                remap[order[i]] = order[i];
+            }
+        }
+        return remap;
+    }
+
+    // Seam vertices (several vertices at one position) and border vertices are never collapsed,
+    // which keeps UV seams and open edges in place.
+    vector<bool> LockedVertices(const vector<GLuint> &remap, const vector<GLuint> &indices) {
+        vector<unsigned> siblings(remap.size());
+        for (auto r : remap) {
+            siblings[r]++;
+        }
+        vector<bool> locked(remap.size());
+        for (size_t i = 0; i < remap.size(); ++i) {
+            locked[i] = siblings[remap[i]] > 1;
+        }
+        unordered_set<uint64_t> edges;
+        edges.reserve(indices.size());
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            for (size_t e = 0; e < 3; ++e) {
+                edges.insert(EdgeKey(remap[indices[i + e]], remap[indices[i + (e + 1) % 3]]));
+            }
+        }
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            for (size_t e = 0; e < 3; ++e) {
+                GLuint a = indices[i + e];
+                GLuint b = indices[i + (e + 1) % 3];
+                if (edges.find(EdgeKey(remap[b], remap[a])) == edges.end()) {
+                    locked[a] = true;
+                    locked[b] = true;
+                }
+            }
+        }
+        return locked;
+    }
+
+    vector<TQuadric> VertexQuadrics(const vector<vec3> &positions, const vector<GLuint> &indices) {
+        vector<TQuadric> quadrics(positions.size());
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            vec3 p0 = positions[indices[i]];
+            vec3 n = cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+            float area = length(n);
+            if (area == 0) continue;
+            n = n / area;
+            TQuadric q;
+            q.AddPlane(n, -dot(n, p0), area);
+            for (size_t k = 0; k < 3; ++k) {
+                quadrics[indices[i + k]] += q;
+            }
+        }
+        return quadrics;
+    }
+
+    bool FlipsTriangle(const vector<vec3> &positions, GLuint a, GLuint b, GLuint c, GLuint from, vec3 to) {
+        vec3 p0 = positions[a], p1 = positions[b], p2 = positions[c];
+        vec3 before = cross(p1 - p0, p2 - p0);
+        (a == from ? p0 : b == from ? p1 : p2) = to;
+        vec3 after = cross(p1 - p0, p2 - p0);
+        return dot(before, after) <= 0;
+    }
+
+    GLuint Resolve(vector<GLuint> &collapses, GLuint index) {
+        while (collapses[index] != index) {
+            index = collapses[index] = collapses[collapses[index]];
+        }
+        return index;
+    }
+}
+
+vector<GLuint> SimplifyMesh(const vector<GLfloat> &vertices,
+                            unsigned stride,
+                            const vector<GLuint> &indices,
+                            size_t targetIndexCount,
+                            float targetError) {
+    size_t vertexCount = vertices.size() / stride;
+    vector<vec3> positions(vertexCount);
+    vec3 low(numeric_limits<float>::max());
+    vec3 high(-numeric_limits<float>::max());
+    for (GLuint i = 0; i < vertexCount; ++i) {
+        positions[i] = Position(vertices, stride, i);
+        low = min(low, positions[i]);
+        high = max(high, positions[i]);
+    }
+    vec3 extent = high - low;
+    double maxError = targetError * std::max(extent.x, std::max(extent.y, extent.z));
+    double maxCost = maxError * maxError;
+
+    auto remap = PositionRemap(positions);
+    auto locked = LockedVertices(remap, indices);
+    auto quadrics = VertexQuadrics(positions, indices);
+    vector<GLuint> result = indices;
+    vector<GLuint> collapses(vertexCount);
+    iota(collapses.begin(), collapses.end(), 0);
+
+    while (result.size() > targetIndexCount) {
+        vector<GLuint> offsets(vertexCount + 1);
+        for (auto index : result) {
+            offsets[index + 1]++;
+        }
+        partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        vector<GLuint> adjacency(result.size());
+        vector<GLuint> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < result.size(); ++i) {
+            adjacency[fill[result[i]]++] = static_cast<GLuint>(i / 3);
+        }
+
+        vector<TCollapse> candidates;
+        candidates.reserve(result.size());
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (size_t e = 0; e < 3; ++e) {
+                GLuint a = result[i + e];
+                GLuint b = result[i + (e + 1) % 3];
+                TQuadric q = quadrics[a];
+                q += quadrics[b];
+                if (!locked[a]) candidates.push_back({a, b, q.Error(positions[b])});
+                if (!locked[b]) candidates.push_back({b, a, q.Error(positions[a])});
+            }
+        }
+        sort(candidates.begin(), candidates.end(), [](auto &l, auto &r) { return l.Cost < r.Cost; });
+
+        vector<bool> touched(vertexCount);
+        size_t triangles = result.size() / 3;
+        size_t targetTriangles = targetIndexCount / 3;
+        size_t accepted = 0;
+        for (auto &[from, to, cost] : candidates) {
+            if (triangles <= targetTriangles || cost > maxCost) break;
+            if (touched[from] || touched[to]) continue;
+            bool flips = false;
+            size_t removed = 0;
+            for (GLuint k = offsets[from]; k < offsets[from + 1] && !flips; ++k) {
+                const GLuint *t = &result[adjacency[k] * 3];
+                if (t[0] == to || t[1] == to || t[2] == to) {
+                    removed++;
+                } else {
+                    flips = FlipsTriangle(positions, t[0], t[1], t[2], from, positions[to]);
+                }
+            }
+            if (flips) continue;
+            for (GLuint k = offsets[from]; k < offsets[from + 1]; ++k) {
+                const GLuint *t = &result[adjacency[k] * 3];
+                touched[t[0]] = touched[t[1]] = touched[t[2]] = true;
+            }
+            collapses[from] = to;
+            quadrics[to] += quadrics[from];
+            triangles -= removed;
+            accepted++;
+        }
+        if (accepted == 0) break;
+
+        size_t write = 0;
+        for (size_t i = 0; i < result.size(); i += 3) {
+            GLuint a = Resolve(collapses, result[i]);
+            GLuint b = Resolve(collapses, result[i + 1]);
+            GLuint c = Resolve(collapses, result[i + 2]);
+            if (a != b && b != c && c != a) {
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+        }
+        result.resize(write);
+    }
+    return result;
+}
+
+vector<vector<GLuint>> BuildLods(const vector<GLfloat> &vertices,
+                                 unsigned stride,
+                                 const vector<GLuint> &indices,
+                                 size_t levels) {
+    vector<vector<GLuint>> lods{indices};
+    for (size_t level = 1; level < levels; ++level) {
+        auto &previous = lods.back();
+        size_t target = previous.size() / 6 * 3;
+        auto lod = SimplifyMesh(vertices, stride, previous, target, LodTargetError * static_cast<float>(level));
+        if (lod.empty() || lod.size() > previous.size() * LodMinReduction) break;
+        lods.emplace_back(std::move(lod));
+    }
+    return lods;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "common.h"
+
+// Quadric error edge collapse. Vertices are never moved or created, so the result indexes
+// the same vertex buffer. Vertex position is expected in the first three floats of each
+// vertex; targetError is relative to the largest mesh extent.
+std::vector<GLuint> SimplifyMesh(const std::vector<GLfloat> &vertices,
+                                 unsigned stride,
+                                 const std::vector<GLuint> &indices,
+                                 size_t targetIndexCount,
+                                 float targetError);
+
+// Detail levels halving triangle count each step, level 0 is the source mesh.
+// Stops early when simplification can't make meaningful progress.
+std::vector<std::vector<GLuint>> BuildLods(const std::vector<GLfloat> &vertices,
+                                           unsigned stride,
+                                           const std::vector<GLuint> &indices,
+                                           size_t levels);
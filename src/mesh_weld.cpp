@@ -0,0 +1,69 @@
+#include "mesh_weld.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace std;
+
+namespace {
+    constexpr GLuint Empty = numeric_limits<GLuint>::max();
+
+    int64_t AttributeKey(GLfloat value, float epsilon) {
+        if (epsilon > 0) {
+            return llround(static_cast<double>(value) / epsilon);
+        }
+        if (value == 0) {
+            return 0;
+        }
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    uint64_t Hash(const int64_t *keys, unsigned stride) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned i = 0; i < stride; ++i) {
+            hash ^= static_cast<uint64_t>(keys[i]);
+            hash *= 1099511628211ULL;
+        }
+        return hash ^ (hash >> 29U);
+    }
+}
+
+size_t WeldVertices(vector<GLfloat> &vertices, unsigned stride, vector<GLuint> &indices, float epsilon) {
+    size_t count = vertices.size() / stride;
+    vector<int64_t> keys(count * stride);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        keys[i] = AttributeKey(vertices[i], epsilon);
+    }
+
+    size_t capacity = 1;
+    while (capacity < count * 2) {
+        capacity <<= 1U;
+    }
+    vector<GLuint> table(capacity, Empty);
+    vector<GLuint> remap(count);
+    vector<GLfloat> welded;
+    welded.reserve(vertices.size());
+    GLuint unique = 0;
+    for (size_t v = 0; v < count; ++v) {
+        const int64_t *key = &keys[v * stride];
+        size_t slot = Hash(key, stride) & (capacity - 1);
+        while (table[slot] != Empty
+               && memcmp(&keys[static_cast<size_t>(table[slot]) * stride], key, stride * sizeof(int64_t)) != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (table[slot] == Empty) {
+            table[slot] = static_cast<GLuint>(v);
+            remap[v] = unique++;
+            welded.insert(welded.end(), vertices.begin() + v * stride, vertices.begin() + (v + 1) * stride);
+        } else {
+            remap[v] = remap[table[slot]];
+        }
+    }
+    for (auto &index : indices) {
+        index = remap[index];
+    }
+    vertices = std::move(welded);
+    return unique;
+}
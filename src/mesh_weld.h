@@ -0,0 +1,11 @@
+#pragma once
+#include "common.h"
+
+// Merges vertices whose attributes match and remaps indices, keeping first-seen vertex order.
+// With epsilon 0 attributes must be bitwise equal, otherwise they are snapped to an epsilon
+// grid before comparing. Every attribute takes part, so vertices split by a UV seam or a hard
+// normal edge stay separate. Returns the number of vertices left.
+size_t WeldVertices(std::vector<GLfloat> &vertices,
+                    unsigned stride,
+                    std::vector<GLuint> &indices,
+                    float epsilon = 0.0f);
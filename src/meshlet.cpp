@@ -0,0 +1,301 @@
+#include "meshlet.h"
+#include "bounds.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <deque>
+#include <numeric>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MESHLET_SSE
+#endif
+
+using namespace std;
+using namespace glm;
+
+namespace {
+    constexpr size_t MaxTriangles = 124;
+    constexpr size_t MaxVertices = 64;
+    // Triangles bending further than this from the seed stay out of the cluster to keep cones narrow.
+    constexpr float MinSeedDot = 0.25f;
+    constexpr float MinConeDot = 0.1f;
+    // Clusters per job, smaller meshes are culled on the calling thread.
+    constexpr size_t ParallelThreshold = 4096;
+
+    vec3 VertexAt(const vector<GLfloat> &vertices, unsigned stride, GLuint index, unsigned offset) {
+        const GLfloat *v = &vertices[static_cast<size_t>(index) * stride + offset];
+        return vec3(v[0], v[1], v[2]);
+    }
+
+    vec3 FaceNormal(const vector<GLfloat> &vertices, unsigned stride, const GLuint *t) {
+        vec3 p0 = VertexAt(vertices, stride, t[0], 0);
+        vec3 n = cross(VertexAt(vertices, stride, t[1], 0) - p0, VertexAt(vertices, stride, t[2], 0) - p0);
+        float l = length(n);
+        return l > 0 ? n / l : vec3(0.0f);
+    }
+
+    void AddBounds(TMeshlets &meshlets,
+                   const vector<GLfloat> &vertices,
+                   unsigned stride,
+                   const vector<GLuint> &indices,
+                   GLuint offset,
+                   GLuint count) {
+        vec3 low(numeric_limits<float>::max());
+        vec3 high(-numeric_limits<float>::max());
+        vec3 axis(0.0f);
+        for (GLuint i = offset; i < offset + count; i += 3) {
+            for (GLuint k = 0; k < 3; ++k) {
+                vec3 p = VertexAt(vertices, stride, indices[i + k], 0);
+                low = min(low, p);
+                high = max(high, p);
+            }
+            axis += FaceNormal(vertices, stride, &indices[i]);
+        }
+        vec3 center = (low + high) * 0.5f;
+        float radius = 0;
+        for (GLuint i = offset; i < offset + count; ++i) {
+            radius = std::max(radius, length(VertexAt(vertices, stride, indices[i], 0) - center));
+        }
+        float cutoff = 1.0f;
+        float axisLength = length(axis);
+        if (axisLength > 0) {
+            axis = axis / axisLength;
+            float minDot = 1.0f;
+            for (GLuint i = offset; i < offset + count; i += 3) {
+                minDot = std::min(minDot, dot(axis, FaceNormal(vertices, stride, &indices[i])));
+            }
+            if (minDot > MinConeDot) {
+                cutoff = std::sqrt(1.0f - minDot * minDot);
+            }
+        }
+        meshlets.Offsets.push_back(offset);
+        meshlets.Counts.push_back(count);
+        meshlets.CenterX.push_back(center.x);
+        meshlets.CenterY.push_back(center.y);
+        meshlets.CenterZ.push_back(center.z);
+        meshlets.Radius.push_back(radius);
+        meshlets.AxisX.push_back(axis.x);
+        meshlets.AxisY.push_back(axis.y);
+        meshlets.AxisZ.push_back(axis.z);
+        meshlets.Cutoff.push_back(cutoff);
+    }
+
+    vec4 ToObject(const mat4 &model, vec4 plane) {
+        return vec4(dot(model[0], plane), dot(model[1], plane), dot(model[2], plane), dot(model[3], plane));
+    }
+
+    struct TCullParams {
+        vector<array<vec4, 6>> Frusta;
+        vec3 Eye;
+        float Scale;
+        float Sign;
+        bool Perspective;
+    };
+
+    bool CullOne(const TMeshlets &m, size_t i, const TCullParams &p) {
+        vec3 center(m.CenterX[i], m.CenterY[i], m.CenterZ[i]);
+        float radius = m.Radius[i];
+        bool inside = false;
+        for (auto &planes : p.Frusta) {
+            bool frustum = true;
+            for (auto &plane : planes) {
+                frustum = frustum && dot(vec3(plane), center) + plane.w >= -radius * p.Scale;
+            }
+            inside = inside || frustum;
+        }
+        if (!inside) return false;
+        vec3 axis = p.Sign * vec3(m.AxisX[i], m.AxisY[i], m.AxisZ[i]);
+        if (p.Perspective) {
+            vec3 view = center - p.Eye;
+            return dot(view, axis) < m.Cutoff[i] * length(view) + radius;
+        }
+        return dot(p.Eye, axis) <= m.Cutoff[i];
+    }
+
+    void CullRange(const TMeshlets &m, size_t begin, size_t end, const TCullParams &p, uint8_t *visible) {
+        size_t i = begin;
+#ifdef MESHLET_SSE
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 scale = _mm_set1_ps(p.Scale);
+        const __m128 sign = _mm_set1_ps(p.Sign);
+        const __m128 ex = _mm_set1_ps(p.Eye.x);
+        const __m128 ey = _mm_set1_ps(p.Eye.y);
+        const __m128 ez = _mm_set1_ps(p.Eye.z);
+        for (; i + 4 <= end; i += 4) {
+            __m128 cx = _mm_loadu_ps(&m.CenterX[i]);
+            __m128 cy = _mm_loadu_ps(&m.CenterY[i]);
+            __m128 cz = _mm_loadu_ps(&m.CenterZ[i]);
+            __m128 r = _mm_loadu_ps(&m.Radius[i]);
+            __m128 limit = _mm_sub_ps(zero, _mm_mul_ps(r, scale));
+            __m128 inside = zero;
+            for (auto &planes : p.Frusta) {
+                __m128 frustum = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                for (auto &plane : planes) {
+                    __m128 d = _mm_add_ps(
+                        _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+                        _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+                    frustum = _mm_and_ps(frustum, _mm_cmpge_ps(d, limit));
+                }
+                inside = _mm_or_ps(inside, frustum);
+            }
+            __m128 ax = _mm_mul_ps(_mm_loadu_ps(&m.AxisX[i]), sign);
+            __m128 ay = _mm_mul_ps(_mm_loadu_ps(&m.AxisY[i]), sign);
+            __m128 az = _mm_mul_ps(_mm_loadu_ps(&m.AxisZ[i]), sign);
+            __m128 cutoff = _mm_loadu_ps(&m.Cutoff[i]);
+            __m128 facing;
+            if (p.Perspective) {
+                __m128 vx = _mm_sub_ps(cx, ex);
+                __m128 vy = _mm_sub_ps(cy, ey);
+                __m128 vz = _mm_sub_ps(cz, ez);
+                __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)),
+                                                    _mm_mul_ps(vz, vz)));
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, ax), _mm_mul_ps(vy, ay)), _mm_mul_ps(vz, az));
+                facing = _mm_cmplt_ps(d, _mm_add_ps(_mm_mul_ps(cutoff, len), r));
+            } else {
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ax), _mm_mul_ps(ey, ay)), _mm_mul_ps(ez, az));
+                facing = _mm_cmple_ps(d, cutoff);
+            }
+            int mask = _mm_movemask_ps(_mm_and_ps(inside, facing));
+            for (int k = 0; k < 4; ++k) {
+                visible[i + k] = (mask >> k) & 1;
+            }
+        }
+#endif
+        for (; i < end; ++i) {
+            visible[i] = CullOne(m, i, p);
+        }
+    }
+}
+
+shared_ptr<const TMeshlets> BuildMeshlets(const vector<GLfloat> &vertices, unsigned stride, vector<GLuint> &indices) {
+    size_t vertexCount = vertices.size() / stride;
+    size_t triangleCount = indices.size() / 3;
+    vector<GLuint> offsets(vertexCount + 1);
+    for (auto index : indices) {
+        offsets[index + 1]++;
+    }
+    partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    vector<GLuint> adjacency(indices.size());
+    vector<GLuint> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) {
+        adjacency[fill[indices[i]]++] = static_cast<GLuint>(i / 3);
+    }
+
+    auto meshlets = make_shared<TMeshlets>();
+    vector<GLuint> result;
+    result.reserve(indices.size());
+    vector<bool> emitted(triangleCount);
+    vector<size_t> vertexTag(vertexCount, numeric_limits<size_t>::max());
+    for (size_t seed = 0; seed < triangleCount; ++seed) {
+        if (emitted[seed]) continue;
+        size_t id = meshlets->Size();
+        auto offset = static_cast<GLuint>(result.size());
+        size_t triangles = 0;
+        size_t unique = 0;
+        vec3 seedNormal = FaceNormal(vertices, stride, &indices[seed * 3]);
+        deque<GLuint> queue{static_cast<GLuint>(seed)};
+        while (!queue.empty() && triangles < MaxTriangles) {
+            GLuint t = queue.front();
+            queue.pop_front();
+            if (emitted[t]) continue;
+            const GLuint *tri = &indices[t * 3];
+            size_t added = 0;
+            for (size_t k = 0; k < 3; ++k) {
+                added += vertexTag[tri[k]] != id;
+            }
+            if (unique + added > MaxVertices) continue;
+            if (t != seed && dot(FaceNormal(vertices, stride, tri), seedNormal) < MinSeedDot) continue;
+            emitted[t] = true;
+            triangles++;
+            unique += added;
+            for (size_t k = 0; k < 3; ++k) {
+                vertexTag[tri[k]] = id;
+                result.push_back(tri[k]);
+                for (GLuint a = offsets[tri[k]]; a < offsets[tri[k] + 1]; ++a) {
+                    if (!emitted[adjacency[a]]) {
+                        queue.push_back(adjacency[a]);
+                    }
+                }
+            }
+        }
+        AddBounds(*meshlets, vertices, stride, result, offset, static_cast<GLuint>(result.size()) - offset);
+    }
+    indices = std::move(result);
+    return meshlets;
+}
+
+TClusterCuller::TClusterCuller(const mat4 &viewProjection, vec3 eye, bool cullFront)
+    : Frusta{FrustumPlanes(viewProjection)}
+      , Eye(eye)
+      , CullFront(cullFront) {
+}
+
+TClusterCuller::TClusterCuller(const array<mat4, 6> &viewProjections, vec3 eye, bool cullFront)
+    : Eye(eye)
+      , CullFront(cullFront) {
+    for (auto &matrix : viewProjections) {
+        Frusta.push_back(FrustumPlanes(matrix));
+    }
+}
+
+TClusterCuller::TClusterCuller(vector<array<vec4, 6>> frusta, vec3 eye, bool cullFront)
+    : Frusta(std::move(frusta))
+      , Eye(eye)
+      , CullFront(cullFront) {
+}
+
+TClusterCuller TClusterCuller::Orthographic(const mat4 &viewProjection, vec3 direction, bool cullFront) {
+    TClusterCuller culler(viewProjection, vec3(0.0f), cullFront);
+    culler.Direction = normalize(direction);
+    culler.Perspective = false;
+    return culler;
+}
+
+void TClusterCuller::Cull(const TMeshlets &meshlets,
+                          const mat4 &model,
+                          vector<GLsizei> &counts,
+                          vector<GLuint> &offsets) {
+    counts.clear();
+    offsets.clear();
+    size_t size = meshlets.Size();
+    TCullParams params;
+    params.Scale = std::max(length(vec3(model[0])), std::max(length(vec3(model[1])), length(vec3(model[2]))));
+    params.Sign = CullFront ? -1.0f : 1.0f;
+    params.Perspective = Perspective;
+    for (auto &planes : Frusta) {
+        array<vec4, 6> local{};
+        for (size_t i = 0; i < planes.size(); ++i) {
+            local[i] = ToObject(model, planes[i]);
+        }
+        params.Frusta.push_back(local);
+    }
+    if (Perspective) {
+        params.Eye = vec3(inverse(model) * vec4(Eye, 1.0f));
+    } else {
+        params.Eye = normalize(inverse(mat3(model)) * Direction);
+    }
+
+    Visibility.resize(size);
+    auto &pool = TWorkerPool::Get();
+    size_t jobs = std::min(pool.GetSize(), size / ParallelThreshold);
+    if (jobs > 1) {
+        size_t chunk = (size + jobs - 1) / jobs;
+        pool.Run(jobs, [&](size_t job) {
+            CullRange(meshlets, job * chunk, std::min(size, (job + 1) * chunk), params, Visibility.data());
+        });
+    } else {
+        CullRange(meshlets, 0, size, params, Visibility.data());
+    }
+
+    for (size_t i = 0; i < size; ++i) {
+        if (!Visibility[i]) continue;
+        Passed++;
+        GLuint offset = meshlets.Offsets[i];
+        if (!offsets.empty() && offsets.back() + counts.back() == offset) {
+            counts.back() += static_cast<GLsizei>(meshlets.Counts[i]);
+        } else {
+            offsets.push_back(offset);
+            counts.push_back(static_cast<GLsizei>(meshlets.Counts[i]));
+        }
+    }
+    Tested += size;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "common.h"
+#include <memory>
+
+// Clusters of a mesh, stored as structure of arrays for the culling kernels.
+// Each cluster is a contiguous range of the index buffer.
+struct TMeshlets {
+    std::vector<GLuint> Offsets;
+    std::vector<GLuint> Counts;
+    std::vector<float> CenterX, CenterY, CenterZ, Radius;
+    std::vector<float> AxisX, AxisY, AxisZ, Cutoff;
+
+    [[nodiscard]] size_t Size() const { return Offsets.size(); }
+};
+
+// Reorders indices so that every cluster is contiguous and returns cluster bounds.
+// Vertex position and normal are expected in the first six floats of each vertex.
+std::shared_ptr<const TMeshlets> BuildMeshlets(const std::vector<GLfloat> &vertices,
+                                               unsigned stride,
+                                               std::vector<GLuint> &indices);
+
+// Culls clusters by frustum and normal cone for one view. Shadow views rendered with
+// front face culling pass cullFront, so clusters facing the light are skipped instead.
+class TClusterCuller {
+private:
+    std::vector<std::array<glm::vec4, 6>> Frusta;
+    glm::vec3 Eye{};
+    glm::vec3 Direction{};
+    bool Perspective{true};
+    bool CullFront{false};
+    std::vector<uint8_t> Visibility;
+    size_t Tested = 0;
+    size_t Passed = 0;
+
+public:
+    TClusterCuller() = default;
+    TClusterCuller(const glm::mat4 &viewProjection, glm::vec3 eye, bool cullFront = false);
+    TClusterCuller(const std::array<glm::mat4, 6> &viewProjections, glm::vec3 eye, bool cullFront = false);
+    // Frusta given by their inward planes, e.g. half spaces padded with planes that pass everything.
+    TClusterCuller(std::vector<std::array<glm::vec4, 6>> frusta, glm::vec3 eye, bool cullFront = false);
+    static TClusterCuller Orthographic(const glm::mat4 &viewProjection, glm::vec3 direction, bool cullFront = false);
+
+    // Writes visible index ranges, adjacent clusters are merged into one range.
+    void Cull(const TMeshlets &meshlets,
+              const glm::mat4 &model,
+              std::vector<GLsizei> &counts,
+              std::vector<GLuint> &offsets);
+
+    [[nodiscard]] bool Empty() const { return Frusta.empty(); }
+    [[nodiscard]] const std::vector<std::array<glm::vec4, 6>> &GetFrusta() const { return Frusta; }
+    [[nodiscard]] size_t GetTested() const { return Tested; }
+    [[nodiscard]] size_t GetPassed() const { return Passed; }
+};
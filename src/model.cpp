@@ -1 +1,30 @@
 #include "model.h"
+
+size_t TModel::SelectLod(const glm::mat4 &model, const TLodSelector &selector) const {
+    if (Radius <= 0 || selector.Pixels <= 0) {
+        return 0;
+    }
+    float scale = std::max(glm::length(glm::vec3(model[0])),
+                           std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    float coverage = Radius * scale * selector.Scale;
+    if (selector.Perspective) {
+        float distance = glm::length(glm::vec3(model * glm::vec4(Center, 1.0f)) - selector.Eye);
+        if (distance <= Radius * scale) {
+            return static_cast<size_t>(std::max(selector.Bias, 0));
+        }
+        coverage /= distance;
+    }
+    float pixels = coverage * static_cast<float>(selector.Pixels);
+    int level = pixels > 0 ? static_cast<int>(std::floor(std::log2(LodPixels / pixels))) : 0;
+    return static_cast<size_t>(std::max(std::max(level, 0) + selector.Bias, 0));
+}
+
+const TMat4Array *TModel::Place(const glm::mat4 &model) const {
+    if (Transforms.Size() == 0) {
+        return nullptr;
+    }
+    // Valid until the next call on this thread, the draw loops consume it right away.
+    thread_local TMat4Array placement;
+    NBatchMath::Multiply(model, Transforms, placement);
+    return &placement;
+}
@@ -2,18 +2,64 @@
 #include "mesh.h"
 #include "material.h"
 #include "shader_program.h"
+#include "batch_math.h"
 #include <functional>
 
+// Describes the view a model is drawn into, used to pick a detail level.
+struct TLodSelector {
+    glm::vec3 Eye{};
+    float Scale{};
+    bool Perspective{true};
+    int Pixels{};
+    int Bias{};
+
+    TLodSelector() = default;
+    TLodSelector(const glm::mat4 &projection, glm::vec3 eye, int pixels, int bias = 0)
+        : Eye(eye)
+          , Scale(projection[1][1])
+          , Perspective(projection[3][3] == 0)
+          , Pixels(pixels)
+          , Bias(bias) {
+    }
+};
+
+// Vertices an importer read and how many of them were left after welding.
+struct TModelStats {
+    size_t LoadedVertices{};
+    size_t WeldedVertices{};
+};
+
 class TModel {
 private:
-    std::vector<std::tuple<TMesh, std::string, size_t>> Meshes;
+    // Projected height in pixels below which the next, twice coarser level is used.
+    static constexpr float LodPixels = 512.0f;
+    std::vector<std::tuple<std::vector<TMesh>, std::string, size_t>> Meshes;
+    // Node transform of every mesh, empty while all meshes sit at the model origin.
+    TMat4Array Transforms;
+    // Object space bounds of every mesh for batched frustum culling.
+    TVec3Array MeshCenters;
+    TVec3Array MeshExtents;
     std::vector<TMaterial> Materials;
+    glm::vec3 Center{};
+    float Radius{};
+    TModelStats Stats;
+    // Half extent given to meshes without bounds, large enough to never be culled yet finite
+    // so that the culling arithmetic stays free of infinities.
+    static constexpr float Unbounded = 1e30f;
+
+    void AddMeshBounds() {
+        auto &bounds = std::get<0>(Meshes.back()).front().GetBounds();
+        MeshCenters.Push(bounds ? bounds->Center : glm::vec3(0.0f));
+        MeshExtents.Push(bounds ? bounds->Extent : glm::vec3(Unbounded));
+    }
 
 public:
+
     TModel() = default;
     TModel(const std::string &name, const TMaterialBuilder &materialBuilder, TMeshBuilder &&meshBuilder) {
         Materials.emplace_back(materialBuilder);
-        Meshes.emplace_back(std::forward_as_tuple(std::move(meshBuilder), name, 0));
+        Meshes.emplace_back(std::vector<TMesh>{TMesh(meshBuilder)}, name, 0);
+        AddMeshBounds();
     }
 
     TModel &Material(const TMaterialBuilder &mat) {
@@ -22,37 +68,133 @@ public:
     }
 
     TModel &Mesh(const std::string &name, const TMeshBuilder &builder, int material) {
-        Meshes.emplace_back(std::forward_as_tuple(builder, name, material));
+        Meshes.emplace_back(std::vector<TMesh>{TMesh(builder)}, name, material);
+        AddMeshBounds();
+        if (Transforms.Size() != 0) {
+            Transforms.Push(glm::mat4(1.0f));
+        }
         return *this;
     }
 
-    void Draw(TShaderSetup &&setup) const {
-        for (auto&[mesh, name, mat] : Meshes) {
-            TMaterialBinder binder(Materials[mat], setup);
-            mesh.Draw();
+    // Levels of detail go from the finest to the coarsest.
+    TModel &Mesh(const std::string &name, const std::vector<TMeshBuilder> &lods, int material) {
+        std::vector<TMesh> meshes(lods.begin(), lods.end());
+        Meshes.emplace_back(std::move(meshes), name, material);
+        AddMeshBounds();
+        if (Transforms.Size() != 0) {
+            Transforms.Push(glm::mat4(1.0f));
         }
+        return *this;
+    }
+
+    // Meshes created as ranges of one packed mesh share its VAO and are drawn without rebinding.
+    TModel &Mesh(const std::string &name, std::vector<TMesh> lods, int material) {
+        Meshes.emplace_back(std::move(lods), name, material);
+        AddMeshBounds();
+        if (Transforms.Size() != 0) {
+            Transforms.Push(glm::mat4(1.0f));
+        }
+        return *this;
+    }
+
+    TModel &Mesh(const std::string &name, std::vector<TMesh> lods, int material, const glm::mat4 &transform) {
+        while (Transforms.Size() < Meshes.size()) {
+            Transforms.Push(glm::mat4(1.0f));
+        }
+        Meshes.emplace_back(std::move(lods), name, material);
+        AddMeshBounds();
+        Transforms.Push(transform);
+        return *this;
+    }
+
+    TModel &Bounds(glm::vec3 center, float radius) {
+        Center = center;
+        Radius = radius;
+        return *this;
+    }
+
+    TModel &Imported(const TModelStats &stats) {
+        Stats = stats;
+        return *this;
+    }
+
+    void Draw(TShaderSetup &&setup) const {
+        Draw(setup, 0);
     }
 
     void Draw(TShaderSetup &setup) const {
-        for (auto&[mesh, name, mat] : Meshes) {
+        Draw(setup, 0);
+    }
+
+    void Draw(TShaderSetup &setup, size_t lod) const {
+        TMeshBinder meshBinder;
+        for (auto&[meshes, name, mat] : Meshes) {
             TMaterialBinder binder(Materials[mat], setup);
-            mesh.Draw();
+            auto &mesh = meshes[std::min(lod, meshes.size() - 1)];
+            meshBinder.Bind(mesh);
+            mesh.Draw(meshBinder);
         }
     }
 
     void Draw(TShaderSetup &setup,
               const std::function<void(const std::string &, const TMesh &, const TMaterial &material)> &fn) const {
-        for (auto&[mesh, name, mat] : Meshes) {
-            fn(name, mesh, Materials.at(mat));
+        for (auto&[meshes, name, mat] : Meshes) {
+            fn(name, meshes.front(), Materials.at(mat));
         }
     }
 
+    // World matrices of every mesh, null when no mesh has a node transform.
+    [[nodiscard]] const TMat4Array *Place(const glm::mat4 &model) const;
+
+    [[nodiscard]] size_t SelectLod(const glm::mat4 &model, const TLodSelector &selector) const;
+
+    [[nodiscard]] glm::vec3 GetCenter() const {
+        return Center;
+    }
+
+    [[nodiscard]] float GetRadius() const {
+        return Radius;
+    }
+
+    [[nodiscard]] const TModelStats &GetStats() const {
+        return Stats;
+    }
+
+    [[nodiscard]] const TVec3Array &GetMeshCenters() const {
+        return MeshCenters;
+    }
+
+    [[nodiscard]] const TVec3Array &GetMeshExtents() const {
+        return MeshExtents;
+    }
+
     [[nodiscard]] size_t MeshCount() const {
         return Meshes.size();
     }
 
     [[nodiscard]] const TMesh &GetMesh(int index) const {
-        return std::get<0>(Meshes.at(index));
+        return std::get<0>(Meshes.at(index)).front();
+    }
+
+    [[nodiscard]] const TMesh &GetMesh(int index, size_t lod) const {
+        auto &meshes = std::get<0>(Meshes.at(index));
+        return meshes[std::min(lod, meshes.size() - 1)];
+    }
+
+    [[nodiscard]] glm::mat4 GetTransform(int index) const {
+        return Transforms.Size() == 0 ? glm::mat4(1.0f) : Transforms.Get(index);
+    }
+
+    [[nodiscard]] size_t LodCount(int index) const {
+        return std::get<0>(Meshes.at(index)).size();
+    }
+
+    [[nodiscard]] size_t LodCount() const {
+        size_t count = 0;
+        for (auto &mesh : Meshes) {
+            count = std::max(count, std::get<0>(mesh).size());
+        }
+        return count;
     }
 
     [[nodiscard]] size_t MaterialsCount() const {
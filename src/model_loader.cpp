@@ -1,4 +1,9 @@
 #include "model.h"
+#include "model_loader.h"
+#include "mesh_simplify.h"
+#include "mesh_weld.h"
+#include "mapped_file.h"
+#include "gltf_loader.h"
 #include "errors.h"
 #include <vector>
 #include <deque>
@@ -7,12 +12,48 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <algorithm>
+#include <limits>
+#include <map>
+#include <future>
+#include <iostream>
+#include <thread>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <cstring>
 #ifndef __APPLE__
 #include <filesystem>
 #endif
+
 using namespace std;
 using namespace glm;
 
+// Textures are kept as builders until the GL thread creates them from the decoded images.
+struct TMaterialData {
+    TMaterialBuilder Builder;
+    vector<pair<EMaterialProp, TTextureBuilder>> Textures;
+};
+
+struct TMeshData {
+    string Name;
+    unsigned Material;
+    vector<GLfloat> Vertices;
+    // Vertex count before welding.
+    size_t LoadedVertices{};
+    vector<vector<GLuint>> Lods;
+    vector<shared_ptr<const TMeshlets>> Meshlets;
+    TBounds Bounds;
+};
+
+struct Impl::TModelData {
+    vector<TMaterialData> Materials;
+    vector<TMeshData> Meshes;
+    vec3 Low{numeric_limits<float>::max()};
+    vec3 High{-numeric_limits<float>::max()};
+    // Binary glTF keeps its buffers in the mapped file until they are uploaded.
+    shared_ptr<const TGltfScene> Gltf;
+};
+
 bool LoadColorTexture(const aiMaterial *material,
                       EMaterialProp prop,
                       aiTextureType type,
@@ -21,17 +62,17 @@ bool LoadColorTexture(const aiMaterial *material,
                       unsigned colorIndex,
                       ETextureUsage usage,
                       const std::string &directory,
-                      TMaterialBuilder &builder) {
+                      TMaterialData &data) {
     if (material->GetTextureCount(type) > 0) {
         aiString path;
         material->GetTexture(type, 0, &path);
         std::string texPath = directory + "/" + path.C_Str();
-        builder.SetTexture(prop, TTextureBuilder().SetFile(texPath).SetUsage(usage));
+        data.Textures.emplace_back(prop, TTextureBuilder().SetFile(texPath).SetUsage(usage));
         return true;
     }
     aiColor3D color;
     if (colorKey != nullptr && material->Get(colorKey, colorType, colorIndex, color) == aiReturn_SUCCESS) {
-        builder.SetColor(prop, vec4(color.r, color.g, color.b, 1.0f));
+        data.Builder.SetColor(prop, vec4(color.r, color.g, color.b, 1.0f));
         return true;
     }
     return false;
@@ -44,25 +85,468 @@ bool LoadConstantTexture(const aiMaterial *material,
                          unsigned constantType,
                          unsigned constantIndex,
                          const std::string &directory,
-                         TMaterialBuilder &builder) {
+                         TMaterialData &data) {
     if (material->GetTextureCount(type) > 0) {
         aiString path;
         material->GetTexture(type, 0, &path);
         std::string texPath = directory + "/" + path.C_Str();
-        builder.SetTexture(prop, TTextureBuilder().SetFile(texPath));
+        data.Textures.emplace_back(prop, TTextureBuilder().SetFile(texPath));
         return true;
     }
     float constant;
     if (material->Get(constantKey, constantType, constantIndex, constant) == aiReturn_SUCCESS) {
-        builder.SetConstant(prop, constant);
+        data.Builder.SetConstant(prop, constant);
         return true;
     }
     return false;
 }
 
-TMeshBuilder LoadMesh(aiMesh *mesh);
+constexpr unsigned VertexStride = 14;
+constexpr size_t LodLevels = 4;
+// Only merges vertices differing by float noise, seams differ by far more.
+constexpr float WeldEpsilon = 1e-5f;
+
+void LoadMesh(aiMesh *mesh, vector<GLfloat> &vertices, vector<GLuint> &indexes);
+void MeshLods(TMeshData &mesh, const vector<GLuint> &indexes);
+void AddMesh(TModel &model, const TMeshData &mesh);
+void AddPackedMeshes(TModel &model, const vector<TMeshData> &meshes);
+
+void DecodeTextures(vector<TMaterialData> &materials);
+TModel BuildModel(const Impl::TModelData &data, bool packed);
+
+// Welds the mesh, grows the model bounds and builds detail levels, shared by all importers.
+void FinishMesh(Impl::TModelData &model, TMeshData &mesh, vector<GLuint> &indexes) {
+    mesh.LoadedVertices = mesh.Vertices.size() / VertexStride;
+    WeldVertices(mesh.Vertices, VertexStride, indexes, WeldEpsilon);
+    for (size_t k = 0; k < mesh.Vertices.size(); k += VertexStride) {
+        vec3 position(mesh.Vertices[k], mesh.Vertices[k + 1], mesh.Vertices[k + 2]);
+        model.Low = glm::min(model.Low, position);
+        model.High = glm::max(model.High, position);
+    }
+    mesh.Bounds = ComputeBounds(mesh.Vertices, VertexStride);
+    MeshLods(mesh, indexes);
+}
+
+namespace NObj {
+    // Files are split into chunks of about this size, each parsed by its own thread.
+    constexpr size_t ChunkSize = 1 << 20;
+    constexpr int64_t Missing = -1;
+    // Negative (relative) indices can only be resolved once the counts of earlier chunks are known,
+    // until then they are stored chunk relative with this bias added.
+    constexpr int64_t Relative = int64_t(1) << 40;
+
+    constexpr double Powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+    bool IsSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    bool IsDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    void SkipSpaces(const char *&p, const char *end) {
+        while (p < end && IsSpace(*p)) ++p;
+    }
+
+    string_view Rest(const char *p, const char *end) {
+        SkipSpaces(p, end);
+        while (end > p && IsSpace(end[-1])) --end;
+        return {p, static_cast<size_t>(end - p)};
+    }
+
+    // Accumulates up to 19 significant digits in an integer and scales once, which is exact
+    // for the short decimals exporters write. Longer or out of range input goes through strtod.
+    float ParseFloat(const char *&p, const char *end) {
+        SkipSpaces(p, end);
+        const char *start = p;
+        bool negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+')) ++p;
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        for (; p < end && IsDigit(*p); ++p) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+            } else {
+                exponent++;
+            }
+        }
+        if (p < end && *p == '.') {
+            for (++p; p < end && IsDigit(*p); ++p) {
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    digits += mantissa != 0;
+                    exponent--;
+                }
+            }
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            ++p;
+            bool negativeExponent = p < end && *p == '-';
+            if (p < end && (*p == '-' || *p == '+')) ++p;
+            int value = 0;
+            for (; p < end && IsDigit(*p); ++p) {
+                value = std::min(value * 10 + (*p - '0'), 10000);
+            }
+            exponent += negativeExponent ? -value : value;
+        }
+        if (digits >= 19 || exponent > 22 || exponent < -22) {
+            string token(start, p);
+            return strtof(token.c_str(), nullptr);
+        }
+        double value = static_cast<double>(mantissa);
+        value = exponent < 0 ? value / Powers[-exponent] : value * Powers[exponent];
+        return static_cast<float>(negative ? -value : value);
+    }
+
+    int64_t ParseIndex(const char *&p, const char *end, size_t count) {
+        bool negative = p < end && *p == '-';
+        if (negative) ++p;
+        int64_t value = 0;
+        const char *start = p;
+        for (; p < end && IsDigit(*p); ++p) {
+            value = value * 10 + (*p - '0');
+        }
+        if (p == start) {
+            return Missing;
+        }
+        return negative ? static_cast<int64_t>(count) - value + Relative : value - 1;
+    }
+
+    struct TRun {
+        optional<string> Object;
+        optional<string> Material;
+        size_t FirstCorner;
+    };
 
-TModel LoadModel(const std::string &filename) {
+    struct TChunk {
+        vector<float> Positions;
+        vector<float> Uvs;
+        vector<float> Normals;
+        // Position, uv and normal index of every triangle corner.
+        vector<int64_t> Corners;
+        vector<TRun> Runs;
+        vector<string> Libraries;
+    };
+
+    void ParseFace(const char *p, const char *end, TChunk &chunk) {
+        thread_local vector<int64_t> polygon;
+        polygon.clear();
+        for (SkipSpaces(p, end); p < end; SkipSpaces(p, end)) {
+            int64_t position = ParseIndex(p, end, chunk.Positions.size() / 3);
+            int64_t uv = Missing;
+            int64_t normal = Missing;
+            if (p < end && *p == '/') {
+                ++p;
+                uv = ParseIndex(p, end, chunk.Uvs.size() / 2);
+                if (p < end && *p == '/') {
+                    ++p;
+                    normal = ParseIndex(p, end, chunk.Normals.size() / 3);
+                }
+            }
+            if (position == Missing) {
+                throw TGlBaseError("invalid file format");
+            }
+            polygon.insert(polygon.end(), {position, uv, normal});
+            while (p < end && !IsSpace(*p)) ++p;
+        }
+        for (size_t i = 6; i < polygon.size(); i += 3) {
+            chunk.Corners.insert(chunk.Corners.end(), polygon.begin(), polygon.begin() + 3);
+            chunk.Corners.insert(chunk.Corners.end(), polygon.begin() + i - 3, polygon.begin() + i + 3);
+        }
+    }
+
+    void ParseChunk(const char *p, const char *end, TChunk &chunk) {
+        while (p < end) {
+            auto newline = static_cast<const char *>(memchr(p, '\n', end - p));
+            const char *lineEnd = newline != nullptr ? newline : end;
+            SkipSpaces(p, lineEnd);
+            string_view line(p, lineEnd - p);
+            if (line.size() > 2 && line[0] == 'v' && IsSpace(line[1])) {
+                const char *s = p + 2;
+                for (int i = 0; i < 3; ++i) chunk.Positions.push_back(ParseFloat(s, lineEnd));
+            } else if (line.size() > 3 && line[0] == 'v' && line[1] == 't' && IsSpace(line[2])) {
+                const char *s = p + 3;
+                for (int i = 0; i < 2; ++i) chunk.Uvs.push_back(ParseFloat(s, lineEnd));
+            } else if (line.size() > 3 && line[0] == 'v' && line[1] == 'n' && IsSpace(line[2])) {
+                const char *s = p + 3;
+                for (int i = 0; i < 3; ++i) chunk.Normals.push_back(ParseFloat(s, lineEnd));
+            } else if (line.size() > 2 && line[0] == 'f' && IsSpace(line[1])) {
+                ParseFace(p + 2, lineEnd, chunk);
+            } else if (line.size() > 2 && (line[0] == 'o' || line[0] == 'g') && IsSpace(line[1])) {
+                chunk.Runs.push_back({string(Rest(p + 2, lineEnd)), nullopt, chunk.Corners.size()});
+            } else if (line.substr(0, 7) == "usemtl ") {
+                chunk.Runs.push_back({nullopt, string(Rest(p + 7, lineEnd)), chunk.Corners.size()});
+            } else if (line.substr(0, 7) == "mtllib ") {
+                chunk.Libraries.emplace_back(Rest(p + 7, lineEnd));
+            }
+            p = newline != nullptr ? newline + 1 : end;
+        }
+    }
+
+    struct TMtl {
+        map<EMaterialProp, pair<string, ETextureUsage>> Maps;
+        map<EMaterialProp, vec4> Colors;
+        optional<float> Shininess;
+    };
+
+    // A missing library only loses its materials, the meshes using them get the default one.
+    void ParseMtl(const string &path, map<string, TMtl> &materials) {
+        if (!std::filesystem::exists(path)) {
+            cerr << "skipping material library " << path << ": not found\n";
+            return;
+        }
+        TMappedFile file(path);
+        TMtl *current = nullptr;
+        for (const char *p = file.Begin(), *end = file.End(); p < end;) {
+            auto newline = static_cast<const char *>(memchr(p, '\n', end - p));
+            const char *lineEnd = newline != nullptr ? newline : end;
+            SkipSpaces(p, lineEnd);
+            const char *s = p;
+            while (s < lineEnd && !IsSpace(*s)) ++s;
+            string_view key(p, s - p);
+            if (key == "newmtl") {
+                current = &materials[string(Rest(s, lineEnd))];
+            } else if (current != nullptr) {
+                auto texture = [&](EMaterialProp prop, ETextureUsage usage) {
+                    // Options like -bm precede the file name, which is the last token.
+                    auto value = Rest(s, lineEnd);
+                    auto space = value.find_last_of(" \t");
+                    current->Maps[prop] = {string(space == string_view::npos ? value : value.substr(space + 1)), usage};
+                };
+                auto color = [&](EMaterialProp prop) {
+                    vec4 value(1.0f);
+                    for (int i = 0; i < 3; ++i) value[i] = ParseFloat(s, lineEnd);
+                    current->Colors[prop] = value;
+                };
+                if (key == "Kd") {
+                    color(EMaterialProp::Diffuse);
+                } else if (key == "Ks") {
+                    color(EMaterialProp::Specular);
+                } else if (key == "Ns") {
+                    current->Shininess = ParseFloat(s, lineEnd);
+                } else if (key == "map_Kd") {
+                    texture(EMaterialProp::Diffuse, ETextureUsage::SRgba);
+                } else if (key == "map_Ks") {
+                    texture(EMaterialProp::Specular, ETextureUsage::SRgba);
+                } else if (key == "map_Ns") {
+                    texture(EMaterialProp::Shininess, ETextureUsage::Rgba);
+                } else if (key == "map_Bump" || key == "map_bump" || key == "bump") {
+                    texture(EMaterialProp::Normal, ETextureUsage::Normals);
+                }
+            }
+            p = newline != nullptr ? newline + 1 : end;
+        }
+    }
+
+    // Same mapping as the assimp path: a texture wins over the constant of the same property.
+    TMaterialData MaterialData(const TMtl &mtl, const string &directory) {
+        TMaterialData data;
+        for (auto &[prop, map] : mtl.Maps) {
+            data.Textures.emplace_back(prop, TTextureBuilder().SetFile(directory + "/" + map.first).SetUsage(map.second));
+        }
+        for (auto &[prop, color] : mtl.Colors) {
+            if (mtl.Maps.count(prop) == 0) {
+                data.Builder.SetColor(prop, color);
+            }
+        }
+        if (mtl.Shininess && mtl.Maps.count(EMaterialProp::Shininess) == 0) {
+            data.Builder.SetConstant(EMaterialProp::Shininess, *mtl.Shininess);
+        }
+        return data;
+    }
+
+    struct TCorner {
+        int64_t Position, Uv, Normal;
+
+        bool operator==(const TCorner &other) const {
+            return Position == other.Position && Uv == other.Uv && Normal == other.Normal;
+        }
+    };
+
+    struct TCornerHash {
+        size_t operator()(const TCorner &corner) const {
+            uint64_t hash = static_cast<uint64_t>(corner.Position) * 0x9E3779B97F4A7C15ULL;
+            hash ^= static_cast<uint64_t>(corner.Uv) * 0xC2B2AE3D27D4EB4FULL;
+            hash ^= static_cast<uint64_t>(corner.Normal) * 0x165667B19E3779F9ULL;
+            return static_cast<size_t>(hash ^ (hash >> 31U));
+        }
+    };
+
+    int64_t Resolve(int64_t index, size_t prefix, size_t count) {
+        if (index == Missing) {
+            return Missing;
+        }
+        if (index >= Relative / 2) {
+            index = index - Relative + static_cast<int64_t>(prefix);
+        }
+        if (index < 0 || index >= static_cast<int64_t>(count)) {
+            throw TGlBaseError("invalid file format");
+        }
+        return index;
+    }
+
+    // Fills normals missing in the file with smooth face normals, then tangent and bitangent from uvs.
+    void TangentFrames(vector<GLfloat> &vertices, const vector<GLuint> &indexes, const vector<bool> &noNormal) {
+        size_t count = vertices.size() / VertexStride;
+        vector<vec3> normals(count), tangents(count), bitangents(count);
+        for (size_t i = 0; i < indexes.size(); i += 3) {
+            const GLfloat *v[3];
+            for (int k = 0; k < 3; ++k) v[k] = &vertices[indexes[i + k] * VertexStride];
+            vec3 e1 = vec3(v[1][0], v[1][1], v[1][2]) - vec3(v[0][0], v[0][1], v[0][2]);
+            vec3 e2 = vec3(v[2][0], v[2][1], v[2][2]) - vec3(v[0][0], v[0][1], v[0][2]);
+            vec2 d1 = vec2(v[1][6], v[1][7]) - vec2(v[0][6], v[0][7]);
+            vec2 d2 = vec2(v[2][6], v[2][7]) - vec2(v[0][6], v[0][7]);
+            vec3 normal = cross(e1, e2);
+            float det = d1.x * d2.y - d2.x * d1.y;
+            vec3 tangent{}, bitangent{};
+            if (det != 0) {
+                tangent = (e1 * d2.y - e2 * d1.y) / det;
+                bitangent = (e2 * d1.x - e1 * d2.x) / det;
+            }
+            for (int k = 0; k < 3; ++k) {
+                normals[indexes[i + k]] += normal;
+                tangents[indexes[i + k]] += tangent;
+                bitangents[indexes[i + k]] += bitangent;
+            }
+        }
+        for (size_t i = 0; i < count; ++i) {
+            GLfloat *v = &vertices[i * VertexStride];
+            if (noNormal[i] && length(normals[i]) > 0) {
+                vec3 n = normalize(normals[i]);
+                v[3] = n.x;
+                v[4] = n.y;
+                v[5] = n.z;
+            }
+            vec3 n(v[3], v[4], v[5]);
+            vec3 t = tangents[i] - n * dot(n, tangents[i]);
+            vec3 b = bitangents[i] - n * dot(n, bitangents[i]);
+            t = length(t) > 0 ? normalize(t) : vec3(1, 0, 0);
+            b = length(b) > 0 ? normalize(b) : vec3(0, 1, 0);
+            v[8] = t.x;
+            v[9] = t.y;
+            v[10] = t.z;
+            v[11] = b.x;
+            v[12] = b.y;
+            v[13] = b.z;
+        }
+    }
+}
+
+// Parses Wavefront OBJ without assimp: the file is mapped, split at line boundaries and parsed
+// in parallel, then triangles are grouped by object and material straight into vertex arrays.
+shared_ptr<Impl::TModelData> ImportObj(const string &path, const string &directory) {
+    using namespace NObj;
+    TMappedFile file(path);
+    size_t size = file.End() - file.Begin();
+    size_t workers = std::max<size_t>(1, std::min<size_t>(thread::hardware_concurrency(), size / ChunkSize));
+    vector<TChunk> chunks(workers);
+    vector<const char *> bounds{file.Begin()};
+    for (size_t i = 1; i < workers; ++i) {
+        const char *p = std::max(bounds.back(), file.Begin() + size * i / workers);
+        auto newline = static_cast<const char *>(memchr(p, '\n', file.End() - p));
+        bounds.push_back(newline != nullptr ? newline + 1 : file.End());
+    }
+    bounds.push_back(file.End());
+    vector<future<void>> parsers;
+    for (size_t i = 0; i < workers; ++i) {
+        parsers.push_back(async(launch::async, ParseChunk, bounds[i], bounds[i + 1], ref(chunks[i])));
+    }
+    for (auto &parser : parsers) {
+        parser.get();
+    }
+
+    vector<float> positions, uvs, normals;
+    vector<array<size_t, 3>> prefixes;
+    for (auto &chunk : chunks) {
+        prefixes.push_back({positions.size() / 3, uvs.size() / 2, normals.size() / 3});
+        positions.insert(positions.end(), chunk.Positions.begin(), chunk.Positions.end());
+        uvs.insert(uvs.end(), chunk.Uvs.begin(), chunk.Uvs.end());
+        normals.insert(normals.end(), chunk.Normals.begin(), chunk.Normals.end());
+    }
+
+    auto result = make_shared<Impl::TModelData>();
+    map<string, TMtl> library;
+    for (auto &chunk : chunks) {
+        for (auto &name : chunk.Libraries) {
+            ParseMtl(directory + "/" + name, library);
+        }
+    }
+    map<string, unsigned> materialIndex;
+    auto materialOf = [&](const string &name) {
+        auto found = materialIndex.find(name);
+        if (found != materialIndex.end()) {
+            return found->second;
+        }
+        auto index = static_cast<unsigned>(result->Materials.size());
+        auto mtl = library.find(name);
+        result->Materials.push_back(mtl != library.end() ? MaterialData(mtl->second, directory) : TMaterialData{});
+        materialIndex.emplace(name, index);
+        return index;
+    };
+
+    struct TBuild {
+        unordered_map<TCorner, GLuint, TCornerHash> Vertices;
+        vector<bool> NoNormal;
+        vector<GLuint> Indexes;
+    };
+    map<pair<string, string>, size_t> meshIndex;
+    vector<TBuild> builds;
+    string object, material;
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        auto &chunk = chunks[c];
+        auto &prefix = prefixes[c];
+        for (size_t r = 0; r <= chunk.Runs.size(); ++r) {
+            size_t begin = r == 0 ? 0 : chunk.Runs[r - 1].FirstCorner;
+            size_t end = r < chunk.Runs.size() ? chunk.Runs[r].FirstCorner : chunk.Corners.size();
+            if (r > 0) {
+                object = chunk.Runs[r - 1].Object.value_or(object);
+                material = chunk.Runs[r - 1].Material.value_or(material);
+            }
+            if (begin == end) continue;
+            auto key = make_pair(object, material);
+            auto found = meshIndex.find(key);
+            if (found == meshIndex.end()) {
+                found = meshIndex.emplace(key, builds.size()).first;
+                builds.emplace_back();
+                auto &data = result->Meshes.emplace_back();
+                data.Name = object;
+                data.Material = materialOf(material);
+            }
+            auto &build = builds[found->second];
+            auto &data = result->Meshes[found->second];
+            for (size_t i = begin; i < end; i += 3) {
+                TCorner corner{Resolve(chunk.Corners[i], prefix[0], positions.size() / 3),
+                               Resolve(chunk.Corners[i + 1], prefix[1], uvs.size() / 2),
+                               Resolve(chunk.Corners[i + 2], prefix[2], normals.size() / 3)};
+                auto[vertex, inserted] = build.Vertices.emplace(corner, static_cast<GLuint>(build.Vertices.size()));
+                if (inserted) {
+                    const float *p = &positions[corner.Position * 3];
+                    float u = corner.Uv == Missing ? 0.0f : uvs[corner.Uv * 2];
+                    float v = corner.Uv == Missing ? 0.0f : 1.0f - uvs[corner.Uv * 2 + 1];
+                    vec3 n = corner.Normal == Missing ? vec3(0) : vec3(normals[corner.Normal * 3],
+                                                                       normals[corner.Normal * 3 + 1],
+                                                                       normals[corner.Normal * 3 + 2]);
+                    data.Vertices.insert(data.Vertices.end(), {p[0], p[1], p[2], n.x, n.y, n.z, u, v,
+                                                               1, 0, 0, 0, 1, 0});
+                    build.NoNormal.push_back(corner.Normal == Missing);
+                }
+                build.Indexes.push_back(vertex->second);
+            }
+        }
+    }
+    DecodeTextures(result->Materials);
+    for (size_t i = 0; i < builds.size(); ++i) {
+        TangentFrames(result->Meshes[i].Vertices, builds[i].Indexes, builds[i].NoNormal);
+        FinishMesh(*result, result->Meshes[i], builds[i].Indexes);
+    }
+    return result;
+}
+
+shared_ptr<Impl::TModelData> ImportModel(const std::string &filename) {
 #ifdef __APPLE__
     std::array<char, PATH_MAX> real{};
     realpath(filename.c_str(), real.data());
@@ -75,28 +559,39 @@ TModel LoadModel(const std::string &filename) {
     auto directory = canonical.parent_path().string();
 #endif
 
+    auto extension = fullpath.substr(std::min(fullpath.size(), fullpath.rfind('.')));
+    transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return tolower(c); });
+    if (extension == ".obj") {
+        return ImportObj(fullpath, directory);
+    }
+    if (extension == ".glb") {
+        auto result = make_shared<Impl::TModelData>();
+        result->Gltf = ImportGlb(fullpath, directory);
+        return result;
+    }
+
     Assimp::Importer importer;
-    auto scene = importer.ReadFile(fullpath, aiProcess_Triangulate | aiProcess_FlipUVs);
+    auto scene = importer.ReadFile(fullpath, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
     if (!scene || !scene->mRootNode || scene->mFlags & static_cast<unsigned>(AI_SCENE_FLAGS_INCOMPLETE)) {
         throw TGlBaseError("Can't import scene");
     }
 
-    TModel model;
+    auto result = make_shared<Impl::TModelData>();
     for (unsigned i = 0; i < scene->mNumMaterials; i++) {
-        TMaterialBuilder builder;
+        auto &data = result->Materials.emplace_back();
         auto material = scene->mMaterials[i];
         LoadColorTexture(material, EMaterialProp::Diffuse, aiTextureType_DIFFUSE,
-                         AI_MATKEY_COLOR_DIFFUSE, ETextureUsage::SRgba, directory, builder);
+                         AI_MATKEY_COLOR_DIFFUSE, ETextureUsage::SRgba, directory, data);
         LoadColorTexture(material, EMaterialProp::Specular, aiTextureType_SPECULAR,
-                         AI_MATKEY_COLOR_SPECULAR, ETextureUsage::SRgba, directory, builder);
+                         AI_MATKEY_COLOR_SPECULAR, ETextureUsage::SRgba, directory, data);
         LoadConstantTexture(material, EMaterialProp::Shininess, aiTextureType_SHININESS,
-                            AI_MATKEY_SHININESS, directory, builder);
+                            AI_MATKEY_SHININESS, directory, data);
         LoadConstantTexture(material, EMaterialProp::Reflection, aiTextureType_REFLECTION,
-                            AI_MATKEY_REFLECTIVITY, directory, builder);
+                            AI_MATKEY_REFLECTIVITY, directory, data);
         LoadColorTexture(material, EMaterialProp::Normal, aiTextureType_HEIGHT,
-                         nullptr, 0, 0, ETextureUsage::Normals, directory, builder);
-        model.Material(builder);
+                         nullptr, 0, 0, ETextureUsage::Normals, directory, data);
     }
+    DecodeTextures(result->Materials);
 
     for (deque<aiNode *> nodes{scene->mRootNode}; !nodes.empty(); nodes.pop_back()) {
         auto node = nodes.back();
@@ -105,22 +600,111 @@ TModel LoadModel(const std::string &filename) {
         }
         for (unsigned i = 0; i < node->mNumMeshes; ++i) {
             auto mesh = scene->mMeshes[node->mMeshes[i]];
-            auto material = mesh->mMaterialIndex;
-            model.Mesh(mesh->mName.C_Str(), LoadMesh(mesh), material);
+            auto &data = result->Meshes.emplace_back();
+            data.Name = mesh->mName.C_Str();
+            data.Material = mesh->mMaterialIndex;
+            vector<GLuint> indexes;
+            LoadMesh(mesh, data.Vertices, indexes);
+            FinishMesh(*result, data, indexes);
+        }
+    }
+    return result;
+}
+
+// Files referenced by several materials are decoded once.
+void DecodeTextures(vector<TMaterialData> &materials) {
+    map<pair<string, ETextureUsage>, shared_ptr<const TTextureImage>> images;
+    for (auto &material : materials) {
+        for (auto &[prop, texture] : material.Textures) {
+            auto &image = images[make_pair(texture.File_, texture.Usage_)];
+            if (!image) {
+                image = DecodeTextureImage(texture.File_, texture.Usage_);
+            }
+            texture.SetImage(image);
+        }
+    }
+}
+
+TModel BuildModel(const Impl::TModelData &data, bool packed) {
+    TModel model;
+    if (data.Gltf) {
+        BuildGltfModel(*data.Gltf, model);
+        return model;
+    }
+    map<const TTextureImage *, TFlatTexture> textures;
+    for (auto &material : data.Materials) {
+        TMaterialBuilder builder = material.Builder;
+        for (auto &[prop, texture] : material.Textures) {
+            auto found = textures.find(texture.Image_.get());
+            if (found == textures.end()) {
+                found = textures.emplace(texture.Image_.get(), TFlatTexture(texture)).first;
+            }
+            builder.SetTexture(prop, found->second);
+        }
+        model.Material(builder);
+    }
+    TModelStats stats;
+    for (auto &mesh : data.Meshes) {
+        stats.LoadedVertices += mesh.LoadedVertices;
+        stats.WeldedVertices += mesh.Vertices.size() / VertexStride;
+    }
+    model.Imported(stats);
+    if (packed) {
+        AddPackedMeshes(model, data.Meshes);
+    } else {
+        for (auto &mesh : data.Meshes) {
+            AddMesh(model, mesh);
         }
     }
+    if (data.Low.x <= data.High.x) {
+        model.Bounds((data.Low + data.High) * 0.5f, glm::length(data.High - data.Low) * 0.5f);
+    }
     return model;
 }
 
-TMeshBuilder LoadMesh(aiMesh *mesh) {
-    vector<GLfloat> vertices(mesh->mNumVertices * 8);
-    vector<GLuint> indexes(mesh->mNumFaces * 3);
+TModel LoadModel(const std::string &filename, bool packed) {
+    return BuildModel(*ImportModel(filename), packed);
+}
+
+TAsyncModel LoadModelAsync(const std::string &filename,
+                           std::function<void(const TModel &)> onLoaded,
+                           TModel placeholder,
+                           bool packed) {
+    return TAsyncModel(std::async(std::launch::async, ImportModel, filename),
+                       std::move(placeholder), packed, std::move(onLoaded));
+}
+
+TAsyncModel::TAsyncModel(std::future<std::shared_ptr<Impl::TModelData>> pending,
+                         TModel placeholder,
+                         bool packed,
+                         std::function<void(const TModel &)> onLoaded)
+    : Pending(std::move(pending))
+      , Model(std::move(placeholder))
+      , Packed(packed)
+      , OnLoaded(std::move(onLoaded)) {
+}
+
+bool TAsyncModel::Update() {
+    if (Pending.valid() && Pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        Model = BuildModel(*Pending.get(), Packed);
+        if (OnLoaded) {
+            OnLoaded(Model);
+        }
+    }
+    return !Pending.valid();
+}
+
+void LoadMesh(aiMesh *mesh, vector<GLfloat> &vertices, vector<GLuint> &indexes) {
+    vertices.resize(mesh->mNumVertices * VertexStride);
+    indexes.resize(mesh->mNumFaces * 3);
 
     int vi = 0;
     for (unsigned j = 0; j < mesh->mNumVertices; j++) {
         auto vertex = mesh->mVertices[j];
         auto norm = mesh->mNormals[j];
         auto tex = mesh->mTextureCoords[0][j];
+        auto tangent = mesh->HasTangentsAndBitangents() ? mesh->mTangents[j] : aiVector3D{1, 0, 0};
+        auto bitangent = mesh->HasTangentsAndBitangents() ? mesh->mBitangents[j] : aiVector3D{0, 1, 0};
         vertices[vi++] = vertex.x;
         vertices[vi++] = vertex.y;
         vertices[vi++] = vertex.z;
@@ -129,6 +713,12 @@ TMeshBuilder LoadMesh(aiMesh *mesh) {
         vertices[vi++] = norm.z;
         vertices[vi++] = tex.x;
         vertices[vi++] = tex.y;
+        vertices[vi++] = tangent.x;
+        vertices[vi++] = tangent.y;
+        vertices[vi++] = tangent.z;
+        vertices[vi++] = bitangent.x;
+        vertices[vi++] = bitangent.y;
+        vertices[vi++] = bitangent.z;
     }
     int ii = 0;
     for (unsigned j = 0; j < mesh->mNumFaces; ++j) {
@@ -140,11 +730,75 @@ TMeshBuilder LoadMesh(aiMesh *mesh) {
             indexes[ii++] = face.mIndices[k];
         }
     }
-    return TMeshBuilder()
-        .SetVertices(EBufferUsage::Static, vertices)
-        .SetIndices(EBufferUsage::Static, indexes)
+}
+
+void MeshLods(TMeshData &mesh, const vector<GLuint> &indexes) {
+    mesh.Lods = BuildLods(mesh.Vertices, VertexStride, indexes, LodLevels);
+    for (auto &lod : mesh.Lods) {
+        mesh.Meshlets.push_back(BuildMeshlets(mesh.Vertices, VertexStride, lod));
+    }
+}
+
+TMeshBuilder &MeshLayout(TMeshBuilder &builder) {
+    return builder
         .AddLayout(EDataType::Float, 3)
         .AddLayout(EDataType::Float, 3)
-        .AddLayout(EDataType::Float, 2);
+        .AddLayout(EDataType::Float, 2)
+        .AddLayout(EDataType::Float, 3)
+        .AddLayout(EDataType::Float, 3);
+}
+
+void AddMesh(TModel &model, const TMeshData &mesh) {
+    auto vertexCount = static_cast<unsigned>(mesh.Vertices.size() / VertexStride);
+    TArrayBuffer buffer(EBufferUsage::Static, mesh.Vertices);
+    vector<TMeshBuilder> lods;
+    for (size_t i = 0; i < mesh.Lods.size(); ++i) {
+        auto &builder = lods.emplace_back();
+        builder.SetVertices(buffer, vertexCount)
+            .SetIndices(EBufferUsage::Static, mesh.Lods[i], vertexCount)
+            .SetMeshlets(mesh.Meshlets[i])
+            .SetBounds(mesh.Bounds);
+        MeshLayout(builder);
+    }
+    model.Mesh(mesh.Name, lods, static_cast<int>(mesh.Material));
 }
 
+// Indices stay relative to each mesh's base vertex, so the index type only has to
+// address the largest mesh rather than the whole model.
+void AddPackedMeshes(TModel &model, const vector<TMeshData> &meshes) {
+    if (meshes.empty()) {
+        return;
+    }
+    vector<GLfloat> vertices;
+    vector<GLuint> indexes;
+    unsigned maxVertexCount = 0;
+    for (auto &mesh : meshes) {
+        vertices.insert(vertices.end(), mesh.Vertices.begin(), mesh.Vertices.end());
+        maxVertexCount = std::max(maxVertexCount, static_cast<unsigned>(mesh.Vertices.size() / VertexStride));
+        for (auto &lod : mesh.Lods) {
+            indexes.insert(indexes.end(), lod.begin(), lod.end());
+        }
+    }
+    TMeshBuilder builder;
+    builder.SetVertices(EBufferUsage::Static, vertices)
+        .SetIndices(EBufferUsage::Static, indexes, maxVertexCount);
+    TMesh packed(MeshLayout(builder));
+
+    GLint baseVertex = 0;
+    unsigned indexOffset = 0;
+    for (auto &mesh : meshes) {
+        auto vertexCount = static_cast<unsigned>(mesh.Vertices.size() / VertexStride);
+        vector<TMesh> lods;
+        for (size_t i = 0; i < mesh.Lods.size(); ++i) {
+            auto indexCount = static_cast<unsigned>(mesh.Lods[i].size());
+            lods.emplace_back(packed, TMeshRangeBuilder()
+                .SetIndices(indexOffset, indexCount)
+                .SetVertices(baseVertex, vertexCount)
+                .SetMeshlets(mesh.Meshlets[i])
+                .SetBounds(mesh.Bounds));
+            indexOffset += indexCount;
+        }
+        baseVertex += static_cast<GLint>(vertexCount);
+        model.Mesh(mesh.Name, std::move(lods), static_cast<int>(mesh.Material));
+    }
+}
@@ -1,6 +1,41 @@
 #pragma once
 #include <string>
+#include <future>
+#include <functional>
 #include "model.h"
 
-TModel LoadModel(const std::string &filename);
+namespace Impl {
+    struct TModelData;
+}
 
+// Packed models keep all meshes and detail levels in one vertex and one index buffer.
+TModel LoadModel(const std::string &filename, bool packed = true);
+
+// Model imported on a worker thread: file parsing, detail levels, clusters and image decoding
+// happen there, GL objects are created by Update() on the GL thread. Until then the handle
+// draws the placeholder, an empty model unless another one is given.
+class TAsyncModel {
+private:
+    std::future<std::shared_ptr<Impl::TModelData>> Pending;
+    TModel Model;
+    bool Packed;
+    std::function<void(const TModel &)> OnLoaded;
+
+public:
+    TAsyncModel(std::future<std::shared_ptr<Impl::TModelData>> pending,
+                TModel placeholder,
+                bool packed,
+                std::function<void(const TModel &)> onLoaded);
+
+    // Uploads the model once import is done and calls the completion callback, returns true when loaded.
+    bool Update();
+
+    [[nodiscard]] bool IsLoaded() const { return !Pending.valid(); }
+    [[nodiscard]] const TModel &Get() const { return Model; }
+    operator const TModel &() const { return Model; }
+};
+
+TAsyncModel LoadModelAsync(const std::string &filename,
+                           std::function<void(const TModel &)> onLoaded = {},
+                           TModel placeholder = {},
+                           bool packed = true);
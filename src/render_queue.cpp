@@ -0,0 +1,78 @@
+#include "render_queue.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    constexpr unsigned ProgramBits = 7;
+    constexpr unsigned MaterialBits = 14;
+    constexpr unsigned MeshBits = 14;
+    constexpr unsigned DepthBits = 25;
+
+    // Maps float order to unsigned order, negative values included, and keeps the high bits.
+    uint64_t DepthKey(float depth) {
+        uint32_t bits;
+        std::memcpy(&bits, &depth, sizeof(bits));
+        bits = (bits & 0x80000000U) ? ~bits : bits | 0x80000000U;
+        return bits >> (32 - DepthBits);
+    }
+}
+
+uint64_t TRenderQueue::Id(const void *object, unsigned bits) {
+    // Ids only group equal state, a collision after wrapping costs a state change, not a
+    // wrong draw, since execution compares the objects themselves.
+    auto found = Ids.find(object);
+    if (found == Ids.end()) {
+        found = Ids.emplace(object, Ids.size()).first;
+    }
+    return found->second & ((uint64_t{1} << bits) - 1);
+}
+
+void TRenderQueue::Submit(ERenderPass pass, float depth, TDrawPacket packet) {
+    uint64_t state = Id(packet.Program, ProgramBits);
+    state = (state << MaterialBits) | Id(packet.Material, MaterialBits);
+    state = (state << MeshBits) | (packet.Mesh->GetVertexArrayObject() & ((1U << MeshBits) - 1));
+    uint64_t key = static_cast<uint64_t>(pass);
+    uint64_t depthKey = DepthKey(depth);
+    if (pass == ERenderPass::Translucent) {
+        depthKey = ~depthKey & ((uint64_t{1} << DepthBits) - 1);
+        key = (((key << DepthBits) | depthKey) << (ProgramBits + MaterialBits + MeshBits)) | state;
+    } else {
+        key = (((key << (ProgramBits + MaterialBits + MeshBits)) | state) << DepthBits) | depthKey;
+    }
+    packet.Key = key;
+    Packets.push_back(packet);
+}
+
+void TRenderQueue::Sort() {
+    std::stable_sort(Packets.begin(), Packets.end(), [](auto &l, auto &r) { return l.Key < r.Key; });
+}
+
+void TRenderQueue::Upload() {
+    Models.Resize(Packets.size());
+    for (size_t i = 0; i < Packets.size(); ++i) {
+        Models.Set(i, Packets[i].Model);
+    }
+    NBatchMath::NormalMatrices(Models, Normals);
+    for (size_t i = 0; i < Packets.size(); ++i) {
+        auto &packet = Packets[i];
+        TObjectRecord record{};
+        record.model = packet.Model;
+        for (int column = 0; column < 3; ++column) {
+            for (int row = 0; row < 3; ++row) {
+                record.norm[column][row] = Normals.M[column * 3 + row][i];
+            }
+        }
+        record.explosion = packet.Explosion;
+        record.opaque = packet.Blend;
+        record.faces = packet.Faces;
+        Objects.Push(record);
+    }
+    Objects.Upload();
+}
+
+void TRenderQueue::Clear() {
+    Packets.clear();
+    if (Ids.size() > (size_t{1} << MaterialBits)) {
+        Ids.clear();
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "mesh.h"
+#include "material.h"
+#include "shader_program.h"
+#include "uniform_buffer.h"
+#include "batch_math.h"
+#include <unordered_map>
+
+// Passes execute in this order when they share a queue.
+enum class ERenderPass : uint8_t {
+    Shadow,
+    Opaque,
+    Translucent,
+};
+
+// One mesh drawn with one material, recorded by a shader set and executed after sorting.
+struct TDrawPacket {
+    uint64_t Key{};
+    const TShaderProgram *Program{};
+    const TMaterial *Material{};
+    const TMesh *Mesh{};
+    glm::mat4 Model{};
+    float Explosion{};
+    // Shadow cube faces the mesh's bounds touch.
+    uint8_t Faces{};
+    bool Blend{};
+    bool Cull{};
+};
+
+// Per draw values in the std140 layout of the shaders' Object block.
+struct TObjectRecord {
+    glm::mat4 model;
+    // Columns of the mat3, padded to vec4 like std140 does.
+    glm::vec4 norm[3];
+    float explosion;
+    GLint opaque;
+    GLint faces;
+    float padding;
+};
+
+// Sort keys, most significant first. Opaque draws group by state and then go front to back
+// for early depth rejection, translucent ones go back to front before anything else:
+//   opaque:      pass:4 | program:7 | material:14 | vao:14 | depth:25
+//   translucent: pass:4 | ~depth:25 | program:7 | material:14 | vao:14
+class TRenderQueue {
+private:
+    std::vector<TDrawPacket> Packets;
+    std::unordered_map<const void *, uint64_t> Ids;
+    TUniformRing<TObjectRecord> Objects{4096};
+    TMat4Array Models;
+    TMat3Array Normals;
+
+    uint64_t Id(const void *object, unsigned bits);
+
+public:
+    // Depth only has to grow away from the viewer, it may be negative.
+    void Submit(ERenderPass pass, float depth, TDrawPacket packet);
+    void Sort();
+    // Streams the per draw values of all packets to the GPU at once, call after Sort. Normal
+    // matrices are derived from the model matrices here, in one batch.
+    void Upload();
+    // Starts the frame's region of per draw values, call once per frame before any Flush.
+    void NextFrame() { Objects.NextFrame(); }
+    // Binds the packet's values to the Object block.
+    void Select(size_t packet) const { Objects.Select(packet); }
+    void Clear();
+
+    [[nodiscard]] const std::vector<TDrawPacket> &GetPackets() const { return Packets; }
+    [[nodiscard]] const TUniformBindingBase &GetObjects() const { return Objects; }
+};
@@ -1,6 +1,7 @@
 #include "errors.h"
 #include "scene.h"
 #include "framebuffer.h"
+#include "gl_state.h"
 #include <glm/glm.hpp>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/ext/matrix_clip_space.hpp>
@@ -9,52 +10,110 @@ using namespace std;
 using namespace glm;
 
 void TScene::Draw(mat4 project, mat4 view, vec3 position, float interval, bool useMap) {
+    Connector.NextFrame();
+    Queue.NextFrame();
+    Suit.Update();
+    Drop.Update();
     ExplosionTime = ExplosionTime >= 15 ? 0 : ExplosionTime + interval;
-    SetupLights(position, interval);
+    SetupLights(project * view, position, interval);
     UpdateFountain(interval);
 
-    mat4 lightMatrix = ortho(-70.0f, 70.0f, -70.0f, 70.0f, 0.01f, 150.0f) *
-        lookAt(-normalize(Directional) * 60.0f, vec3(0, 0, 0), vec3(0, 1, 0));
-    glm::mat4 proj = perspective(glm::radians(90.0f), 1.0f, 0.02f, 100.0f);
+    Cascades.Fit(project, view, Directional);
+    if (ShadowFilter != EShadowFilter::Pcf && !Moments) {
+        Moments = CreateShadowMoments();
+    }
+    bool moments = ShadowFilter != EShadowFilter::Pcf;
+    auto farMoments = FarMoments(ShadowFilter);
 
-    glCullFace(GL_FRONT);
+    // Moments are written and blurred as they are.
+    auto &state = TGlState::Get();
+    state.SetEnabled(GL_BLEND, false);
+    state.SetCullFace(GL_FRONT);
     {
-        TFrameBufferBinder binder(GlobalLightShadow);
-        DrawScene(TShadowShaderSet(&ShadowShader, lightMatrix, position));
+        auto &staticShadow = moments ? Moments->Static : StaticLightShadow;
+        auto &globalShadow = moments ? Moments->Global : GlobalLightShadow;
+        TCullStats staticStats;
+        bool staticDrawn = false;
+        for (int i = 0; i < Cascades.GetCount(); ++i) {
+            auto &cascade = Cascades.Get(i);
+            if (StaticShadowMatrices[i] != cascade.Matrix) {
+                TFrameBufferBinder binder(staticShadow, cascade.Viewport, false);
+                binder.Clear(farMoments);
+                staticStats += DrawScene(CascadeShadowSet(cascade, position, EMobility::Static));
+                StaticShadowMatrices[i] = cascade.Matrix;
+                staticDrawn = true;
+            }
+        }
+        if (staticDrawn) {
+            CullStats[static_cast<size_t>(EScenePass::StaticShadow)] = staticStats;
+        }
+        staticShadow.CopyTo(globalShadow);
+        TCullStats dynamicStats;
+        for (int i = 0; i < Cascades.GetCount(); ++i) {
+            auto &cascade = Cascades.Get(i);
+            TFrameBufferBinder binder(globalShadow, cascade.Viewport, false);
+            dynamicStats += DrawScene(CascadeShadowSet(cascade, position, EMobility::Dynamic));
+        }
+        CullStats[static_cast<size_t>(EScenePass::DirectionalShadow)] = dynamicStats;
     }
     {
-        std::array<glm::mat4, 6> spotMatrices;
-        spotMatrices[0] = proj * lookAt(Spots[0].first, Spots[0].first + vec3(1, 0, 0), vec3(0, -1, 0));
-        spotMatrices[1] = proj * lookAt(Spots[0].first, Spots[0].first + vec3(-1, 0, 0), vec3(0, -1, 0));
-        spotMatrices[2] = proj * lookAt(Spots[0].first, Spots[0].first + vec3(0, 1, 0), vec3(0, 0, 1));
-        spotMatrices[3] = proj * lookAt(Spots[0].first, Spots[0].first + vec3(0, -1, 0), vec3(0, 0, -1));
-        spotMatrices[4] = proj * lookAt(Spots[0].first, Spots[0].first + vec3(0, 0, 1), vec3(0, -1, 0));
-        spotMatrices[5] = proj * lookAt(Spots[0].first, Spots[0].first + vec3(0, 0, -1), vec3(0, -1, 0));
-        TFrameBufferBinder binder(SpotLightShadow);
-        DrawScene(TShadowShaderSet(&ShadowShader, spotMatrices, Spots[0].first, position));
+        // Only the scheduled faces are cleared, the others keep their shadows.
+        TFrameBufferBinder binder(moments ? Moments->Spot : SpotLightShadow, false);
+        std::array<EScenePass, 2> passes{EScenePass::SpotShadow, EScenePass::SpotShadow2};
+        for (size_t i = 0; i < Spots.size(); ++i) {
+            unsigned faces = ShadowScheduler.GetFaces(i);
+            if (faces == 0) {
+                CullStats[static_cast<size_t>(passes[i])] = {};
+                continue;
+            }
+            // The scheduler works in cube faces, hemispheres are redrawn when any face within is.
+            bool paraboloid = ShadowAtlas.GetMode() == EOmniShadow::DualParaboloid;
+            unsigned tiles = paraboloid ? ParaboloidFaces(faces) : faces;
+            for (size_t face = 0; face < ShadowAtlas.GetTiles(); ++face) {
+                if (tiles & (1U << face)) {
+                    binder.ClearRegion(ShadowAtlas.GetViewport(i, face), farMoments);
+                }
+            }
+            vec3 origin = ShadowScheduler.GetOrigin(i);
+            std::array<mat4, 6> spotMatrices{};
+            std::optional<TClusterCuller> culler;
+            if (paraboloid) {
+                auto views = ParaboloidViews(origin);
+                std::copy(views.begin(), views.end(), spotMatrices.begin());
+                culler.emplace(ParaboloidFrusta(origin), origin, true);
+            } else {
+                spotMatrices = CubeFaceMatrices(SpotProjection, origin);
+                culler.emplace(spotMatrices, origin, true);
+            }
+            // A hemisphere tile has about the texel density of a cube face half its size.
+            TLodSelector lod(SpotProjection, origin, ShadowAtlas.GetResolution(i) / (paraboloid ? 2 : 1),
+                             ShadowLodBias);
+            ShadowScheduler.BeginUpdate(i);
+            CullStats[static_cast<size_t>(passes[i])] = DrawScene(
+                TShadowShaderSet(&Queue, &ShadowShader, ShadowFilter, ShadowAtlas.GetMode(), spotMatrices,
+                                 ShadowAtlas.GetRects(i), origin, ShadowScheduler.GetRange(i), tiles, position, lod,
+                                 std::move(*culler)));
+            ShadowScheduler.EndUpdate(i);
+        }
     }
-    {
-        std::array<glm::mat4, 6> spotMatrices;
-        spotMatrices[0] = proj * lookAt(Spots[1].first, Spots[1].first + vec3(1, 0, 0), vec3(0, -1, 0));
-        spotMatrices[1] = proj * lookAt(Spots[1].first, Spots[1].first + vec3(-1, 0, 0), vec3(0, -1, 0));
-        spotMatrices[2] = proj * lookAt(Spots[1].first, Spots[1].first + vec3(0, 1, 0), vec3(0, 0, 1));
-        spotMatrices[3] = proj * lookAt(Spots[1].first, Spots[1].first + vec3(0, -1, 0), vec3(0, 0, -1));
-        spotMatrices[4] = proj * lookAt(Spots[1].first, Spots[1].first + vec3(0, 0, 1), vec3(0, -1, 0));
-        spotMatrices[5] = proj * lookAt(Spots[1].first, Spots[1].first + vec3(0, 0, -1), vec3(0, -1, 0));
-        TFrameBufferBinder binder(SpotLightShadow2);
-        DrawScene(TShadowShaderSet(&ShadowShader, spotMatrices, Spots[1].first, position));
-    }
-    glCullFace(GL_BACK);
+    state.SetCullFace(GL_BACK);
+    if (moments) {
+        BlurShadowMoments();
+    }
+    state.SetEnabled(GL_BLEND, true);
     {
         TFrameBufferBinder binder(AliasedFrameBuffer);
         ProjectionView = {project, view};
         DrawSkybox();
         DrawLightCubes();
-        DrawScene(TSceneShaderSet{&SceneShader, &ParticlesShader, SkyTex,
-                                  std::get<TFlatTexture>(GlobalLightShadow.GetDepth()),
-                                  std::get<TCubeTexture>(SpotLightShadow.GetDepth()),
-                                  std::get<TCubeTexture>(SpotLightShadow2.GetDepth()),
-                                  lightMatrix, position, true});
+        CullStats[static_cast<size_t>(EScenePass::Camera)] = DrawScene(
+            TSceneShaderSet{&Queue, &SceneShader, &ExplodeShader, &ParticlesShader, SkyTex,
+                            std::get<TFlatTexture>(moments ? Moments->Global.GetScreen() : GlobalLightShadow.GetDepth()),
+                            std::get<TFlatTexture>(moments ? Moments->Spot.GetScreen() : SpotLightShadow.GetDepth()),
+                            &SpotShadows,
+                            ShadowFilter, &Cascades, position, true,
+                            TLodSelector(project, position, ScreenHeight),
+                            TClusterCuller(project * view, position)});
     }
     AliasedFrameBuffer.CopyTo(FrameBuffer);
     {
@@ -81,14 +140,26 @@ void TScene::Draw(mat4 project, mat4 view, vec3 position, float interval, bool u
             .SetDepth(std::get<TFlatTexture>(FrameBuffer.GetDepth()))
             .SetBloom(std::get<TFlatTexture>(BloomBuffers[1].GetScreen()))
             .SetExposure(0.9);
-        glDepthFunc(GL_LEQUAL);
+        state.SetDepthFunc(GL_LEQUAL);
         ScreenQuad.Draw();
-        glDepthFunc(GL_LESS);
+        state.SetDepthFunc(GL_LESS);
     }
     DrawBorder();
 }
 
-void TScene::SetupLights(glm::vec3 position, float interval) {
+std::vector<TMesh> TScene::CreatePoints() {
+    std::vector<TMesh> points;
+    for (size_t lod = 0; lod < Drop.Get().LodCount(0); ++lod) {
+        points.emplace_back(Drop.Get().GetMesh(0, lod),
+                            TInstanceMeshBuilder()
+                                .SetInstances(ParticleInstances, 6 * Particles.size())
+                                .AddLayout(EDataType::Float, 3, 1)
+                                .AddLayout(EDataType::Float, 3, 1));
+    }
+    return points;
+}
+
+void TScene::SetupLights(const glm::mat4 &viewProjection, glm::vec3 position, float interval) {
     SpotAngle += interval;
     float radius = 5;
     Spots[0] = std::make_pair(glm::vec3{-4.0f + sin(SpotAngle) * radius, 13.0f, -6.0f + cos(SpotAngle) * radius},
@@ -107,8 +178,36 @@ void TScene::SetupLights(glm::vec3 position, float interval) {
                            0.3f * spot.second,
                            spot.second,
                            0.00, 0.005};
+        SpotRanges[k - 1] = std::min(lights.spots[k].Range(), SpotShadowFar);
+        ShadowScheduler.SetLight(k - 1, spot.first, SpotRanges[k - 1]);
+        ShadowAtlas.SetLight(k - 1, spot.first, SpotRanges[k - 1]);
         k++;
     }
+    // Lights whose tiles moved lost their shadows.
+    ShadowAtlas.Pack(viewProjection);
+    SpotShadows.Paraboloid = ShadowAtlas.GetMode() == EOmniShadow::DualParaboloid;
+    if (SpotShadows.Paraboloid) {
+        auto views = ParaboloidViews(vec3(0));
+        SpotShadows.Faces = {};
+        std::copy(views.begin(), views.end(), SpotShadows.Faces.begin());
+    } else {
+        SpotShadows.Faces = CubeFaceMatrices(SpotProjection, vec3(0));
+    }
+    SpotShadows.Rects = {};
+    for (size_t i = 0; i < Spots.size(); ++i) {
+        if (ShadowAtlas.Moved(i)) {
+            ShadowScheduler.Invalidate(i);
+        }
+        auto &rects = ShadowAtlas.GetRects(i);
+        std::copy(rects.begin(), rects.end(), SpotShadows.Rects.begin() + 6 * (i + 1));
+    }
+    auto &suit = Suit.Get();
+    ShadowScheduler.AddDynamicCaster({suit.GetCenter(), vec3(suit.GetRadius()), suit.GetRadius()}, SuitModel);
+    ShadowScheduler.Schedule(viewProjection, position);
+    pos.shadowOrigins[0] = pos.spots[0];
+    for (size_t i = 0; i < Spots.size(); ++i) {
+        pos.shadowOrigins[i + 1] = vec4(ShadowScheduler.GetOrigin(i), 1.0);
+    }
     lights.spotCount = k;
     LightSetup = lights;
     LightsPos = pos;
@@ -116,19 +215,67 @@ void TScene::SetupLights(glm::vec3 position, float interval) {
     GL_ASSERT(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT));
 }
 
-void TScene::DrawScene(IShaderSet &&set) {
+TScene::TShadowMoments TScene::CreateShadowMoments() const {
+    auto flat = [](glm::ivec2 size) {
+        return TFlatTexture(TTextureBuilder()
+                                .SetEmpty(size.x, size.y)
+                                .SetWrap(ETextureWrap::ClampToEdge)
+                                .SetUsage(ETextureUsage::FloatRgba));
+    };
+    auto atlas = Cascades.GetAtlasSize();
+    auto global = flat(atlas);
+    return {
+        TFrameBuffer(global, GlobalLightShadow.GetDepth()),
+        TFrameBuffer(flat(atlas), StaticLightShadow.GetDepth()),
+        TFrameBuffer(flat(glm::ivec2(ShadowAtlas.GetSize())), SpotLightShadow.GetDepth()),
+        TFrameBuffer(flat(atlas), false),
+        TFrameBuffer(global, false)};
+}
+
+// The whole atlas is blurred at once, taps near the tile borders read the neighbouring tile.
+void TScene::BlurShadowMoments() {
+    {
+        TFrameBufferBinder binder(Moments->Blur);
+        auto setup = TBlurSetup(&BlurShader)
+            .SetScreen(std::get<TFlatTexture>(Moments->Global.GetScreen()))
+            .SetVertical(false)
+            .SetSigma(ShadowBlurSigma)
+            .SetAllChannels(true);
+        ScreenQuad.Draw();
+    }
+    {
+        TFrameBufferBinder binder(Moments->Blurred);
+        auto setup = TBlurSetup(&BlurShader)
+            .SetScreen(std::get<TFlatTexture>(Moments->Blur.GetScreen()))
+            .SetVertical(true)
+            .SetSigma(ShadowBlurSigma)
+            .SetAllChannels(true);
+        ScreenQuad.Draw();
+    }
+}
+
+TCullStats TScene::DrawScene(IShaderSet &&set) {
     DrawFountain(set);
     DrawObjects(set);
     DrawOpaques(set);
+    set.Flush();
+    return set.GetCullStats();
+}
+
+TShadowShaderSet TScene::CascadeShadowSet(const TCascade &cascade, vec3 position, EMobility casters) {
+    TLodSelector lod(cascade.Projection, position, Cascades.GetResolution(), ShadowLodBias);
+    return {&Queue, &ShadowShader, ShadowFilter, cascade.Matrix, position, lod,
+            TClusterCuller::Orthographic(cascade.Matrix, Directional, true), casters};
 }
 
 void TScene::DrawSkybox() {
-    glDepthMask(GL_FALSE);
-    glDepthFunc(GL_LEQUAL);
+    auto &state = TGlState::Get();
+    state.SetDepthMask(false);
+    state.SetDepthFunc(GL_LEQUAL);
     auto setup = TSkyBoxSetup(&SkyboxShader).SetSkyBox(SkyTex);
     Sky.Draw();
-    glDepthFunc(GL_LESS);
-    glDepthMask(GL_TRUE);
+    state.SetDepthFunc(GL_LESS);
+    state.SetDepthMask(true);
 }
 
 void TScene::UpdateFountain(float interval) {
@@ -147,11 +294,17 @@ void TScene::UpdateFountain(float interval) {
             Particles[i] = make_pair(pos + speed * interval, speed);
         }
     }
-    Points.GetInstances().Write(Particles.data(), 0, Particles.size() * 6 * sizeof(float));
+    ParticleInstances.Write(Particles.data(), 0, Particles.size() * 6 * sizeof(float));
 }
 
 void TScene::DrawFountain(IShaderSet &set) {
-    set.Particles(NConstMath::Translate(0, 10, 0), NConstMath::Scale(.5), Points);
+    if (Points.empty()) {
+        return;
+    }
+    mat4 model = NConstMath::Translate(0, 10, 0);
+    mat4 single = NConstMath::Scale(.5);
+    auto lod = std::min(Drop.Get().SelectLod(model * single, set.GetLodSelector()), Points.size() - 1);
+    set.Particles(model, single, Points[lod]);
 }
 
 mat4 Place(vec3 position, vec3 axis, float angle, vec3 s) {
@@ -160,31 +313,28 @@ mat4 Place(vec3 position, vec3 axis, float angle, vec3 s) {
 
 void TScene::DrawObjects(IShaderSet &set) {
     set.Scene(scale(NConstMath::Translate(0.0f, -100.0f, 0.0f), vec3(200.0f)),
-              false, 0, Asphalt, GroundCube);
+              false, 0, EMobility::Static, Asphalt, GroundCube);
 
     set.Scene(Place(vec3(6, 7.0, 44.0), vec3(.2, .4, -.1), 30.0f, vec3(10.0f)),
-              false, 0, Container, SimpleCube);
+              false, 0, EMobility::Static, Container, SimpleCube);
     float explosion = ExplosionTime <= 14 ? 0.0f : static_cast<float>(std::sin((ExplosionTime - 14.0f) * M_PI) * 20.0f);
-    set.Scene(NConstMath::Translate(0, 0, -15), false, explosion, Suit);
+    set.Scene(SuitModel, false, explosion, EMobility::Dynamic, Suit);
 }
 
 void TScene::DrawOpaques(IShaderSet &set) {
-    std::map<float, OpaqueType> objs{};
-    for (auto obj : OpaqueObjects) {
-        objs.emplace(-glm::length(get<0>(obj) - set.GetPosition()), obj);
-    }
-    for (auto obj : objs) {
+    // The queue orders blended draws back to front.
+    for (auto &obj : OpaqueObjects) {
         // todo: don't divide to position and matrix
-        auto&[position, matrix, material, mesh] = obj.second;
-        set.Scene(NConstMath::Translate(position) * matrix, true, 0, material, mesh);
+        auto&[position, matrix, material, mesh] = obj;
+        set.Scene(NConstMath::Translate(position) * matrix, true, 0, EMobility::Static, material, mesh);
     }
 }
 
 void TScene::DrawBorder() {
     {
-        auto setup = TSilhouetteSetup(&SilhouetteShader).SetModel(NConstMath::Translate(0, 0, -15));
+        auto setup = TSilhouetteSetup(&SilhouetteShader).SetModel(SuitModel);
         TFrameBufferBinder binder(AliasedFrameBuffer);
-        Suit.Draw(setup);
+        Suit.Get().Draw(setup);
     }
     AliasedFrameBuffer.CopyTo(FrameBuffer);
     {
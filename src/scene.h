@@ -10,23 +10,43 @@
 #include "shaders/blur.h"
 #include "shaders/depth.h"
 #include "shaders/hdr.h"
-#include "cube.h"
+#include "geometry_pool.h"
 #include "framebuffer.h"
 #include "scene_setup.h"
 #include "shader_set.h"
+#include "cascades.h"
+#include "shadow_scheduler.h"
+#include "shadow_atlas.h"
 #include <glm/glm.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <optional>
 #include <random>
 #include <utility>
 
+// Views the scene is drawn into every frame, in drawing order.
+enum class EScenePass {
+    // Only drawn for cascades whose cached static shadow is out of date. Both directional
+    // passes sum up all cascades.
+    StaticShadow,
+    DirectionalShadow,
+    // One pass per shadowed spot light, all of them draw into the spot shadow atlas.
+    SpotShadow,
+    SpotShadow2,
+    Camera,
+    Count,
+};
+
 class TScene {
 private:
     TUniformBinding<TProjectionView> ProjectionView;
     TUniformBinding<TLights> LightSetup;
     TUniformBinding<TLightsPos> LightsPos;
-    TUniformBuffer Connector{&ProjectionView, &LightSetup, &LightsPos};
-    TSceneShader SceneShader{ProjectionView, LightSetup, LightsPos};
+    TUniformBuffer Connector{{&ProjectionView, &LightSetup, &LightsPos}, EUniformUpdate::Streaming};
+    TRenderQueue Queue;
+    TSceneShader SceneShader{ProjectionView, LightSetup, LightsPos, Queue.GetObjects()};
+    TSceneShader ExplodeShader{ProjectionView, LightSetup, LightsPos, Queue.GetObjects(), true};
     TLightShader LightShader{ProjectionView};
-    TShadowShader ShadowShader{};
+    TShadowShader ShadowShader{Queue.GetObjects()};
     TDepthShader DepthShader{};
     THdrShader HdrShader{};
     TBlurShader BlurShader{};
@@ -88,11 +108,9 @@ private:
                             .SetFile("images/container2_specular2.png"))
             .SetConstant(EMaterialProp::Reflection, .01)
             .SetConstant(EMaterialProp::Shininess, 64)};
-    TMesh Sky{
-        TMeshBuilder()
-            .SetVertices(EBufferUsage::Static, Cube<false, false>(
-                TGeomBuilder().SetSize(1).SetBackward(true)))
-            .AddLayout(EDataType::Float, 3)};
+    TGeometryPool Geometry;
+    std::array<TCullStats, static_cast<size_t>(EScenePass::Count)> CullStats;
+    TMesh Sky{Geometry.Cube<false, false>(TGeomBuilder().SetSize(1).SetBackward(true))};
     TMaterial
         Grass{TMaterialBuilder().SetTexture(EMaterialProp::Diffuse,
                                             TTextureBuilder()
@@ -103,44 +121,22 @@ private:
                                              TTextureBuilder()
                                                  .SetUsage(ETextureUsage::SRgba)
                                                  .SetFile("images/window.png"))};
-    TMesh GroundCube{
-        TMeshBuilder()
-            .SetVertices(EBufferUsage::Static, Cube<true, true>(TGeomBuilder().SetTextureMul(10, 10)))
-            .AddLayout(EDataType::Float, 3)
-            .AddLayout(EDataType::Float, 3)
-            .AddLayout(EDataType::Float, 2)};
-    TMesh SimpleCube{
-        TMeshBuilder()
-            .SetVertices(EBufferUsage::Static, Cube<true, true>())
-            .AddLayout(EDataType::Float, 3)
-            .AddLayout(EDataType::Float, 3)
-            .AddLayout(EDataType::Float, 2)};
-
-    TMesh QuadPoly{
-        TMeshBuilder()
-            .SetVertices(EBufferUsage::Static, DoubleQuad())
-            .AddLayout(EDataType::Float, 3)
-            .AddLayout(EDataType::Float, 3)
-            .AddLayout(EDataType::Float, 2)};
-
-    TMesh ScreenQuad{
-        TMeshBuilder()
-            .SetVertices(EBufferUsage::Static, Quad<false, true>(
-                TGeomBuilder()
-                    .SetTextureMul(1, -1)
-                    .SetTextureOffset(0, 1)
-                    .SetSize(1.0f)))
-            .AddLayout(EDataType::Float, 3)
-            .AddLayout(EDataType::Float, 2)};
-
-    TModel Suit{LoadModel("nanosuit/nanosuit.obj")};
-    TModel Drop{LoadModel("images/drop.obj")};
-    TMesh Points{Drop.GetMesh(0),
-                 TInstanceMeshBuilder()
-                     .SetInstances(TArrayBuffer(EBufferUsage::Stream, nullptr, sizeof(float) * 6 * Particles.size()),
-                                   6 * Particles.size())
-                     .AddLayout(EDataType::Float, 3, 1)
-                     .AddLayout(EDataType::Float, 3, 1)};
+    // Split so dual paraboloid shadows of the large faces stay close to straight.
+    TMesh GroundCube{Geometry.Cube<true, true, true>(TGeomBuilder().SetTextureMul(10, 10).SetSegments(16))};
+    TMesh SimpleCube{Geometry.Cube<true, true, true>()};
+
+    TMesh QuadPoly{Geometry.DoubleQuad<true, true, true>()};
+
+    TMesh ScreenQuad{Geometry.Quad<false, true>(
+        TGeomBuilder()
+            .SetTextureMul(1, -1)
+            .SetTextureOffset(0, 1)
+            .SetSize(1.0f))};
+
+    TArrayBuffer ParticleInstances{EBufferUsage::Stream, nullptr, sizeof(float) * 6 * Particles.size()};
+    std::vector<TMesh> Points;
+    TAsyncModel Suit{LoadModelAsync("nanosuit/nanosuit.obj")};
+    TAsyncModel Drop{LoadModelAsync("images/drop.obj", [this](const TModel &) { Points = CreatePoints(); })};
 
     glm::vec3 Directional{0.6f, -1.0f, 1.0f};
     float SpotAngle = 0;
@@ -156,36 +152,78 @@ private:
         std::forward_as_tuple(glm::vec3(-48, 5, 44), NConstMath::RotateY4(40) * NConstMath::Scale(10), Window, QuadPoly)
     };
 
+    // Shadow maps are sampled with filtering, so they can use coarser meshes than the camera.
+    static constexpr int ShadowLodBias = 1;
+    // Far plane of the spot shadow cube maps, shadow.frag divides distances by it.
+    static constexpr float SpotShadowFar = 100.0f;
+    // Distance casters have to be within to shadow anything a spot light reaches.
+    std::array<float, 2> SpotRanges{};
+    glm::mat4 SpotProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.02f, SpotShadowFar);
+    // Spot shadow faces are redrawn when their light moves or a dynamic caster passes them,
+    // within a GPU budget per frame.
+    TShadowScheduler ShadowScheduler{
+        TShadowSchedulerBuilder()
+            .SetLights(2)
+            .SetProjection(SpotProjection)
+            .SetBudget(1.0f)};
+    // Tiles of the spot shadow faces, sized by how large the lights are on screen.
+    TShadowAtlas ShadowAtlas{TShadowAtlasBuilder().SetLights(2)};
+    // The atlas layout as the scene shader reads it.
+    TSpotShadows SpotShadows;
+    glm::mat4 SuitModel = NConstMath::Translate(0, 0, -15);
+    int ScreenHeight;
     TFrameBuffer FrameBuffer;
     std::array<TFrameBuffer, 2> BloomBuffers;
     TFrameBuffer AliasedFrameBuffer;
+    TShadowCascades Cascades{TCascadeBuilder()};
+    // Atlas of the directional shadow cascades.
     TFrameBuffer GlobalLightShadow{
         false,
         TTextureBuilder()
-            .SetEmpty(4096, 4096)
+            .SetEmpty(Cascades.GetAtlasSize().x, Cascades.GetAtlasSize().y)
             .SetMagLinear(false)
             .SetMinLinear(false)
             .SetWrap(ETextureWrap::ClampToBorder)
             .SetBorderColor(glm::vec4(1))
             .SetUsage(ETextureUsage::Depth)};
-    TFrameBuffer SpotLightShadow{
+    // Static casters only, copied into GlobalLightShadow every frame before dynamic casters.
+    TFrameBuffer StaticLightShadow{
         false,
-        TCubeTextureBuilder()
-            .SetEmpty(512, 512, 512)
+        TTextureBuilder()
+            .SetEmpty(Cascades.GetAtlasSize().x, Cascades.GetAtlasSize().y)
             .SetMagLinear(false)
             .SetMinLinear(false)
             .SetUsage(ETextureUsage::Depth)};
-    TFrameBuffer SpotLightShadow2{
+    // Matrix each cascade of StaticLightShadow was drawn with. It only changes with the light
+    // direction or when the cascade's region moves, and a cascade is drawn again when it does.
+    std::array<std::optional<glm::mat4>, TShadowCascades::MaxCascades> StaticShadowMatrices;
+    // Atlas of the spot shadow cube faces.
+    TFrameBuffer SpotLightShadow{
         false,
-        TCubeTextureBuilder()
-            .SetEmpty(512, 512, 512)
+        TTextureBuilder()
+            .SetEmpty(ShadowAtlas.GetSize(), ShadowAtlas.GetSize())
             .SetMagLinear(false)
             .SetMinLinear(false)
             .SetUsage(ETextureUsage::Depth)};
+    EShadowFilter ShadowFilter = EShadowFilter::Pcf;
+    // Blur of the directional moment atlas, scene.frag keeps lookups off the tile borders it mixes.
+    static constexpr float ShadowBlurSigma = 1.0f;
+    // Moment maps of the prefiltered filters, created when one is first selected. They draw
+    // into the depth buffers of the maps above.
+    struct TShadowMoments {
+        TFrameBuffer Global;
+        TFrameBuffer Static;
+        TFrameBuffer Spot;
+        // Color only targets of the separable blur, the second one writes back into Global.
+        TFrameBuffer Blur;
+        TFrameBuffer Blurred;
+    };
+    std::optional<TShadowMoments> Moments;
 
 public:
     TScene(int width, int height)
-        : FrameBuffer(
+        : ScreenHeight(height)
+        , FrameBuffer(
             TTextureBuilder().SetEmpty(width, height).SetWrap(ETextureWrap::ClampToEdge).SetUsage(ETextureUsage::FloatRgba),
             TTextureBuilder().SetEmpty(width, height).SetWrap(ETextureWrap::ClampToEdge).SetUsage(ETextureUsage::Depth))
         , BloomBuffers{
@@ -202,9 +240,49 @@ public:
 
     void Draw(glm::mat4 project, glm::mat4 view, glm::vec3 position, float interval, bool useMap);
 
+    // Static objects were added, moved or removed.
+    void InvalidateStaticShadow() {
+        StaticShadowMatrices.fill(std::nullopt);
+        ShadowScheduler.Invalidate();
+    }
+
+    // Static shadows are drawn again with the new filter.
+    void SetShadowFilter(EShadowFilter filter) {
+        ShadowFilter = filter;
+        InvalidateStaticShadow();
+    }
+
+    [[nodiscard]] EShadowFilter GetShadowFilter() const { return ShadowFilter; }
+
+    // Spot shadows are drawn again in the new layout once the next frame packs the atlas.
+    void SetOmniShadow(EOmniShadow mode) { ShadowAtlas.SetMode(mode); }
+
+    [[nodiscard]] EOmniShadow GetOmniShadow() const { return ShadowAtlas.GetMode(); }
+
+    [[nodiscard]] const TShadowScheduler &GetShadowScheduler() const { return ShadowScheduler; }
+
+    // Vertex counts of the imported models loaded so far.
+    [[nodiscard]] TModelStats GetModelStats() const {
+        TModelStats stats;
+        for (auto *model : {&Suit.Get(), &Drop.Get()}) {
+            stats.LoadedVertices += model->GetStats().LoadedVertices;
+            stats.WeldedVertices += model->GetStats().WeldedVertices;
+        }
+        return stats;
+    }
+
+    // Frustum culling of the last frame.
+    [[nodiscard]] const TCullStats &GetCullStats(EScenePass pass) const {
+        return CullStats[static_cast<size_t>(pass)];
+    }
+
 private:
-    void DrawScene(IShaderSet &&set);
-    void SetupLights(glm::vec3 position, float interval);
+    std::vector<TMesh> CreatePoints();
+    TCullStats DrawScene(IShaderSet &&set);
+    TShadowMoments CreateShadowMoments() const;
+    void BlurShadowMoments();
+    TShadowShaderSet CascadeShadowSet(const TCascade &cascade, glm::vec3 position, EMobility casters);
+    void SetupLights(const glm::mat4 &viewProjection, glm::vec3 position, float interval);
     void UpdateFountain(float interval);
     void DrawFountain(IShaderSet &set);
     void DrawSkybox();
@@ -1,5 +1,8 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <random>
 
 struct TProjectionView {
@@ -38,6 +41,19 @@ struct TSpotLight {
           , Linear(linear)
           , Quadratic(quadratic) {
     }
+
+    // Distance at which the attenuated diffuse and specular drop below threshold.
+    [[nodiscard]] float Range(float threshold = 1.0f / 256) const {
+        glm::vec3 color = glm::max(glm::vec3(Diffuse), Specular);
+        float ratio = std::max(color.x, std::max(color.y, color.z)) / threshold - 1.0f;
+        if (ratio <= 0) {
+            return 0;
+        }
+        if (Quadratic > 0) {
+            return (std::sqrt(Linear * Linear + 4 * Quadratic * ratio) - Linear) / (2 * Quadratic);
+        }
+        return Linear > 0 ? ratio / Linear : std::numeric_limits<float>::infinity();
+    }
 };
 
 struct TProjectorLightPos {
@@ -92,6 +108,7 @@ struct TLightsPos {
     glm::vec4 directional;
     glm::vec4 spots[4];
     TProjectorLightPos projector;
+    glm::vec4 shadowOrigins[4];
 };
 
 class TParticleInjector {
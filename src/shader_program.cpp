@@ -1,6 +1,8 @@
 #include "errors.h"
 #include "shader_program.h"
+#include "gl_state.h"
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
 #include <array>
 
 TShaderProgram::TShaderProgram(const TShaderBuilder &builder)
@@ -71,12 +73,14 @@ TShaderProgram::TShaderProgram(const TShaderBuilder &builder)
         if (vertex != 0) glDeleteShader(vertex);
         if (fragment != 0) glDeleteShader(fragment);
         if (geometry != 0) glDeleteShader(geometry);
+        TGlState::Get().ForgetProgram(Program);
         glDeleteProgram(Program);
         throw;
     }
 }
 
 TShaderProgram::~TShaderProgram() {
+    TGlState::Get().ForgetProgram(Program);
     glDeleteProgram(Program);
 }
 
@@ -121,67 +125,102 @@ GLuint TShaderProgram::CreateShader(GLenum type, const std::string &name, const
     }
 }
 
+// The program stays in use until the next setup replaces it.
 TShaderSetup::TShaderSetup(const TShaderProgram *program)
     : Program(program) {
-    GL_ASSERT(glUseProgram(program->Program));
+    TGlState::Get().UseProgram(program->Program);
 }
 
-TShaderSetup::~TShaderSetup() {
-    if (Program != nullptr) {
-        glUseProgram(0);
+bool TShaderSetup::Changed(GLint location, const void *data, size_t size) {
+    if (location == -1) {
+        return false;
     }
+    auto &stats = TShaderProgram::UniformStats;
+    stats.Calls++;
+    auto bytes = static_cast<const std::byte*>(data);
+    auto &cached = Program->Values[location];
+    if (std::equal(cached.begin(), cached.end(), bytes, bytes + size)) {
+        stats.Skipped++;
+        return false;
+    }
+    cached.assign(bytes, bytes + size);
+    return true;
 }
 
 void TShaderSetup::Set(GLint location, GLint value) {
-    GL_ASSERT(glUniform1i(location, value));
+    if (Changed(location, &value, sizeof(value))) {
+        GL_ASSERT(glUniform1i(location, value));
+    }
 }
 
 void TShaderSetup::Set(GLint location, GLfloat value) {
-    GL_ASSERT(glUniform1f(location, value));
+    if (Changed(location, &value, sizeof(value))) {
+        GL_ASSERT(glUniform1f(location, value));
+    }
 }
 
 void TShaderSetup::Set(GLint location, glm::vec2 value) {
-    GL_ASSERT(glUniform2f(location, value.x, value.y));
+    if (Changed(location, &value, sizeof(value))) {
+        GL_ASSERT(glUniform2f(location, value.x, value.y));
+    }
 }
 
 void TShaderSetup::Set(GLint location, GLfloat x, GLfloat y) {
-    GL_ASSERT(glUniform2f(location, x, y));
+    Set(location, glm::vec2(x, y));
 }
 
 void TShaderSetup::Set(GLint location, GLfloat x, GLfloat y, GLfloat z) {
-    GL_ASSERT(glUniform3f(location, x, y, z));
+    Set(location, glm::vec3(x, y, z));
 }
 
 void TShaderSetup::Set(GLint location, glm::vec3 value) {
-    GL_ASSERT(glUniform3f(location, value.x, value.y, value.z));
+    if (Changed(location, &value, sizeof(value))) {
+        GL_ASSERT(glUniform3f(location, value.x, value.y, value.z));
+    }
 }
 
 void TShaderSetup::Set(GLint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w) {
-    GL_ASSERT(glUniform4f(location, x, y, z, w));
+    Set(location, glm::vec4(x, y, z, w));
 }
 
 void TShaderSetup::Set(GLint location, glm::vec4 value) {
-    GL_ASSERT(glUniform4f(location, value.x, value.y, value.z, value.w));
+    if (Changed(location, &value, sizeof(value))) {
+        GL_ASSERT(glUniform4f(location, value.x, value.y, value.z, value.w));
+    }
 }
 
 void TShaderSetup::Set(GLint location, const glm::mat4 &mat) {
-    GL_ASSERT(glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(mat)));
+    if (Changed(location, glm::value_ptr(mat), sizeof(mat))) {
+        GL_ASSERT(glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(mat)));
+    }
 }
 
 void TShaderSetup::Set(GLint location, const glm::mat3 &mat) {
-    GL_ASSERT(glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(mat)));
+    if (Changed(location, glm::value_ptr(mat), sizeof(mat))) {
+        GL_ASSERT(glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(mat)));
+    }
 }
 
 void TShaderSetup::Set(GLint location, const glm::mat4 *mat, GLsizei count) {
-    GL_ASSERT(glUniformMatrix4fv(location, count, GL_FALSE, glm::value_ptr(*mat)));
+    if (Changed(location, mat, count * sizeof(*mat))) {
+        GL_ASSERT(glUniformMatrix4fv(location, count, GL_FALSE, glm::value_ptr(*mat)));
+    }
+}
+
+void TShaderSetup::Set(GLint location, const glm::vec4 *data, GLsizei count) {
+    if (Changed(location, data, count * sizeof(*data))) {
+        GL_ASSERT(glUniform4fv(location, count, glm::value_ptr(*data)));
+    }
 }
 
 void TShaderSetup::Set(GLint location, const GLfloat *data, GLsizei count) {
-    GL_ASSERT(glUniform1fv(location, count, data));
+    if (Changed(location, data, count * sizeof(*data))) {
+        GL_ASSERT(glUniform1fv(location, count, data));
+    }
 }
 
 void TShaderSetup::Set(GLint index, const TMaterialTexture &texture) {
-    GL_ASSERT(glUniform1i(Program->Bound[index], index));
+    Set(Program->Bound[index], index);
     if (texture.index() == 1) {
         Attach(std::get<TFlatTexture>(texture), index);
     } else if (texture.index() == 2) {
@@ -4,6 +4,9 @@
 #include "texture.h"
 #include "material.h"
 #include "resource.h"
+#include "gl_state.h"
+#include <cstddef>
+#include <unordered_map>
 
 class TShaderBuilder {
 public:
@@ -29,6 +32,10 @@ private:
     std::array<GLint, MATERIAL_PROPS_COUNT> Constants{};
     std::array<GLint, 32> Bound{};
     int TexturesCount = 1;
+    // Last value uploaded to each uniform location, unknown until a setup sets it.
+    mutable std::unordered_map<GLint, std::vector<std::byte>> Values;
+
+    static inline TGlStateStats UniformStats;
 
 public:
     TShaderProgram(const TShaderBuilder &builder);
@@ -36,6 +43,10 @@ public:
     TShaderProgram &operator=(const TShaderProgram &) = delete;
     ~TShaderProgram();
 
+    // Uniform uploads asked of all programs and how many of them repeated the last value.
+    [[nodiscard]] static const TGlStateStats &GetUniformStats() { return UniformStats; }
+    static void ResetUniformStats() { UniformStats = {}; }
+
 protected:
     GLint DefineTexture(const std::string &name, bool skip = false);
     GLint DefineProp(const std::string &name, bool skip = false);
@@ -56,7 +67,7 @@ public:
           , Program(src.Program) {
         src.Program = nullptr;
     }
-    ~TShaderSetup() override;
+    ~TShaderSetup() override = default;
 
     void SetTexture(EMaterialProp prop, const TMaterialTexture &texture) override {
         auto index = Program->Textures[static_cast<size_t>(prop)];
@@ -84,17 +95,23 @@ public:
     }
 
 protected:
-    static void Set(GLint location, GLint value);
-    static void Set(GLint location, GLfloat value);
-    static void Set(GLint location, glm::vec2 value);
-    static void Set(GLint location, GLfloat x, GLfloat y);
-    static void Set(GLint location, GLfloat x, GLfloat y, GLfloat z);
-    static void Set(GLint location, glm::vec3 value);
-    static void Set(GLint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w);
-    static void Set(GLint location, glm::vec4 value);
-    static void Set(GLint location, const GLfloat* data, GLsizei count);
-    static void Set(GLint location, const glm::mat4 &mat);
-    static void Set(GLint location, const glm::mat3 &mat);
-    static void Set(GLint location, const glm::mat4 *mat, GLsizei count);
+    // Uploads go to the program in use and are skipped when the location already holds the value.
+    void Set(GLint location, GLint value);
+    void Set(GLint location, GLfloat value);
+    void Set(GLint location, glm::vec2 value);
+    void Set(GLint location, GLfloat x, GLfloat y);
+    void Set(GLint location, GLfloat x, GLfloat y, GLfloat z);
+    void Set(GLint location, glm::vec3 value);
+    void Set(GLint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w);
+    void Set(GLint location, glm::vec4 value);
+    void Set(GLint location, const GLfloat* data, GLsizei count);
+    void Set(GLint location, const glm::mat4 &mat);
+    void Set(GLint location, const glm::mat3 &mat);
+    void Set(GLint location, const glm::mat4 *mat, GLsizei count);
+    void Set(GLint location, const glm::vec4 *data, GLsizei count);
     void Set(GLint index, const TMaterialTexture &texture);
+
+private:
+    // Stores the value as the location's last upload, false when it is there already.
+    bool Changed(GLint location, const void *data, size_t size);
 };
@@ -1,23 +1,66 @@
 #include "shader_set.h"
+#include "gl_state.h"
+#include <optional>
 
-TSceneShaderSet::TSceneShaderSet(TSceneShader *scene,
+namespace {
+    // A packet per visible mesh of the model at the given detail level, placed by its node
+    // transform. Every mesh is visible without a frustum, frusta outside the mask are skipped.
+    template<typename TSubmit>
+    void SubmitModel(TFrustumCuller *frustum, unsigned mask, const TModel &obj, size_t lod, const glm::mat4 &model,
+                     TDrawPacket packet, TSubmit &&submit) {
+        thread_local std::vector<uint8_t> visible;
+        auto placement = obj.Place(model);
+        if (!frustum) {
+            visible.assign(obj.MeshCount(), 1);
+        } else if (placement) {
+            frustum->Cull(*placement, obj.GetMeshCenters(), obj.GetMeshExtents(), visible);
+        } else {
+            frustum->Cull(model, obj.GetMeshCenters(), obj.GetMeshExtents(), visible);
+        }
+        for (int i = 0; i < static_cast<int>(obj.MeshCount()); ++i) {
+            packet.Faces = static_cast<uint8_t>(visible[i] & mask);
+            if (!packet.Faces) continue;
+            packet.Material = &obj.GetMeshMaterial(i);
+            packet.Mesh = &obj.GetMesh(i, lod);
+            packet.Model = placement ? placement->Get(i) : model;
+            submit(packet);
+        }
+    }
+}
+
+TSceneShaderSet::TSceneShaderSet(TRenderQueue *queue,
+                                 TSceneShader *scene,
+                                 TSceneShader *explode,
                                  TParticlesShader *particles,
                                  TCubeTexture sky,
                                  TFlatTexture shadow,
-                                 TCubeTexture spotShadow,
-                                 TCubeTexture spotShadow2,
-                                 glm::mat4 lightMatrix,
+                                 TFlatTexture spotShadow,
+                                 const TSpotShadows *spotShadows,
+                                 EShadowFilter filter,
+                                 const TShadowCascades *cascades,
                                  glm::vec3 position,
-                                 bool useMap)
-    : SceneShader(scene)
+                                 bool useMap,
+                                 TLodSelector lod,
+                                 TClusterCuller culler)
+    : Queue(queue)
+      , SceneShader(scene)
+      , ExplodeShader(explode)
       , ParticlesShader(particles)
       , Sky(std::move(sky))
       , Shadow(std::move(shadow))
       , SpotShadow(std::move(spotShadow))
-      , SpotShadow2(std::move(spotShadow2))
-      , LightMatrix(lightMatrix)
+      , SpotShadows(spotShadows)
+      , Filter(filter)
+      , Cascades(cascades)
       , Position(position)
-      , UseMap(useMap) {
+      , UseMap(useMap)
+      , Lod(lod)
+      , Culler(std::move(culler))
+      , Frustum(Culler.GetFrusta()) {
+}
+
+float TSceneShaderSet::Depth(glm::vec3 center) const {
+    return glm::length(center - Position);
 }
 
 void TSceneShaderSet::Particles(glm::mat4 model, glm::mat4 single, const TMesh &mesh) {
@@ -29,73 +72,206 @@ void TSceneShaderSet::Particles(glm::mat4 model, glm::mat4 single, const TMesh &
     mesh.Draw();
 }
 
-void TSceneShaderSet::Scene(glm::mat4 model, bool opaque, float explosion, const TMaterial &mat, const TMesh &mesh) {
-    auto setup = TSceneSetup(SceneShader)
-        .SetViewPos(Position)
-        .SetModel(model)
-        .SetOpaque(opaque)
-        .SetShadow(Shadow)
-        .SetSpotShadow(SpotShadow)
-        .SetSpotShadow2(SpotShadow2)
-        .SetLight(LightMatrix * model)
-        .SetExplosion(explosion)
-        .SetUseMap(UseMap);
-    mat.DrawWith(setup, mesh);
+void TSceneShaderSet::Scene(glm::mat4 model, bool opaque, float explosion, EMobility,
+                            const TMaterial &mat, const TMesh &mesh) {
+    // Exploded triangles leave the mesh bounds.
+    if (explosion <= 0 && mesh.GetBounds() && !Frustum.Visible(*mesh.GetBounds(), model)) return;
+    TDrawPacket packet;
+    packet.Program = explosion > 0 ? ExplodeShader : SceneShader;
+    packet.Material = &mat;
+    packet.Mesh = &mesh;
+    packet.Model = model;
+    packet.Explosion = explosion;
+    packet.Blend = opaque;
+    Queue->Submit(opaque ? ERenderPass::Translucent : ERenderPass::Opaque, Depth(glm::vec3(model[3])), packet);
 }
 
-void TSceneShaderSet::Scene(glm::mat4 model, bool opaque, float explosion, const TModel &obj) {
-    auto setup = TSceneSetup(SceneShader)
-        .SetViewPos(Position)
-        .SetModel(model)
-        .SetOpaque(opaque)
-        .SetShadow(Shadow)
-        .SetSpotShadow(SpotShadow)
-        .SetSpotShadow2(SpotShadow2)
-        .SetLight(LightMatrix * model)
-        .SetExplosion(explosion)
-        .SetUseMap(UseMap);
-    obj.Draw(setup);
+void TSceneShaderSet::Scene(glm::mat4 model, bool opaque, float explosion, EMobility, const TModel &obj) {
+    TDrawPacket packet;
+    packet.Program = explosion > 0 ? ExplodeShader : SceneShader;
+    packet.Explosion = explosion;
+    packet.Blend = opaque;
+    // Exploded triangles leave the cluster and mesh bounds.
+    packet.Cull = explosion <= 0;
+    auto pass = opaque ? ERenderPass::Translucent : ERenderPass::Opaque;
+    float depth = Depth(glm::vec3(model * glm::vec4(obj.GetCenter(), 1.0f)));
+    SubmitModel(packet.Cull ? &Frustum : nullptr, ~0U, obj, obj.SelectLod(model, Lod), model, packet,
+                [&](const TDrawPacket &mesh) { Queue->Submit(pass, depth, mesh); });
 }
 
-TShadowShaderSet::TShadowShaderSet(TShadowShader *shader, glm::mat4 lightMatrix, glm::vec3 position)
-    : ShadowShader(shader)
+void TSceneShaderSet::Flush() {
+    Queue->Sort();
+    Queue->Upload();
+    {
+        // Pass state is set once per program, material textures once per material run and
+        // the VAO only when it changes. Per draw values are a single buffer range bind.
+        std::optional<TSceneSetup> setup;
+        std::optional<TMaterialBinder> material;
+        const TShaderProgram *program = nullptr;
+        const TMaterial *bound = nullptr;
+        TMeshBinder meshBinder;
+        auto &packets = Queue->GetPackets();
+        for (size_t i = 0; i < packets.size(); ++i) {
+            auto &packet = packets[i];
+            if (packet.Program != program) {
+                material.reset();
+                setup.reset();
+                program = packet.Program;
+                bound = nullptr;
+                setup.emplace(program == ExplodeShader ? ExplodeShader : SceneShader);
+                setup->SetViewPos(Position)
+                    .SetShadow(Shadow)
+                    .SetSpotShadows(SpotShadow, *SpotShadows)
+                    .SetShadowFilter(Filter)
+                    .SetCascades(*Cascades)
+                    .SetUseMap(UseMap);
+            }
+            if (packet.Material != bound) {
+                material.reset();
+                bound = packet.Material;
+                material.emplace(*bound, *setup);
+            }
+            Queue->Select(i);
+            meshBinder.Bind(*packet.Mesh);
+            if (packet.Cull) {
+                packet.Mesh->Draw(meshBinder, Culler, packet.Model);
+            } else {
+                packet.Mesh->Draw(meshBinder);
+            }
+        }
+        material.reset();
+    }
+    Queue->Clear();
+}
+
+TShadowShaderSet::TShadowShaderSet(TRenderQueue *queue,
+                                   TShadowShader *shader,
+                                   EShadowFilter filter,
+                                   glm::mat4 lightMatrix,
+                                   glm::vec3 position,
+                                   TLodSelector lod,
+                                   TClusterCuller culler,
+                                   std::optional<EMobility> casters)
+    : Queue(queue)
+      , ShadowShader(shader)
+      , Filter(filter)
       , LightMatrices({lightMatrix})
       , Position(position)
-      , Direct(true) {
+      , Direct(true)
+      , Casters(casters)
+      , Lod(lod)
+      , Culler(std::move(culler))
+      , Frustum(Culler.GetFrusta()) {
 }
 
-TShadowShaderSet::TShadowShaderSet(TShadowShader *shader,
+TShadowShaderSet::TShadowShaderSet(TRenderQueue *queue,
+                                   TShadowShader *shader,
+                                   EShadowFilter filter,
+                                   EOmniShadow mode,
                                    const std::array<glm::mat4, 6> &lightMatrices,
+                                   const std::array<glm::vec4, 6> &faceRects,
                                    glm::vec3 lightPos,
-                                   glm::vec3 position)
-    : ShadowShader(shader)
+                                   float range,
+                                   unsigned faces,
+                                   glm::vec3 position,
+                                   TLodSelector lod,
+                                   TClusterCuller culler)
+    : Queue(queue)
+      , ShadowShader(shader)
+      , Filter(filter)
       , LightMatrices(lightMatrices)
       , Position(position)
       , LightPos(lightPos)
-      , Direct(false) {
+      , Direct(false)
+      , FaceMask(faces)
+      , FaceRects(faceRects)
+      , Paraboloid(mode == EOmniShadow::DualParaboloid)
+      , Lod(lod)
+      , Culler(std::move(culler))
+      , Frustum(Culler.GetFrusta()) {
+    Frustum.SetRange(lightPos, range);
+}
+
+float TShadowShaderSet::Depth(glm::vec3 center) const {
+    if (Direct) {
+        return (LightMatrices[0] * glm::vec4(center, 1.0f)).z;
+    }
+    return glm::length(center - LightPos);
 }
 
 void TShadowShaderSet::Particles(glm::mat4, glm::mat4, const TMesh &mesh) {
 }
 
-void TShadowShaderSet::Scene(glm::mat4 model, bool opacity, float explosion, const TMaterial &mat, const TMesh &mesh) {
-    if (explosion > 0) return;
-    auto setup = TShadowSetup(ShadowShader)
-        .SetLightMatrices(LightMatrices)
-        .SetDirect(Direct)
-        .SetModel(model)
-        .SetLightPos(LightPos)
-        .SetOpacity(opacity);
-    mat.DrawWith(setup, mesh);
+void TShadowShaderSet::Scene(glm::mat4 model, bool opacity, float explosion, EMobility mobility,
+                             const TMaterial &mat, const TMesh &mesh) {
+    if (explosion > 0 || (Casters && mobility != *Casters)) return;
+    unsigned faces = mesh.GetBounds() ? Frustum.Visible(*mesh.GetBounds(), model) : Frustum.AllFrusta();
+    faces &= FaceMask;
+    if (faces == 0) return;
+    TDrawPacket packet;
+    packet.Faces = static_cast<uint8_t>(faces);
+    packet.Program = ShadowShader;
+    packet.Material = &mat;
+    packet.Mesh = &mesh;
+    packet.Model = model;
+    packet.Blend = opacity;
+    Queue->Submit(ERenderPass::Shadow, Depth(glm::vec3(model[3])), packet);
 }
 
-void TShadowShaderSet::Scene(glm::mat4 model, bool opacity, float explosion, const TModel &obj) {
-    if (explosion > 0) return;
-    auto setup = TShadowSetup(ShadowShader)
-        .SetLightMatrices(LightMatrices)
-        .SetDirect(Direct)
-        .SetModel(model)
-        .SetLightPos(LightPos)
-        .SetOpacity(opacity);
-    obj.Draw(setup);
+void TShadowShaderSet::Scene(glm::mat4 model, bool opacity, float explosion, EMobility mobility, const TModel &obj) {
+    if (explosion > 0 || (Casters && mobility != *Casters)) return;
+    TDrawPacket packet;
+    packet.Program = ShadowShader;
+    packet.Blend = opacity;
+    packet.Cull = true;
+    float depth = Depth(glm::vec3(model * glm::vec4(obj.GetCenter(), 1.0f)));
+    SubmitModel(&Frustum, FaceMask, obj, obj.SelectLod(model, Lod), model, packet,
+                [&](const TDrawPacket &mesh) { Queue->Submit(ERenderPass::Shadow, depth, mesh); });
+}
+
+void TShadowShaderSet::Flush() {
+    Queue->Sort();
+    Queue->Upload();
+    // The geometry shader clips cube faces to their frusta before moving them into the atlas.
+    auto &state = TGlState::Get();
+    if (!Direct) {
+        for (GLenum plane = 0; plane < 4; ++plane) {
+            state.SetEnabled(GL_CLIP_DISTANCE0 + plane, true);
+        }
+    }
+    {
+        auto setup = TShadowSetup(ShadowShader)
+            .SetLightMatrices(LightMatrices)
+            .SetFaceRects(FaceRects)
+            .SetParaboloid(Paraboloid)
+            .SetDirect(Direct)
+            .SetFilter(Filter)
+            .SetLightPos(LightPos);
+        std::optional<TMaterialBinder> material;
+        const TMaterial *bound = nullptr;
+        TMeshBinder meshBinder;
+        auto &packets = Queue->GetPackets();
+        for (size_t i = 0; i < packets.size(); ++i) {
+            auto &packet = packets[i];
+            if (packet.Material != bound) {
+                material.reset();
+                bound = packet.Material;
+                material.emplace(*bound, setup);
+            }
+            Queue->Select(i);
+            meshBinder.Bind(*packet.Mesh);
+            if (packet.Cull) {
+                packet.Mesh->Draw(meshBinder, Culler, packet.Model);
+            } else {
+                packet.Mesh->Draw(meshBinder);
+            }
+        }
+        material.reset();
+    }
+    if (!Direct) {
+        for (GLenum plane = 0; plane < 4; ++plane) {
+            state.SetEnabled(GL_CLIP_DISTANCE0 + plane, false);
+        }
+    }
+    Queue->Clear();
 }
@@ -1,58 +1,109 @@
 #pragma once
 #include "model.h"
+#include "render_queue.h"
 #include "shaders/scene.h"
 #include "shaders/particles.h"
 #include "shaders/shadow.h"
 #include "shaders/depth.h"
+#include "shadow_atlas.h"
 #include <glm/glm.hpp>
+#include <optional>
 
+// Static objects never move, so shadows they cast can be cached until the light changes.
+enum class EMobility {
+    Static,
+    Dynamic,
+};
+
+// Scene draws are recorded into a render queue and issued sorted by Flush, particles are
+// drawn right away. Meshes outside the pass's frusta are dropped before they are recorded.
 class IShaderSet {
 public:
     virtual ~IShaderSet() = default;
     virtual void Particles(glm::mat4 model, glm::mat4 single, const TMesh &mesh) = 0;
-    virtual void Scene(glm::mat4 model, bool opaque, float explosion, const TMaterial &mat, const TMesh &mesh) = 0;
-    virtual void Scene(glm::mat4 model, bool opaque, float explosion, const TModel &obj) = 0;
+    virtual void Scene(glm::mat4 model, bool opaque, float explosion, EMobility mobility,
+                       const TMaterial &mat, const TMesh &mesh) = 0;
+    virtual void Scene(glm::mat4 model, bool opaque, float explosion, EMobility mobility, const TModel &obj) = 0;
+    virtual void Flush() = 0;
+    virtual const TCullStats &GetCullStats() = 0;
     virtual glm::vec3 GetPosition() = 0;
+    virtual const TLodSelector &GetLodSelector() = 0;
 };
 
 class TSceneShaderSet: public IShaderSet {
 private:
+    TRenderQueue *Queue;
     TCubeTexture Sky;
     TFlatTexture Shadow;
-    TCubeTexture SpotShadow;
-    TCubeTexture SpotShadow2;
-    glm::mat4 LightMatrix;
+    TFlatTexture SpotShadow;
+    const TSpotShadows *SpotShadows;
+    EShadowFilter Filter;
+    const TShadowCascades *Cascades;
     TSceneShader *SceneShader;
+    TSceneShader *ExplodeShader;
     TParticlesShader *ParticlesShader;
     glm::vec3 Position;
     bool UseMap;
+    TLodSelector Lod;
+    TClusterCuller Culler;
+    TFrustumCuller Frustum;
+
+    [[nodiscard]] float Depth(glm::vec3 center) const;
 
 public:
-    TSceneShaderSet(TSceneShader *scene, TParticlesShader *particles, TCubeTexture sky,
-                    TFlatTexture shadow, TCubeTexture spotShadow, TCubeTexture spotShadow2,
-                    glm::mat4 lightMatrix, glm::vec3 position, bool useMap);
+    TSceneShaderSet(TRenderQueue *queue, TSceneShader *scene, TSceneShader *explode, TParticlesShader *particles,
+                    TCubeTexture sky, TFlatTexture shadow, TFlatTexture spotShadow, const TSpotShadows *spotShadows,
+                    EShadowFilter filter, const TShadowCascades *cascades, glm::vec3 position, bool useMap, TLodSelector lod,
+                    TClusterCuller culler);
     void Particles(glm::mat4 model, glm::mat4 single, const TMesh &mesh) override;
-    void Scene(glm::mat4 model, bool opaque, float explosion, const TMaterial &mat, const TMesh &mesh) override;
-    void Scene(glm::mat4 model, bool opaque, float explosion, const TModel &obj) override;
+    void Scene(glm::mat4 model, bool opaque, float explosion, EMobility mobility,
+               const TMaterial &mat, const TMesh &mesh) override;
+    void Scene(glm::mat4 model, bool opaque, float explosion, EMobility mobility, const TModel &obj) override;
+    void Flush() override;
+    const TCullStats &GetCullStats() override { return Frustum.GetStats(); }
     glm::vec3 GetPosition() override { return Position; }
+    const TLodSelector &GetLodSelector() override { return Lod; }
 };
 
 class TShadowShaderSet: public IShaderSet {
 private:
+    TRenderQueue *Queue;
     TShadowShader *ShadowShader;
+    EShadowFilter Filter;
     std::array<glm::mat4, 6> LightMatrices;
     glm::vec3 LightPos;
     glm::vec3 Position;
     bool Direct;
+    // Only casters of this mobility are drawn, all of them when empty.
+    std::optional<EMobility> Casters;
+    // Cube faces drawn by the pass, the others keep their contents.
+    unsigned FaceMask = ~0U;
+    // Atlas tiles of the cube faces.
+    std::array<glm::vec4, 6> FaceRects{};
+    bool Paraboloid = false;
+    TLodSelector Lod;
+    TClusterCuller Culler;
+    TFrustumCuller Frustum;
+
+    [[nodiscard]] float Depth(glm::vec3 center) const;
 
 public:
-    TShadowShaderSet(TShadowShader *shader, glm::mat4 lightMatrix, glm::vec3 position);
-    TShadowShaderSet(TShadowShader *shader, const std::array<glm::mat4, 6> &lightMatrices, glm::vec3 lightPos, glm::vec3 position);
+    TShadowShaderSet(TRenderQueue *queue, TShadowShader *shader, EShadowFilter filter, glm::mat4 lightMatrix,
+                     glm::vec3 position, TLodSelector lod, TClusterCuller culler, std::optional<EMobility> casters = {});
+    // Casters further than range from the light are skipped, only the given faces are drawn,
+    // each into its atlas tile. Dual paraboloid shadows take the hemisphere views as the first
+    // two light matrices.
+    TShadowShaderSet(TRenderQueue *queue, TShadowShader *shader, EShadowFilter filter, EOmniShadow mode,
+                     const std::array<glm::mat4, 6> &lightMatrices, const std::array<glm::vec4, 6> &faceRects,
+                     glm::vec3 lightPos, float range, unsigned faces, glm::vec3 position, TLodSelector lod,
+                     TClusterCuller culler);
     void Particles(glm::mat4 model, glm::mat4 single, const TMesh &mesh) override;
-    void Scene(glm::mat4 model, bool opaque, float explosion, const TMaterial &mat, const TMesh &mesh) override;
-    void Scene(glm::mat4 model, bool opaque, float explosion, const TModel &obj) override;
+    void Scene(glm::mat4 model, bool opaque, float explosion, EMobility mobility,
+               const TMaterial &mat, const TMesh &mesh) override;
+    void Scene(glm::mat4 model, bool opaque, float explosion, EMobility mobility, const TModel &obj) override;
+    void Flush() override;
+    const TCullStats &GetCullStats() override { return Frustum.GetStats(); }
     glm::vec3 GetPosition() override { return Position; }
+    const TLodSelector &GetLodSelector() override { return Lod; }
 };
 
-
-
@@ -5,17 +5,21 @@ uniform bool vertical;
 uniform int size;
 uniform float kernel[16];
 uniform float threshold;
+// Blurs all four channels as they are, e.g. shadow moments, instead of bright colors.
+uniform bool allChannels;
 out vec4 color;
 
 void main() {
     ivec2 sz = textureSize(screenTexture, 0);
     vec2 dir = vertical ? vec2(0.0f, 1.0f / sz.y) : vec2(1.0f / sz.x, 0.0f);
-    vec3 result = vec3(0.0f);
+    vec4 result = vec4(0.0f);
     for (int i = -size; i <= size; i++) {
-        vec3 tc = texture(screenTexture, fragmentCoord + dir * i).rgb;
-        float brightness = dot(tc, vec3(0.2126, 0.7152, 0.0722));
-        if (brightness > threshold)
+        vec4 tc = texture(screenTexture, fragmentCoord + dir * i);
+        float brightness = dot(tc.rgb, vec3(0.2126, 0.7152, 0.0722));
+        if (allChannels)
             result += tc * kernel[abs(i)];
+        else if (brightness > threshold)
+            result.rgb += tc.rgb * kernel[abs(i)];
     }
-    color = vec4(result, 1.0f);
+    color = allChannels ? result : vec4(result.rgb, 1.0f);
 }
\ No newline at end of file
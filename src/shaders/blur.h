@@ -11,6 +11,7 @@ private:
     GLint Size;
     GLint Kernel;
     GLint Threshold;
+    GLint AllChannels;
 public:
     TBlurShader()
         : TShaderProgram(
@@ -21,7 +22,8 @@ public:
           , Vertical(DefineProp("vertical"))
           , Size(DefineProp("size"))
           , Kernel(DefineProp("kernel"))
-          , Threshold(DefineProp("threshold")) {
+          , Threshold(DefineProp("threshold"))
+          , AllChannels(DefineProp("allChannels")) {
     }
     friend class TBlurSetup;
 };
@@ -43,11 +45,11 @@ public:
     ~TBlurSetup() {
         if (Shader != nullptr) {
             try {
-
-            } catch (...) {
                 Set(Shader->Vertical, false);
                 Set(Shader->Size, 0);
                 Set(Shader->Threshold, 0.0f);
+                Set(Shader->AllChannels, false);
+            } catch (...) {
             }
         }
     }
@@ -84,4 +86,10 @@ public:
         Set(Shader->Threshold, threshold);
         return std::move(*this);
     }
+
+    // Blurs every channel without the brightness threshold, e.g. shadow moments.
+    TBlurSetup&& SetAllChannels(bool all) {
+        Set(Shader->AllChannels, all);
+        return std::move(*this);
+    }
 };
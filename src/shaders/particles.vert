@@ -3,8 +3,8 @@
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 coord;
-layout (location = 3) in vec3 offset;
-layout (location = 4) in vec3 speed;
+layout (location = 5) in vec3 offset;
+layout (location = 6) in vec3 speed;
 out VS_OUT {
     vec3 normal;
     vec3 position;
@@ -48,7 +48,7 @@ struct ProjectorLight {
 in GS_OUT {
     vec3 normal;
     vec3 position;
-    vec4 lightPos;
+    vec3 world;
     vec2 coord;
     vec3 directional;
     vec3 spots[4];
@@ -59,9 +59,31 @@ in GS_OUT {
 
 uniform Material material;
 uniform sampler2D shadow;
-uniform samplerCube spotShadow;
-uniform samplerCube spotShadow2;
-uniform bool opaque;
+// Directional shadow cascades packed into the shadow atlas: world to light clip space and
+// the atlas region of each cascade as texture coordinate offset and scale.
+uniform mat4 cascades[4];
+uniform vec4 cascadeRects[4];
+uniform int cascadeCount;
+uniform float cascadeBlend;
+// Spot light shadows unfolded into one atlas. shadowFaces project directions from a light
+// onto the cube faces, spotShadowRects hold the atlas tile of every face, six per spot light.
+// Lights without a shadow have empty tiles. Dual paraboloid shadows use the first two faces
+// and tiles for the hemispheres below and above the light.
+uniform sampler2D spotShadow;
+uniform mat4 shadowFaces[6];
+uniform vec4 spotShadowRects[24];
+uniform bool paraboloidShadows;
+// 0 filters depth maps with PCF. 1 and 2 read variance or exponential variance moments from
+// the same samplers with a single filtered fetch.
+uniform int shadowFilter;
+layout (std140) uniform Object {
+    mat4 model;
+    mat3 norm;
+    float explosion;
+    bool opaque;
+    // Shadow cube faces the object touches.
+    int faces;
+};
 uniform bool useMap;
 layout (std140) uniform Lights {
     DirectionalLight directional;
@@ -114,34 +136,141 @@ void main() {
 
 vec2 shadowTex = 0.5 / textureSize(shadow, 0);
 
+// Must match the exponents shadow.frag warps casters with.
+const float evsmPositive = 40.0;
+const float evsmNegative = 5.0;
+// Texels along the atlas tile borders that the moment blur mixes with the neighbouring tile.
+const float momentBorder = 4.0;
+
+// Upper bound of the lit fraction from the mean and variance of occluder depths. The lowest
+// part is cut off to reduce light bleeding between overlapping occluders.
+float Chebyshev(vec2 moments, float depth, float minVariance) {
+    if (depth <= moments.x) {
+        return 1.0f;
+    }
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = depth - moments.x;
+    float lit = variance / (variance + d * d);
+    return clamp((lit - 0.2) / 0.8, 0.0, 1.0);
+}
+
+float MomentShadow(vec4 moments, float depth) {
+    if (shadowFilter == 1) {
+        return Chebyshev(moments.xy, depth, 0.00002);
+    }
+    float positive = exp(evsmPositive * (2 * depth - 1));
+    float negative = -exp(-evsmNegative * (2 * depth - 1));
+    // Variance floors scaled by the slope of the warp.
+    float lit = Chebyshev(moments.xy, positive, 0.00002 * evsmPositive * evsmPositive * positive * positive);
+    float litNegative = Chebyshev(moments.zw, negative, 0.00002 * evsmNegative * evsmNegative * negative * negative);
+    return min(lit, litNegative);
+}
+
+// 7x7 PCF or one moment fetch inside the cascade's atlas region, taps never read a
+// neighbouring cascade.
+float CascadeShadow(int cascade, vec3 lightPos) {
+    vec4 rect = cascadeRects[cascade];
+    vec3 scoord = lightPos * 0.5 + 0.5;
+    vec2 base = rect.xy + scoord.xy * rect.zw;
+    if (shadowFilter != 0) {
+        vec2 border = 2 * momentBorder * shadowTex;
+        return MomentShadow(texture(shadow, clamp(base, rect.xy + border, rect.xy + rect.zw - border)), scoord.z);
+    }
+    vec2 low = rect.xy + shadowTex;
+    vec2 high = rect.xy + rect.zw - shadowTex;
+    float s = 1.0f;
+    for (int i = -3; i <= 3; i++) {
+        for (int j = -3; j <= 3; j++) {
+            if (texture(shadow, clamp(base + shadowTex * vec2(i, j), low, high)).r < scoord.z + 0.001) {
+                s -= 1.0 / 49;
+            }
+        }
+    }
+    return s;
+}
+
+// The first cascade whose map covers the fragment casts its shadow. Close to the cascade
+// border the result fades into the next cascade, hiding the step in resolution.
+float DirectionalShadow() {
+    for (int c = 0; c < cascadeCount; c++) {
+        vec3 lightPos = vec3(cascades[c] * vec4(fs_in.world, 1.0f));
+        if (abs(lightPos.x) >= 1 || abs(lightPos.y) >= 1 || lightPos.z > 1) {
+            continue;
+        }
+        float s = CascadeShadow(c, lightPos);
+        float edge = 1 - max(abs(lightPos.x), abs(lightPos.y));
+        if (edge < cascadeBlend && c + 1 < cascadeCount) {
+            vec3 nextPos = vec3(cascades[c + 1] * vec4(fs_in.world, 1.0f));
+            if (nextPos.z <= 1) {
+                s = mix(CascadeShadow(c + 1, nextPos), s, edge / cascadeBlend);
+            }
+        }
+        return s;
+    }
+    return 1.0f;
+}
+
 vec3 CalcDirectionalLight(DirectionalLight light, vec3 dir, vec3 norm, vec3 viewDir, vec3 diffuse, vec3 specular, float shiness) {
     vec3 lightNorm = normalize(-dir);
     vec3 halfLight = normalize(lightNorm + viewDir);
 
     float diff = max(dot(norm, lightNorm), 0.0f);
     float spec = dot(norm, lightNorm) >= 0 ? pow(max(dot(norm, halfLight), 0.0f), shiness) : 0;
-    float s = 1.0f;
-    vec3 scoord = fs_in.lightPos.xyz * 0.5 + 0.5;
-    if (fs_in.lightPos.z <= 1) {
-        for (int i = -3; i <= 3; i++) {
-            for (int j = -3; j <= 3; j++) {
-                if (texture(shadow, scoord.xy + shadowTex * vec2(i, j)).r < scoord.z + 0.001) {
-                    s -= 1.0 / 49;
-                }
-            }
-        }
-    }
+    float s = DirectionalShadow();
 
     return diffuse * light.ambient +
     s * diffuse * diff * light.diffuse +
     s * specular.rgb * spec * light.specular;
 }
 
-vec3 sampleOffsetDirections[9] = vec3[] (
-    vec3(0, 0, 0),
-    vec3(1, 1, 1), vec3(1, 1, -1), vec3(1, -1, 1), vec3(1, -1, -1),
-    vec3(-1, 1, 1), vec3(-1, 1, -1), vec3(-1, -1, 1), vec3(-1, -1, -1)
-);
+vec2 spotShadowTex = 1.0 / textureSize(spotShadow, 0);
+
+// The cube face a direction falls on, in cube map layer order.
+int CubeFace(vec3 dir) {
+    vec3 a = abs(dir);
+    if (a.x >= a.y && a.x >= a.z) {
+        return dir.x > 0 ? 0 : 1;
+    }
+    if (a.y >= a.z) {
+        return dir.y > 0 ? 2 : 3;
+    }
+    return dir.z > 0 ? 4 : 5;
+}
+
+// The atlas stores distances to the light divided by the shadow far plane. 3x3 PCF or one
+// moment fetch, kept inside the face's tile.
+float SpotShadow(int light, vec3 fragFromLight) {
+    int face;
+    vec2 coord;
+    if (paraboloidShadows) {
+        face = fragFromLight.y <= 0 ? 0 : 1;
+        vec3 dir = normalize(mat3(shadowFaces[face]) * fragFromLight);
+        coord = dir.xy / (1 - dir.z);
+    } else {
+        face = CubeFace(fragFromLight);
+        vec4 clip = shadowFaces[face] * vec4(fragFromLight, 1.0);
+        coord = clip.xy / clip.w;
+    }
+    vec4 rect = spotShadowRects[light * 6 + face];
+    if (rect.z == 0) {
+        return 1.0f;
+    }
+    vec2 base = rect.xy + (coord * 0.5 + 0.5) * rect.zw;
+    vec2 low = rect.xy + 0.5 * spotShadowTex;
+    vec2 high = rect.xy + rect.zw - 0.5 * spotShadowTex;
+    float dist = length(fragFromLight);
+    if (shadowFilter != 0) {
+        return MomentShadow(texture(spotShadow, clamp(base, low, high)), dist / 100);
+    }
+    float s = 1.0f;
+    for (int i = -1; i <= 1; i++) {
+        for (int j = -1; j <= 1; j++) {
+            if (texture(spotShadow, clamp(base + spotShadowTex * vec2(i, j), low, high)).r * 100 < dist + .04)
+                s -= 1.0f / 9.0f;
+        }
+    }
+    return s;
+}
 
 vec3 CalcSpotLight(SpotLight light, vec3 pos, int i, vec3 norm, vec3 viewDir, vec3 diffuse, vec3 specular, float shiness) {
     vec3 lightNorm = normalize(pos - fs_in.position);
@@ -152,20 +281,7 @@ vec3 CalcSpotLight(SpotLight light, vec3 pos, int i, vec3 norm, vec3 viewDir, ve
 
     float diff = max(dot(norm, lightNorm), 0.0f);
     float spec = dot(norm, lightNorm) >= 0 ? pow(max(dot(norm, halfLight), 0.0f), shiness) : 0;
-    float s = 1.0f;
-    vec3 fragFromLight = fs_in.shadows[i];
-    float dist = length(fragFromLight);
-    if (i == 1) {
-        for (int j = 0; j < 9; j++) {
-            if (texture(spotShadow, fragFromLight + sampleOffsetDirections[j] * dist * 0.003).r * 100 < dist + .04)
-                s -= 1.0f / 9.0f;
-        }
-    } else if (i == 2) {
-        for (int j = 0; j < 9; j++) {
-            if (texture(spotShadow2, fragFromLight + sampleOffsetDirections[j] * dist * 0.003).r * 100 < dist + .04)
-                s -= 1.0f / 9.0f;
-        }
-    }
+    float s = SpotShadow(i, fs_in.shadows[i]);
 
     return (diffuse * light.ambient +
         s * diffuse * diff * light.diffuse +
@@ -2,30 +2,55 @@
 #include <glm/glm.hpp>
 #include "../shader_program.h"
 #include "../resource.h"
+#include "../cascades.h"
+#include "shadow.h"
+#include <array>
+
+// Spot light shadows unfolded into one atlas, six tiles per light in the order of the light
+// uniforms. Lights without a shadow have empty tiles.
+struct TSpotShadows {
+    static constexpr size_t MaxSpots = 4;
+    // Projections of directions from a light onto the cube faces, or the two hemisphere views
+    // of dual paraboloid shadows.
+    std::array<glm::mat4, 6> Faces{};
+    bool Paraboloid = false;
+    // Atlas tiles as texture coordinate offset and scale.
+    std::array<glm::vec4, MaxSpots * 6> Rects{};
+};
 
 class TSceneShader: public TShaderProgram {
 private:
-    GLint Model;
-    GLint Norm;
-    GLint Light;
+    GLint Cascades;
+    GLint CascadeRects;
+    GLint CascadeCount;
+    GLint CascadeBlend;
     GLint SkyBox;
     GLint Shadow;
     GLint SpotShadow;
-    GLint SpotShadow2;
+    GLint ShadowFaces;
+    GLint ParaboloidShadows;
+    GLint SpotShadowRects;
+    GLint ShadowFilter;
     GLint ViewPos;
-    GLint Explosion;
-    GLint Opaque;
     GLint UseMap;
 public:
-    TSceneShader(const TUniformBindingBase &matrices, const TUniformBindingBase &lights, const TUniformBindingBase &lightsPos)
+    // The exploding variant moves triangles along their normals in a geometry shader and
+    // derives tangent space there. The default one reads tangents from the vertex layout.
+    // Per draw values come from the Object block.
+    TSceneShader(const TUniformBindingBase &matrices,
+                 const TUniformBindingBase &lights,
+                 const TUniformBindingBase &lightsPos,
+                 const TUniformBindingBase &objects,
+                 bool exploding = false)
         : TShaderProgram(
         TShaderBuilder()
-            .SetVertex(&NResource::shaders_scene_vert)
+            .SetVertex(exploding ? &NResource::shaders_scene_vert : &NResource::shaders_scene_tbn_vert)
             .SetFragment(&NResource::shaders_scene_frag)
-            .SetGeometry(&NResource::shaders_scene_geom)
+            .SetGeometry(exploding ? &NResource::shaders_scene_geom : nullptr)
             .SetBlock("Matrices", matrices)
             .SetBlock("Lights", lights)
             .SetBlock("LightsPos", lightsPos)
+            .SetBlock("Object", objects)
             .SetTexture(EMaterialProp::Diffuse, "material.diffuse_map", "material.has_diffuse_map")
             .SetTexture(EMaterialProp::Specular, "material.specular_map", "material.has_specular_map")
             .SetTexture(EMaterialProp::Normal, "material.normal_map", "material.has_normal_map")
@@ -33,15 +58,17 @@ public:
             .SetColor(EMaterialProp::Diffuse, "material.diffuse_col")
             .SetColor(EMaterialProp::Specular, "material.specular_col")
             .SetConstant(EMaterialProp::Shininess, "material.shiness"))
-          , Model(DefineProp("model"))
-          , Norm(DefineProp("norm"))
-          , Light(DefineProp("light"))
+          , Cascades(DefineProp("cascades"))
+          , CascadeRects(DefineProp("cascadeRects"))
+          , CascadeCount(DefineProp("cascadeCount"))
+          , CascadeBlend(DefineProp("cascadeBlend"))
           , Shadow(DefineTexture("shadow"))
           , SpotShadow(DefineTexture("spotShadow"))
-          , SpotShadow2(DefineTexture("spotShadow2"))
+          , ShadowFaces(DefineProp("shadowFaces"))
+          , ParaboloidShadows(DefineProp("paraboloidShadows"))
+          , SpotShadowRects(DefineProp("spotShadowRects"))
+          , ShadowFilter(DefineProp("shadowFilter"))
           , ViewPos(DefineProp("viewPos"))
-          , Explosion(DefineProp("explosion"))
-          , Opaque(DefineProp("opaque"))
           , UseMap(DefineProp("useMap")) {
     }
 
@@ -62,26 +89,11 @@ public:
         src.Shader = nullptr;
     }
 
-    ~TSceneSetup() override {
-        if (Shader != nullptr) {
-            try {
-                Set(Shader->Model, glm::mat4(0));
-                Set(Shader->ViewPos, glm::vec3(0));
-                Set(Shader->Explosion, 0.0f);
-                Set(Shader->Opaque, false);
-            } catch (...) {
-            }
-        }
-    }
-
-    TSceneSetup &&SetModel(glm::mat4 model) {
-        Set(Shader->Model, model);
-        Set(Shader->Norm, glm::transpose(glm::inverse(glm::mat3(model))));
-        return std::move(*this);
-    }
-
-    TSceneSetup &&SetLight(glm::mat4 matrix) {
-        Set(Shader->Light, matrix);
+    TSceneSetup &&SetCascades(const TShadowCascades &cascades) {
+        Set(Shader->Cascades, cascades.GetMatrices().data(), cascades.GetCount());
+        Set(Shader->CascadeRects, cascades.GetRects().data(), cascades.GetCount());
+        Set(Shader->CascadeCount, cascades.GetCount());
+        Set(Shader->CascadeBlend, cascades.GetBlend());
         return std::move(*this);
     }
 
@@ -90,28 +102,22 @@ public:
         return std::move(*this);
     }
 
-    TSceneSetup &&SetExplosion(float value) {
-        Set(Shader->Explosion, value);
-        return std::move(*this);
-    }
-
-    TSceneSetup &&SetOpaque(bool value) {
-        Set(Shader->Opaque, value);
-        return std::move(*this);
-    }
-
     TSceneSetup &&SetShadow(TFlatTexture &texture) {
         Set(Shader->Shadow, texture);
         return std::move(*this);
     }
 
-    TSceneSetup &&SetSpotShadow(TCubeTexture &texture) {
-        Set(Shader->SpotShadow, texture);
+    TSceneSetup &&SetSpotShadows(TFlatTexture &atlas, const TSpotShadows &shadows) {
+        Set(Shader->SpotShadow, atlas);
+        Set(Shader->ShadowFaces, shadows.Faces.data(), 6);
+        Set(Shader->ParaboloidShadows, shadows.Paraboloid);
+        Set(Shader->SpotShadowRects, shadows.Rects.data(), static_cast<GLsizei>(shadows.Rects.size()));
         return std::move(*this);
     }
 
-    TSceneSetup &&SetSpotShadow2(TCubeTexture &texture) {
-        Set(Shader->SpotShadow2, texture);
+    // The shadow textures hold moments instead of depth unless the filter is PCF.
+    TSceneSetup &&SetShadowFilter(EShadowFilter filter) {
+        Set(Shader->ShadowFilter, static_cast<GLint>(filter));
         return std::move(*this);
     }
 
@@ -0,0 +1,77 @@
+#version 330 core
+
+struct ProjectorLightPos {
+    vec3 position;
+    vec3 target;
+};
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec2 coord;
+// glTF meshes carry no bitangent: w of the tangent holds the handedness and the
+// bitangent attribute is left disabled, so it reads as zero.
+layout (location = 3) in vec4 tangent;
+layout (location = 4) in vec3 bitangent;
+
+layout (std140) uniform Matrices
+{
+    mat4 projection;
+    mat4 view;
+};
+
+layout (std140) uniform LightsPos {
+    vec3 directional;
+    vec3 spots[4];
+    ProjectorLightPos projector;
+    // Positions the spot shadow maps were last drawn from.
+    vec3 shadowOrigins[4];
+};
+
+layout (std140) uniform Object {
+    mat4 model;
+    mat3 norm;
+    float explosion;
+    bool opaque;
+    // Shadow cube faces the object touches.
+    int faces;
+};
+uniform vec3 viewPos;
+
+out GS_OUT {
+    vec3 normal;
+    vec3 position;
+    vec3 world;
+    vec2 coord;
+    vec3 directional;
+    vec3 spots[4];
+    vec3 shadows[4];
+    ProjectorLightPos projector;
+    vec3 viewPos;
+} vs_out;
+
+void main() {
+    vec4 pos = vec4(position, 1.0f);
+    vec4 world = model * pos;
+    gl_Position = projection * view * world;
+
+    vec3 worldNormal = norm * normal;
+    vec3 n = normalize(worldNormal);
+    vec3 tg = mat3(model) * tangent.xyz;
+    vec3 btg = mat3(model) * (dot(bitangent, bitangent) > 0 ? bitangent : cross(normal, tangent.xyz) * tangent.w);
+    vec3 t = normalize(tg - dot(tg, n) * n);
+    vec3 b = normalize(btg - dot(btg, n) * n);
+    mat3 itbn = transpose(mat3(t, b, n));
+
+    vs_out.world = vec3(world);
+    vs_out.coord = coord;
+    vs_out.normal = itbn * worldNormal;
+    vs_out.position = itbn * vec3(world);
+    vs_out.directional = itbn * directional;
+    for (int j = 0; j < 4; ++j) {
+        vs_out.spots[j] = itbn * spots[j];
+        vs_out.shadows[j] = vec3(world) - shadowOrigins[j];
+    }
+    vs_out.projector.position = itbn * projector.position;
+    vs_out.projector.target = itbn * projector.target;
+    vs_out.viewPos = itbn * viewPos;
+}
@@ -5,18 +5,39 @@ in GS_OUT {
     vec2 coord;
 } fs_in;
 
-uniform bool opacity;
+layout (std140) uniform Object {
+    mat4 model;
+    mat3 norm;
+    float explosion;
+    bool opaque;
+    // Shadow cube faces the object touches.
+    int faces;
+};
 uniform sampler2D diffuse;
 uniform vec3 lightPos;
 uniform bool direct;
+// 0 writes depth only, 1 variance and 2 exponential variance moments as well.
+uniform int shadowFilter;
+
+out vec4 moments;
+
+// Must match the exponents scene.frag warps receivers with.
+const float evsmPositive = 40.0;
+const float evsmNegative = 5.0;
 
 void main() {
-    if (opacity) {
+    if (opaque) {
         if (texture(diffuse, fs_in.coord).a < .2) discard;
     }
-    if (direct) {
-        gl_FragDepth = gl_FragCoord.z;
+    float depth = direct ? gl_FragCoord.z : length(fs_in.position - lightPos) / 100.0;
+    gl_FragDepth = depth;
+    if (shadowFilter == 1) {
+        moments = vec4(depth, depth * depth, 0, 0);
+    } else if (shadowFilter == 2) {
+        float positive = exp(evsmPositive * (2 * depth - 1));
+        float negative = -exp(-evsmNegative * (2 * depth - 1));
+        moments = vec4(positive, positive * positive, negative, negative * negative);
     } else {
-        gl_FragDepth = length(fs_in.position - lightPos) / 100.0;
+        moments = vec4(depth);
     }
-}
\ No newline at end of file
+}
@@ -2,27 +2,51 @@
 #include <glm/glm.hpp>
 #include "../shader_program.h"
 #include "../resource.h"
+#include <cmath>
+
+// How shadow maps are filtered. The prefiltered modes additionally write depth moments into
+// a color target, which can be blurred and is read with a single filtered fetch.
+enum class EShadowFilter {
+    Pcf,
+    Variance,
+    ExponentialVariance,
+};
+
+// Moments of the far plane, the clear value of a moment target. The exponents match
+// shadow.frag.
+inline glm::vec4 FarMoments(EShadowFilter filter) {
+    if (filter == EShadowFilter::ExponentialVariance) {
+        float positive = std::exp(40.0f);
+        float negative = -std::exp(-5.0f);
+        return {positive, positive * positive, negative, negative * negative};
+    }
+    return glm::vec4(1.0f);
+}
 
 class TShadowShader: public TShaderProgram {
 private:
     GLint LightMatrices;
     GLint Direct;
-    GLint Model;
     GLint LightPos;
-    GLint Opacity;
+    GLint FaceRects;
+    GLint Paraboloid;
+    GLint Filter;
 public:
-    explicit TShadowShader()
+    // Per draw values come from the Object block.
+    explicit TShadowShader(const TUniformBindingBase &objects)
         : TShaderProgram(
         TShaderBuilder()
             .SetVertex(&NResource::shaders_shadow_vert)
             .SetFragment(&NResource::shaders_shadow_frag)
             .SetGeometry(&NResource::shaders_shadow_geom)
+            .SetBlock("Object", objects)
             .SetTexture(EMaterialProp::Diffuse, "diffuse"))
           , LightMatrices(DefineProp("lightMatrices"))
           , Direct(DefineProp("direct"))
-          , Model(DefineProp("model"))
           , LightPos(DefineProp("lightPos"))
-          , Opacity(DefineProp("opacity")) {
+          , FaceRects(DefineProp("faceRects"))
+          , Paraboloid(DefineProp("paraboloid"))
+          , Filter(DefineProp("shadowFilter")) {
     }
 
     friend class TShadowSetup;
@@ -42,16 +66,6 @@ public:
         src.Shader = nullptr;
     }
 
-    ~TShadowSetup() override {
-        if (Shader != nullptr) {
-            try {
-                Set(Shader->Direct, false);
-                Set(Shader->Model, glm::mat4(0));
-            } catch (...) {
-            }
-        }
-    }
-
     TShadowSetup &&SetDirect(bool direct) {
         Set(Shader->Direct, direct);
         return std::move(*this);
@@ -62,18 +76,25 @@ public:
         return std::move(*this);
     }
 
-    TShadowSetup &&SetModel(glm::mat4 model) {
-        Set(Shader->Model, model);
+    TShadowSetup &&SetLightPos(glm::vec3 lightPos) {
+        Set(Shader->LightPos, lightPos);
         return std::move(*this);
     }
 
-    TShadowSetup &&SetLightPos(glm::vec3 lightPos) {
-        Set(Shader->LightPos, lightPos);
+    TShadowSetup &&SetFilter(EShadowFilter filter) {
+        Set(Shader->Filter, static_cast<GLint>(filter));
+        return std::move(*this);
+    }
+
+    // Atlas tiles the cube faces are drawn into, as texture coordinate offset and scale.
+    TShadowSetup &&SetFaceRects(const std::array<glm::vec4, 6> &rects) {
+        Set(Shader->FaceRects, rects.data(), 6);
         return std::move(*this);
     }
 
-    TShadowSetup &&SetOpacity(bool opacity) {
-        Set(Shader->Opacity, opacity);
+    // The light matrices are dual paraboloid hemisphere views rather than cube faces.
+    TShadowSetup &&SetParaboloid(bool paraboloid) {
+        Set(Shader->Paraboloid, paraboloid);
         return std::move(*this);
     }
 };
@@ -3,7 +3,14 @@
 layout (location = 0) in vec3 position;
 layout (location = 2) in vec2 coord;
 
-uniform mat4 model;
+layout (std140) uniform Object {
+    mat4 model;
+    mat3 norm;
+    float explosion;
+    bool opaque;
+    // Shadow cube faces the object touches.
+    int faces;
+};
 out VS_OUT {
     vec3 position;
     vec2 coord;
@@ -0,0 +1,122 @@
+#include "shadow_atlas.h"
+#include "bounds.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+
+using namespace glm;
+
+namespace {
+    // A light keeps its resolution until the wanted one is this many octaves away, so lights
+    // close to a step don't move their tiles every frame.
+    constexpr float Hysteresis = 0.75f;
+
+    bool PowerOfTwo(int value) {
+        return value > 0 && (value & (value - 1)) == 0;
+    }
+
+    // Cell of a Z-order curve position, x from the even bits and y from the odd ones.
+    ivec2 Deinterleave(uint64_t index) {
+        ivec2 cell(0);
+        for (int bit = 0; bit < 32; ++bit) {
+            cell.x |= static_cast<int>((index >> (2 * bit)) & 1U) << bit;
+            cell.y |= static_cast<int>((index >> (2 * bit + 1)) & 1U) << bit;
+        }
+        return cell;
+    }
+}
+
+TShadowAtlas::TShadowAtlas(const TShadowAtlasBuilder &builder)
+    : Settings(builder)
+      , Lights(builder.Lights_) {
+    if (Settings.Lights_ > MaxLights) {
+        throw TGlBaseError("Shadow atlas holds at most 4 lights");
+    }
+    if (!PowerOfTwo(Settings.Size_) || !PowerOfTwo(Settings.MinResolution_) || !PowerOfTwo(Settings.MaxResolution_)
+        || Settings.MinResolution_ > Settings.MaxResolution_ || 2 * Settings.MaxResolution_ > Settings.Size_) {
+        throw TGlBaseError("Shadow atlas sizes must be powers of two and fit into each other");
+    }
+    auto minimum = static_cast<uint64_t>(Settings.MinResolution_);
+    auto size = static_cast<uint64_t>(Settings.Size_);
+    if (8 * Lights.size() * minimum * minimum > size * size) {
+        throw TGlBaseError("Shadow atlas is too small for its lights");
+    }
+}
+
+void TShadowAtlas::SetLight(size_t light, vec3 position, float range) {
+    Lights.at(light).Position = position;
+    Lights.at(light).Range = range;
+}
+
+int TShadowAtlas::DesiredResolution(const TLight &light, int current, const mat4 &viewProjection,
+                                    const std::array<vec4, 6> &planes) const {
+    if (!SphereVisible(planes, light.Position, light.Range)) {
+        return Settings.MinResolution_;
+    }
+    // The clip w is the view depth, and the y row of the view projection is as long as the
+    // projection's vertical scale.
+    float depth = (viewProjection * vec4(light.Position, 1.0f)).w;
+    if (depth <= light.Range) {
+        return Settings.MaxResolution_;
+    }
+    float scale = length(vec3(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1]));
+    float texels = Settings.Density_ * light.Range * scale / depth;
+    float level = std::log2(std::max(texels, 1.0f));
+    int resolution = 1 << static_cast<int>(std::round(level));
+    if (current > 0 && std::abs(level - std::log2(static_cast<float>(current))) < Hysteresis) {
+        resolution = current;
+    }
+    return std::clamp(resolution, Settings.MinResolution_, Settings.MaxResolution_);
+}
+
+void TShadowAtlas::Pack(const mat4 &viewProjection) {
+    auto planes = FrustumPlanes(viewProjection);
+    size_t tiles = GetTiles();
+    int scale = Mode == EOmniShadow::Cube ? 1 : 2;
+    std::vector<int> resolutions;
+    uint64_t area = 0;
+    for (auto &light : Lights) {
+        // After a mode change the resolution is chosen afresh.
+        int current = light.Tiles == tiles ? light.Resolution / scale : 0;
+        resolutions.push_back(DesiredResolution(light, current, viewProjection, planes) * scale);
+        area += tiles * static_cast<uint64_t>(resolutions.back()) * static_cast<uint64_t>(resolutions.back());
+    }
+    auto size = static_cast<uint64_t>(Settings.Size_);
+    while (area > size * size) {
+        auto largest = std::max_element(resolutions.begin(), resolutions.end());
+        auto r = static_cast<uint64_t>(*largest);
+        area -= tiles * (r * r - r * r / 4);
+        *largest /= 2;
+    }
+
+    std::vector<size_t> order(Lights.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t left, size_t right) {
+        return resolutions[left] > resolutions[right];
+    });
+    // Positions count cells of the smallest tile. Larger tiles come first and cover a whole
+    // aligned block of the curve, which is a square.
+    int cell = Settings.MinResolution_;
+    uint64_t cursor = 0;
+    for (auto index : order) {
+        auto &light = Lights[index];
+        int resolution = resolutions[index];
+        auto cells = static_cast<uint64_t>(resolution / cell) * static_cast<uint64_t>(resolution / cell);
+        std::array<ivec4, 6> viewports{};
+        std::array<vec4, 6> rects{};
+        auto atlas = static_cast<float>(Settings.Size_);
+        for (size_t face = 0; face < tiles; ++face) {
+            ivec2 origin = Deinterleave(cursor) * cell;
+            viewports[face] = ivec4(origin.x, origin.y, resolution, resolution);
+            rects[face] = vec4(static_cast<float>(origin.x) / atlas, static_cast<float>(origin.y) / atlas,
+                               static_cast<float>(resolution) / atlas, static_cast<float>(resolution) / atlas);
+            cursor += cells;
+        }
+        light.Moved = light.Tiles != tiles || light.Viewports != viewports;
+        light.Resolution = resolution;
+        light.Tiles = tiles;
+        light.Viewports = viewports;
+        light.Rects = rects;
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "common.h"
+#include <array>
+#include <vector>
+
+// How omnidirectional shadows are unfolded into the atlas.
+enum class EOmniShadow {
+    // Six cube faces, a caster triangle is drawn once per face it touches.
+    Cube,
+    // Two hemispheres seen through paraboloids, a triangle is drawn at most twice. The
+    // projection bends straight edges, so large casters need finely tessellated surfaces.
+    DualParaboloid,
+};
+
+class TShadowAtlasBuilder {
+public:
+    BUILDER_PROPERTY(size_t, Lights){1};
+    // Texels per side of the square atlas.
+    BUILDER_PROPERTY(int, Size){2048};
+    // Bounds of the cube face resolution of a light, powers of two. Paraboloid tiles get twice
+    // the face resolution: their rim is sampled half as densely as their center, and two of
+    // them take about the atlas space of six faces.
+    BUILDER_PROPERTY(int, MinResolution){64};
+    BUILDER_PROPERTY(int, MaxResolution){512};
+    // Face resolution of a light whose range spans the screen height.
+    BUILDER_PROPERTY(float, Density){1024.0f};
+};
+
+// Shadow maps of omnidirectional lights unfolded into one depth texture. Every frame a light
+// gets a face resolution from the screen size of its range, and the tiles of all lights
+// are packed largest first along a Z-order curve, which fills the atlas like a quadtree
+// without gaps. While the atlas is short of space the largest lights are halved. The packing
+// only depends on the resolutions, so tiles stay in place until one of them changes.
+class TShadowAtlas {
+public:
+    static constexpr size_t MaxLights = 4;
+
+private:
+    struct TLight {
+        glm::vec3 Position{};
+        float Range{};
+        int Resolution = 0;
+        size_t Tiles = 0;
+        std::array<glm::ivec4, 6> Viewports{};
+        std::array<glm::vec4, 6> Rects{};
+        bool Moved = true;
+    };
+
+    TShadowAtlasBuilder Settings;
+    std::vector<TLight> Lights;
+    EOmniShadow Mode = EOmniShadow::Cube;
+
+    // Face resolution for the light, staying at the current one while close to it.
+    [[nodiscard]] int DesiredResolution(const TLight &light, int current, const glm::mat4 &viewProjection,
+                                        const std::array<glm::vec4, 6> &planes) const;
+
+public:
+    explicit TShadowAtlas(const TShadowAtlasBuilder &builder);
+
+    // Position and reach of the light this frame.
+    void SetLight(size_t light, glm::vec3 position, float range);
+    // Sizes and places the tiles of every light for the camera, call once per frame.
+    void Pack(const glm::mat4 &viewProjection);
+    // Takes effect with the next Pack, which moves every light.
+    void SetMode(EOmniShadow mode) { Mode = mode; }
+
+    [[nodiscard]] EOmniShadow GetMode() const { return Mode; }
+    // Tiles per light, six cube faces or two hemispheres.
+    [[nodiscard]] size_t GetTiles() const { return Mode == EOmniShadow::Cube ? 6 : 2; }
+    [[nodiscard]] int GetSize() const { return Settings.Size_; }
+    [[nodiscard]] size_t GetCount() const { return Lights.size(); }
+    [[nodiscard]] int GetResolution(size_t light) const { return Lights.at(light).Resolution; }
+    // Tile in texels, cube faces in cube map layer order, hemispheres below and above the light.
+    [[nodiscard]] const glm::ivec4 &GetViewport(size_t light, size_t face) const {
+        return Lights.at(light).Viewports.at(face);
+    }
+    // The tiles as texture coordinate offset and scale, unused entries are empty.
+    [[nodiscard]] const std::array<glm::vec4, 6> &GetRects(size_t light) const { return Lights.at(light).Rects; }
+    // The last Pack moved or resized the light's tiles, their contents are lost.
+    [[nodiscard]] bool Moved(size_t light) const { return Lights.at(light).Moved; }
+};
@@ -0,0 +1,189 @@
+#include "shadow_scheduler.h"
+#include <glm/ext/matrix_transform.hpp>
+#include <algorithm>
+#include <bitset>
+#include <limits>
+
+using namespace glm;
+
+namespace {
+    constexpr unsigned AllFaces = (1U << 6) - 1;
+    // Importance of lights whose range is outside the camera frustum, waiting still raises it.
+    constexpr float HiddenImportance = 0.05f;
+    // Weight of a new measurement in the running face cost.
+    constexpr float CostSmoothing = 0.2f;
+
+    struct TUpdate {
+        size_t Light;
+        unsigned Faces;
+        bool Moved;
+        bool Forced;
+        float Priority;
+        float Cost;
+    };
+}
+
+std::array<mat4, 6> CubeFaceMatrices(const mat4 &projection, vec3 position) {
+    return {
+        projection * lookAt(position, position + vec3(1, 0, 0), vec3(0, -1, 0)),
+        projection * lookAt(position, position + vec3(-1, 0, 0), vec3(0, -1, 0)),
+        projection * lookAt(position, position + vec3(0, 1, 0), vec3(0, 0, 1)),
+        projection * lookAt(position, position + vec3(0, -1, 0), vec3(0, 0, -1)),
+        projection * lookAt(position, position + vec3(0, 0, 1), vec3(0, -1, 0)),
+        projection * lookAt(position, position + vec3(0, 0, -1), vec3(0, -1, 0))};
+}
+
+std::array<mat4, 2> ParaboloidViews(vec3 position) {
+    return {
+        lookAt(position, position + vec3(0, -1, 0), vec3(0, 0, -1)),
+        lookAt(position, position + vec3(0, 1, 0), vec3(0, 0, 1))};
+}
+
+std::vector<std::array<vec4, 6>> ParaboloidFrusta(vec3 position) {
+    // Planes that pass everything fill the frusta up.
+    vec4 open(0, 0, 0, 1);
+    return {
+        {vec4(0, -1, 0, position.y), open, open, open, open, open},
+        {vec4(0, 1, 0, -position.y), open, open, open, open, open}};
+}
+
+unsigned ParaboloidFaces(unsigned cubeFaces) {
+    // Every cube face but the top one reaches below the light, every one but the bottom above.
+    unsigned below = cubeFaces & (AllFaces & ~(1U << 2)) ? 1U : 0U;
+    unsigned above = cubeFaces & (AllFaces & ~(1U << 3)) ? 2U : 0U;
+    return below | above;
+}
+
+TShadowScheduler::TShadowScheduler(const TShadowSchedulerBuilder &builder)
+    : Settings(builder)
+      , Lights(builder.Lights_) {
+    for (auto &light : Lights) {
+        light.FaceCost = Settings.FaceCost_;
+    }
+}
+
+void TShadowScheduler::SetLight(size_t light, vec3 position, float range) {
+    Lights.at(light).Position = position;
+    Lights.at(light).Range = range;
+}
+
+void TShadowScheduler::AddDynamicCaster(const TBounds &bounds, const mat4 &model) {
+    for (auto &light : Lights) {
+        if (light.Drawn) {
+            light.Dynamic |= light.Faces.Visible(bounds, model);
+        }
+    }
+}
+
+void TShadowScheduler::Invalidate() {
+    for (auto &light : Lights) {
+        light.Drawn = false;
+    }
+}
+
+void TShadowScheduler::Invalidate(size_t light) {
+    Lights.at(light).Drawn = false;
+    Lights.at(light).Lost = true;
+}
+
+void TShadowScheduler::MeasureCosts(TLight &light) {
+    while (light.TimedCount > 0) {
+        auto elapsed = light.Timer.Poll();
+        if (!elapsed) {
+            break;
+        }
+        auto faces = std::bitset<6>(light.Timed[light.TimedFirst]).count();
+        light.TimedFirst = (light.TimedFirst + 1) % TGpuTimer::Depth;
+        light.TimedCount--;
+        if (faces > 0) {
+            light.FaceCost = mix(light.FaceCost, *elapsed / static_cast<float>(faces), CostSmoothing);
+        }
+    }
+}
+
+void TShadowScheduler::Schedule(const mat4 &viewProjection, vec3 eye) {
+    auto planes = FrustumPlanes(viewProjection);
+    std::vector<TUpdate> updates;
+    for (size_t i = 0; i < Lights.size(); ++i) {
+        auto &light = Lights[i];
+        MeasureCosts(light);
+        light.Scheduled = 0;
+        // A caster that left a face since the last frame still shows in it.
+        light.Dirty |= light.Dynamic | light.LastDynamic;
+        light.LastDynamic = light.Dynamic;
+        light.Dynamic = 0;
+
+        float distance = std::max(length(eye - light.Position), 1e-3f);
+        float importance = SphereVisible(planes, light.Position, light.Range)
+                           ? std::min(1.0f, light.Range / distance)
+                           : HiddenImportance;
+        bool moved = !light.Drawn || light.Position != light.Origin || light.Range != light.OriginRange;
+        if (moved) {
+            int waited = *std::max_element(light.Waiting.begin(), light.Waiting.end());
+            float priority = light.Lost ? std::numeric_limits<float>::infinity()
+                                        : importance * static_cast<float>(1 + waited);
+            updates.push_back({i, AllFaces, true, light.Lost, priority, 6 * light.FaceCost});
+            continue;
+        }
+        for (unsigned face = 0; face < 6; ++face) {
+            if (light.Dirty & (1U << face)) {
+                updates.push_back({i, 1U << face, false, false, importance * static_cast<float>(1 + light.Waiting[face]),
+                                   light.FaceCost});
+            }
+        }
+    }
+    std::stable_sort(updates.begin(), updates.end(), [](const TUpdate &left, const TUpdate &right) {
+        return left.Priority > right.Priority;
+    });
+
+    float spent = 0;
+    for (auto &update : updates) {
+        if (!update.Forced && spent > 0 && spent + update.Cost > Settings.Budget_) {
+            continue;
+        }
+        spent += update.Cost;
+        auto &light = Lights[update.Light];
+        light.Scheduled |= update.Faces;
+        light.Dirty &= ~update.Faces;
+        if (update.Moved) {
+            light.Origin = light.Position;
+            light.OriginRange = light.Range;
+            light.Drawn = true;
+            light.Lost = false;
+            std::vector<std::array<vec4, 6>> frusta;
+            for (auto &face : CubeFaceMatrices(Settings.Projection_, light.Origin)) {
+                frusta.push_back(FrustumPlanes(face));
+            }
+            light.Faces = TFrustumCuller(std::move(frusta));
+            light.Faces.SetRange(light.Origin, light.OriginRange);
+        }
+    }
+
+    UpdatedFaces = 0;
+    PendingFaces = 0;
+    for (auto &light : Lights) {
+        bool moved = !light.Drawn || light.Position != light.Origin || light.Range != light.OriginRange;
+        unsigned pending = moved ? AllFaces : light.Dirty;
+        for (unsigned face = 0; face < 6; ++face) {
+            if (light.Scheduled & (1U << face)) {
+                light.Waiting[face] = 0;
+            } else if (pending & (1U << face)) {
+                light.Waiting[face]++;
+            }
+        }
+        UpdatedFaces += std::bitset<6>(light.Scheduled).count();
+        PendingFaces += std::bitset<6>(pending).count();
+    }
+}
+
+void TShadowScheduler::BeginUpdate(size_t light) {
+    auto &state = Lights.at(light);
+    if (state.Timer.Begin()) {
+        state.Timed[(state.TimedFirst + state.TimedCount) % TGpuTimer::Depth] = state.Scheduled;
+        state.TimedCount++;
+    }
+}
+
+void TShadowScheduler::EndUpdate(size_t light) {
+    Lights.at(light).Timer.End();
+}
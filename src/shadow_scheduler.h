@@ -0,0 +1,93 @@
+#pragma once
+#include "common.h"
+#include "bounds.h"
+#include "gpu_timer.h"
+#include <array>
+#include <vector>
+
+// View projections of the six cube map faces around the position, in layer order.
+std::array<glm::mat4, 6> CubeFaceMatrices(const glm::mat4 &projection, glm::vec3 position);
+// Views of the two dual paraboloid hemispheres, below and above the position.
+std::array<glm::mat4, 2> ParaboloidViews(glm::vec3 position);
+// The hemispheres as culling frusta, each bounded only by the horizontal plane through the position.
+std::vector<std::array<glm::vec4, 6>> ParaboloidFrusta(glm::vec3 position);
+// Hemispheres overlapping any of the cube faces, a bit each.
+unsigned ParaboloidFaces(unsigned cubeFaces);
+
+class TShadowSchedulerBuilder {
+public:
+    BUILDER_PROPERTY(size_t, Lights){1};
+    // Projection of every cube face.
+    BUILDER_PROPERTY(glm::mat4, Projection){1.0f};
+    // GPU milliseconds per frame spent on shadow updates, the most important update is done
+    // even when it alone exceeds the budget.
+    BUILDER_PROPERTY(float, Budget){1.0f};
+    // Cost of a face until a light's updates have been measured.
+    BUILDER_PROPERTY(float, FaceCost){0.1f};
+};
+
+// Decides which cube shadow faces are redrawn each frame. A face is dirty while a dynamic
+// caster is within it or was last frame, a light that moved redraws all faces at once around
+// its new position. Until then its shadow stays at the origin it was drawn from, which the
+// shaders read instead of the light position. Updates go by priority, the projected size of
+// the light's range times the frames they have waited, until the per frame budget is spent.
+class TShadowScheduler {
+private:
+    struct TLight {
+        glm::vec3 Position{};
+        float Range{};
+        // The last full update.
+        glm::vec3 Origin{};
+        float OriginRange{};
+        bool Drawn = false;
+        // The shadow's contents are gone, it is drawn again this frame whatever the budget.
+        bool Lost = false;
+        TFrustumCuller Faces;
+        unsigned Dirty = 0;
+        unsigned Dynamic = 0;
+        unsigned LastDynamic = 0;
+        std::array<int, 6> Waiting{};
+        unsigned Scheduled = 0;
+        float FaceCost{};
+        TGpuTimer Timer;
+        // Faces of the updates being measured, oldest first.
+        std::array<unsigned, TGpuTimer::Depth> Timed{};
+        size_t TimedFirst = 0;
+        size_t TimedCount = 0;
+    };
+
+    TShadowSchedulerBuilder Settings;
+    std::vector<TLight> Lights;
+    size_t UpdatedFaces = 0;
+    size_t PendingFaces = 0;
+
+    void MeasureCosts(TLight &light);
+
+public:
+    explicit TShadowScheduler(const TShadowSchedulerBuilder &builder);
+
+    // Position and reach of the light this frame.
+    void SetLight(size_t light, glm::vec3 position, float range);
+    // World bounds of a caster that may move, placed by the model matrix.
+    void AddDynamicCaster(const TBounds &bounds, const glm::mat4 &model);
+    // Redraws every face, e.g. after static casters changed.
+    void Invalidate();
+    // Redraws the light's faces this frame, even over budget, e.g. after its atlas tiles moved.
+    void Invalidate(size_t light);
+    // Picks this frame's updates, call once per frame after lights and casters are set.
+    void Schedule(const glm::mat4 &viewProjection, glm::vec3 eye);
+
+    // Faces to redraw this frame, a bit per cube layer.
+    [[nodiscard]] unsigned GetFaces(size_t light) const { return Lights.at(light).Scheduled; }
+    // Position and range the light's shadow is drawn from.
+    [[nodiscard]] glm::vec3 GetOrigin(size_t light) const { return Lights.at(light).Origin; }
+    [[nodiscard]] float GetRange(size_t light) const { return Lights.at(light).OriginRange; }
+
+    // Wrap the draws of the light's scheduled faces to measure their cost.
+    void BeginUpdate(size_t light);
+    void EndUpdate(size_t light);
+
+    // Faces scheduled and faces left dirty by the last Schedule.
+    [[nodiscard]] size_t GetUpdatedFaces() const { return UpdatedFaces; }
+    [[nodiscard]] size_t GetPendingFaces() const { return PendingFaces; }
+};
@@ -1,5 +1,6 @@
 #include "texture.h"
 #include "errors.h"
+#include "gl_state.h"
 #include "stb_image.h"
 
 using namespace std;
@@ -159,61 +160,96 @@ vector<GLfloat> ReadAsFloat(const uint8_t *data, int width, int height, int chan
     return result;
 }
 
-void LoadTextureImage(const string &file, GLenum what, int &width, int &height, ETextureUsage usage) {
-    auto internalFormat = TextureInternalFormat(usage);
-    auto format = DataFormat(usage);
-    auto byteFormat = ByteFormat(usage);
-    if (file.empty()) {
-        GL_ASSERT(glTexImage2D(what, 0, internalFormat, width, height, 0, format, byteFormat, nullptr));
-    } else {
-        int channels;
-        unsigned char *const data = stbi_load(file.c_str(), &width, &height, &channels, StbiFormat(usage));
-        if (data == nullptr) {
-            throw TGlBaseError("can't load file " + file);
-        }
-        try {
-            if (usage == ETextureUsage::Height || usage == ETextureUsage::Normals) {
-                vector<uint8_t> result;
-                if (channels < 3 || ChannelDeviation<unsigned char>(data, width * height, channels) < 2) {
-                    // It`s height map.
+// Converts pixels returned by stbi for the usage and frees them.
+shared_ptr<const TTextureImage> ConvertTextureImage(unsigned char *const data,
+                                                   int width,
+                                                   int height,
+                                                   int channels,
+                                                   ETextureUsage usage) {
+    auto image = make_shared<TTextureImage>();
+    image->Width = width;
+    image->Height = height;
+    try {
+        if (usage == ETextureUsage::Height || usage == ETextureUsage::Normals) {
+            if (channels < 3 || ChannelDeviation<unsigned char>(data, width * height, channels) < 2) {
+                // It`s height map.
+                if (usage == ETextureUsage::Height) {
+                    image->Bytes = ReadHeightMap(data, width, height, channels);
+                } else {
+                    image->Bytes = HeightMapToNormalMap(data, width, height, channels, 20.0f);
+                }
+            } else {
+                auto limits = Limits(data, width * height, channels);
+                if (get<0>(limits[0]) >= 127 && get<0>(limits[1]) >= 127
+                    && get<0>(limits[2]) >= 191) {
                     if (usage == ETextureUsage::Height) {
-                        result = ReadHeightMap(data, width, height, channels);
+                        throw TGlBaseError("can't convert normal map to height map");
                     } else {
-                        result = HeightMapToNormalMap(data, width, height, channels, 20.0f);
+                        image->Bytes = ReadNormalMap(data, width, height, channels, 191, 64, 191, 64, 191, 64);
                     }
                 } else {
-                    auto limits = Limits(data, width * height, channels);
-                    if (get<0>(limits[0]) >= 127 && get<0>(limits[1]) >= 127
-                        && get<0>(limits[2]) >= 191) {
-                        if (usage == ETextureUsage::Height) {
-                            throw TGlBaseError("can't convert normal map to height map");
-                        } else {
-                            result = ReadNormalMap(data, width, height, channels, 191, 64, 191, 64, 191, 64);
-                        }
-                    } else {
-                        throw TGlBaseError("can't detect format");
-                    }
+                    throw TGlBaseError("can't detect format");
                 }
-                GL_ASSERT(glTexImage2D(what, 0, internalFormat, width, height, 0, format, byteFormat, result.data()));
-            } else if (ByteFormat(usage) == GL_FLOAT) {
-                vector<GLfloat> result = ReadAsFloat(data, width, height, channels);
-                GL_ASSERT(glTexImage2D(what, 0, internalFormat, width, height, 0, format, byteFormat, result.data()));
-            } else {
-                GL_ASSERT(glTexImage2D(what, 0, internalFormat, width, height, 0, format, byteFormat, data));
             }
-            stbi_image_free(data);
-        } catch (...) {
-            stbi_image_free(data);
-            throw;
+        } else if (ByteFormat(usage) == GL_FLOAT) {
+            image->Floats = ReadAsFloat(data, width, height, channels);
+        } else {
+            image->Bytes.assign(data, data + static_cast<size_t>(width) * height * StbiFormat(usage));
         }
+        stbi_image_free(data);
+    } catch (...) {
+        stbi_image_free(data);
+        throw;
+    }
+    return image;
+}
+
+shared_ptr<const TTextureImage> DecodeTextureImage(const string &file, ETextureUsage usage) {
+    int width, height, channels;
+    unsigned char *const data = stbi_load(file.c_str(), &width, &height, &channels, StbiFormat(usage));
+    if (data == nullptr) {
+        throw TGlBaseError("can't load file " + file);
+    }
+    return ConvertTextureImage(data, width, height, channels, usage);
+}
+
+shared_ptr<const TTextureImage> DecodeTextureImage(const void *encoded, size_t size, ETextureUsage usage) {
+    int width, height, channels;
+    unsigned char *const data = stbi_load_from_memory(static_cast<const stbi_uc *>(encoded), static_cast<int>(size),
+                                                      &width, &height, &channels, StbiFormat(usage));
+    if (data == nullptr) {
+        throw TGlBaseError("can't decode image");
+    }
+    return ConvertTextureImage(data, width, height, channels, usage);
+}
+
+void UploadTextureImage(const TTextureImage &image, GLenum what, ETextureUsage usage) {
+    const void *pixels = image.Floats.empty()
+                         ? static_cast<const void *>(image.Bytes.data())
+                         : static_cast<const void *>(image.Floats.data());
+    GL_ASSERT(glTexImage2D(what, 0, TextureInternalFormat(usage), image.Width, image.Height, 0,
+                           DataFormat(usage), ByteFormat(usage), pixels));
+}
+
+void LoadTextureImage(const string &file, GLenum what, int &width, int &height, ETextureUsage usage) {
+    if (file.empty()) {
+        GL_ASSERT(glTexImage2D(what, 0, TextureInternalFormat(usage), width, height, 0,
+                               DataFormat(usage), ByteFormat(usage), nullptr));
+    } else {
+        auto image = DecodeTextureImage(file, usage);
+        UploadTextureImage(*image, what, usage);
+        width = image->Width;
+        height = image->Height;
     }
 }
 
 void FreeTexture(tuple<GLuint, int, int> *texture) {
+    TGlState::Get().ForgetTexture(get<0>(*texture));
     glDeleteTextures(1, &get<0>(*texture));
 }
 
 void FreeCubeTexture(tuple<GLuint, int, int, int> *texture) {
+    TGlState::Get().ForgetTexture(get<0>(*texture));
     glDeleteTextures(1, &get<0>(*texture));
 }
 
@@ -224,7 +260,7 @@ shared_ptr<tuple<GLuint, int, int>> Impl::CreateFlatTexture(const TTextureBuilde
         ETextureWrap wrapS = builder.WrapS_ == ETextureWrap::Undefined ? builder.Wrap_ : builder.WrapS_;
         ETextureWrap wrapT = builder.WrapT_ == ETextureWrap::Undefined ? builder.Wrap_ : builder.WrapT_;
 
-        GL_ASSERT(glBindTexture(GL_TEXTURE_2D, texture));
+        TGlState::Get().BindTexture(GL_TEXTURE_2D, texture);
         GL_ASSERT(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
                                   MinFilter(builder.MinLinear_, builder.Mipmap_)));
         GL_ASSERT(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, MagFilter(builder.MagLinear_)));
@@ -235,18 +271,23 @@ shared_ptr<tuple<GLuint, int, int>> Impl::CreateFlatTexture(const TTextureBuilde
         GL_ASSERT(glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border));
 
         auto[width, height] = builder.Empty_;
-        LoadTextureImage(builder.File_, GL_TEXTURE_2D, width, height, builder.Usage_);
+        if (builder.Image_) {
+            UploadTextureImage(*builder.Image_, GL_TEXTURE_2D, builder.Usage_);
+            width = builder.Image_->Width;
+            height = builder.Image_->Height;
+        } else {
+            LoadTextureImage(builder.File_, GL_TEXTURE_2D, width, height, builder.Usage_);
+        }
         if (builder.Mipmap_ != ETextureMipmap::None) {
             GL_ASSERT(glGenerateMipmap(GL_TEXTURE_2D));
         }
-        GL_ASSERT(glBindTexture(GL_TEXTURE_2D, 0));
         if (width == 0 || height == 0) {
             throw TGlBaseError("width or height is 0");
         }
         return shared_ptr<tuple<GLuint, int, int>>(
             new tuple<GLuint, int, int>(texture, width, height), FreeTexture);
     } catch (...) {
-        glBindTexture(GL_TEXTURE_2D, 0);
+        TGlState::Get().ForgetTexture(texture);
         glDeleteTextures(1, &texture);
         throw;
     }
@@ -256,18 +297,17 @@ shared_ptr<tuple<GLuint, int, int>> Impl::CreateMultisampleTexture(const TMultiS
     GLuint texture;
     GL_ASSERT(glGenTextures(1, &texture));
     try {
-        GL_ASSERT(glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, texture));
+        TGlState::Get().BindTexture(GL_TEXTURE_2D_MULTISAMPLE, texture);
         auto format = TextureInternalFormat(builder.Usage_);
         auto[width, height]= builder.Size_;
         GL_ASSERT(glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, builder.Samples_, format, width, height, GL_TRUE));
-        GL_ASSERT(glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0));
         if (width == 0 || height == 0) {
             throw TGlBaseError("width or height is 0");
         }
         return shared_ptr<tuple<GLuint, int, int>>(
             new tuple<GLuint, int, int>(texture, width, height), FreeTexture);
     } catch (...) {
-        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+        TGlState::Get().ForgetTexture(texture);
         glDeleteTextures(1, &texture);
         throw;
     }
@@ -277,7 +317,7 @@ shared_ptr<tuple<GLuint, int, int, int>> Impl::CreateCubeTexture(const TCubeText
     GLuint texture;
     GL_ASSERT(glGenTextures(1, &texture));
     try {
-        GL_ASSERT(glBindTexture(GL_TEXTURE_CUBE_MAP, texture));
+        TGlState::Get().BindTexture(GL_TEXTURE_CUBE_MAP, texture);
         GL_ASSERT(glTexParameteri(GL_TEXTURE_CUBE_MAP,
                                   GL_TEXTURE_MIN_FILTER,
                                   MinFilter(builder.MinLinear_, builder.Mipmap_)));
@@ -296,14 +336,13 @@ shared_ptr<tuple<GLuint, int, int, int>> Impl::CreateCubeTexture(const TCubeText
         if (builder.Mipmap_ != ETextureMipmap::None) {
             GL_ASSERT(glGenerateMipmap(GL_TEXTURE_CUBE_MAP));
         }
-        GL_ASSERT(glBindTexture(GL_TEXTURE_CUBE_MAP, 0));
         if (width == 0 || height == 0 || depth == 0) {
             throw TGlBaseError("width, height or depth is 0");
         }
         return shared_ptr<tuple<GLuint, int, int, int>>(
             new tuple<GLuint, int, int, int>(texture, width, height, depth), FreeCubeTexture);
     } catch (...) {
-        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        TGlState::Get().ForgetTexture(texture);
         glDeleteTextures(1, &texture);
         throw;
     }
@@ -316,30 +355,14 @@ TTextureBinder::TTextureBinder(TTextureBinder &&src) noexcept
     }
 }
 
-TTextureBinder::~TTextureBinder() {
-    bool empty = true;
-    for (int i = 0; i < Textures.size(); ++i) {
-        if (Textures[i].has_value()) {
-            glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(static_cast<GLenum>(*Textures[i]), 0);
-            empty = false;
-        }
-    }
-    if (!empty)
-        glActiveTexture(GL_TEXTURE0);
-    TGlError::Skip();
-}
-
 void TTextureBinder::Attach(ETextureType type, GLuint texture, int index) {
     if (texture == 0) {
         if (Textures[index].has_value()) {
-            GL_ASSERT(glActiveTexture(GL_TEXTURE0 + index));
-            GL_ASSERT(glBindTexture(static_cast<GLenum>(*Textures[index]), 0));
+            TGlState::Get().BindTexture(index, static_cast<GLenum>(*Textures[index]), 0);
             Textures[index] = {};
         }
     } else if (index >= 0) {
-        GL_ASSERT(glActiveTexture(GL_TEXTURE0 + index));
-        GL_ASSERT(glBindTexture(static_cast<GLenum>(type), texture));
+        TGlState::Get().BindTexture(index, static_cast<GLenum>(type), texture);
         Textures[index] = type;
     }
 }
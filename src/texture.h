@@ -39,6 +39,18 @@ enum struct ETextureUsage {
 
 GLenum TextureInternalFormat(ETextureUsage usage);
 
+// Decoded and converted pixels of an image file, ready for glTexImage2D.
+struct TTextureImage {
+    int Width{};
+    int Height{};
+    std::vector<uint8_t> Bytes;
+    std::vector<GLfloat> Floats;
+};
+
+// Touches no GL state, so images can be decoded on a worker thread and uploaded later.
+std::shared_ptr<const TTextureImage> DecodeTextureImage(const std::string &file, ETextureUsage usage);
+std::shared_ptr<const TTextureImage> DecodeTextureImage(const void *encoded, size_t size, ETextureUsage usage);
+
 class TTextureBuilder {
 public:
     BUILDER_PROPERTY(bool, MagLinear){true};
@@ -49,6 +61,7 @@ public:
     BUILDER_PROPERTY(ETextureWrap, WrapT){ETextureWrap::Undefined};
     BUILDER_PROPERTY(ETextureUsage, Usage){ETextureUsage::Rgba};
     BUILDER_PROPERTY(std::string, File) {};
+    BUILDER_PROPERTY(std::shared_ptr<const TTextureImage>, Image) {};
     BUILDER_PROPERTY(glm::vec4, BorderColor) {};
     BUILDER_PROPERTY2(int, int, Empty){0, 0};
 };
@@ -130,13 +143,15 @@ public:
     friend class TTextureBinder;
 };
 
+// Binds textures to units. They stay attached after the binder is gone, until another texture
+// takes the unit.
 class TTextureBinder {
 private:
     std::array<std::optional<ETextureType>, 32> Textures;
 
 public:
     TTextureBinder() = default;
-    ~TTextureBinder();
+    ~TTextureBinder() = default;
     TTextureBinder(TTextureBinder &&src) noexcept;
     TTextureBinder(const TTextureBinder &) = delete;
     TTextureBinder &operator=(const TTextureBinder &) = delete;
@@ -1,54 +1,277 @@
 #include "uniform_buffer.h"
+#include "gl_state.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // Binding points are shared by all programs of the context, every block gets its own.
+    GLuint NextIndex() {
+        static GLuint next = 0;
+        return next++;
+    }
+
+    size_t Alignment() {
+        GLint align{};
+        GL_ASSERT(glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align));
+        return static_cast<size_t>(align);
+    }
+}
+
+namespace Impl {
+    // Frames copies of a region in one buffer, one written by the CPU while the GPU may still
+    // read the others. With ARB_buffer_storage the copies stay mapped and a fence guards their
+    // reuse, otherwise the buffer is orphaned whenever the first copy comes round again.
+    class TFrameStorage {
+    private:
+        GLuint Buffer;
+        size_t FrameSize;
+        // Persistently mapped copies, null when the buffer is orphaned instead.
+        uint8_t *Mapped = nullptr;
+        std::array<GLsync, TUniformBuffer::Frames> Fences{};
+        size_t Current = 0;
+
+    public:
+        // Allocates the copies in the bound buffer.
+        TFrameStorage(GLuint buffer, size_t frameSize)
+            : Buffer(buffer)
+              , FrameSize(frameSize) {
+            auto total = static_cast<GLsizeiptr>(TUniformBuffer::Frames * FrameSize);
+            if (GLEW_ARB_buffer_storage) {
+                GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+                GL_ASSERT(glBufferStorage(GL_UNIFORM_BUFFER, total, nullptr, flags));
+                Mapped = static_cast<uint8_t *>(GL_ASSERTR(glMapBufferRange(GL_UNIFORM_BUFFER, 0, total, flags)));
+            } else {
+                GL_ASSERT(glBufferData(GL_UNIFORM_BUFFER, total, nullptr, GL_STREAM_DRAW));
+            }
+        }
+
+        ~TFrameStorage() {
+            for (auto fence : Fences) {
+                if (fence != nullptr) {
+                    glDeleteSync(fence);
+                }
+            }
+            TGlError::Skip();
+        }
+
+        TFrameStorage(const TFrameStorage &) = delete;
+        TFrameStorage &operator=(const TFrameStorage &) = delete;
+
+        [[nodiscard]] size_t GetBase() const { return Current * FrameSize; }
+        [[nodiscard]] size_t GetFrameSize() const { return FrameSize; }
+
+        // Copies into the current frame's copy, which no queued draw reads.
+        void Copy(size_t offset, size_t size, const void *data) {
+            size_t start = GetBase() + offset;
+            if (Mapped != nullptr) {
+                std::memcpy(Mapped + start, data, size);
+                return;
+            }
+            TGlState::Get().BindBuffer(GL_UNIFORM_BUFFER, Buffer);
+            auto target = GL_ASSERTR(glMapBufferRange(
+                GL_UNIFORM_BUFFER, start, size,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+            std::memcpy(target, data, size);
+            GL_ASSERT(glUnmapBuffer(GL_UNIFORM_BUFFER));
+        }
+
+        // Fences the frame's draws and moves on to the next copy once the GPU is done with it.
+        void NextFrame() {
+            if (Mapped != nullptr) {
+                Fences[Current] = GL_ASSERTR(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+            }
+            Current = (Current + 1) % TUniformBuffer::Frames;
+            if (Fences[Current] != nullptr) {
+                // Only waits when the GPU is more than the other frames behind.
+                GLenum status;
+                do {
+                    status = glClientWaitSync(Fences[Current], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+                } while (status == GL_TIMEOUT_EXPIRED);
+                glDeleteSync(Fences[Current]);
+                Fences[Current] = nullptr;
+                if (status == GL_WAIT_FAILED) {
+                    throw TGlError("wait for uniform buffer fence");
+                }
+            }
+            if (Mapped == nullptr && Current == 0) {
+                // Draws may still read any of the copies, new storage is handed out instead.
+                TGlState::Get().BindBuffer(GL_UNIFORM_BUFFER, Buffer);
+                GL_ASSERT(glBufferData(GL_UNIFORM_BUFFER, static_cast<GLsizeiptr>(TUniformBuffer::Frames * FrameSize),
+                                       nullptr, GL_STREAM_DRAW));
+            }
+        }
+    };
+
+    // The per frame copies of a streamed uniform buffer, each starting out with the latest
+    // values of all blocks.
+    class TUniformStream: public TFrameStorage {
+    private:
+        std::vector<uint8_t> Latest;
+
+    public:
+        TUniformStream(GLuint buffer, size_t frameSize)
+            : TFrameStorage(buffer, frameSize)
+              , Latest(frameSize) {
+        }
+
+        void Write(size_t offset, size_t size, const void *data) {
+            std::memcpy(Latest.data() + offset, data, size);
+            Copy(offset, size, data);
+        }
+
+        void NextFrame() {
+            TFrameStorage::NextFrame();
+            Copy(0, GetFrameSize(), Latest.data());
+        }
+    };
+}
 
 void TUniformBindingBase::Write(const void *data) {
-    GL_ASSERT(glBindBuffer(GL_UNIFORM_BUFFER, Buffer));
-    try {
-        GL_ASSERT(glBufferSubData(GL_UNIFORM_BUFFER, Offset, Size, data));
-    } catch (...) {
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
-        throw;
+    if (Stream != nullptr) {
+        Stream->Write(Offset, Size, data);
+        return;
     }
-    GL_ASSERT(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+    TGlState::Get().BindBuffer(GL_UNIFORM_BUFFER, Buffer);
+    GL_ASSERT(glBufferSubData(GL_UNIFORM_BUFFER, Offset, Size, data));
 }
 
-TUniformBuffer::TUniformBuffer(std::initializer_list<TUniformBindingBase *> buffers) {
+TUniformBuffer::TUniformBuffer(std::initializer_list<TUniformBindingBase *> buffers, EUniformUpdate update)
+    : Bindings(buffers) {
     size_t total = 0;
-    int index = 0;
-    GLint align{};
-    GL_ASSERT(glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align));
+    size_t align = Alignment();
 
     for (auto &buffer : buffers) {
         buffer->Offset = total;
-        buffer->BoundIndex = index++;
+        buffer->BoundIndex = NextIndex();
         total = ((total + buffer->Size - 1) / align + 1) * align;
     }
 
     GL_ASSERT(glGenBuffers(1, &Buffer));
+    auto &state = TGlState::Get();
     try {
-        GL_ASSERT(glBindBuffer(GL_UNIFORM_BUFFER, Buffer));
+        state.BindBuffer(GL_UNIFORM_BUFFER, Buffer);
 
-        GL_ASSERT(glBufferData(GL_UNIFORM_BUFFER, total + 2, nullptr, GL_DYNAMIC_DRAW));
+        if (update == EUniformUpdate::Streaming) {
+            Stream = std::make_unique<Impl::TUniformStream>(Buffer, total);
+        } else {
+            GL_ASSERT(glBufferData(GL_UNIFORM_BUFFER, total + 2, nullptr, GL_DYNAMIC_DRAW));
+        }
 
-        GL_ASSERT(glBindBuffer(GL_UNIFORM_BUFFER, 0));
         for (auto &buffer : buffers) {
             buffer->Buffer = Buffer;
-            GL_ASSERT(glBindBufferRange(GL_UNIFORM_BUFFER, buffer->BoundIndex, Buffer, buffer->Offset, buffer->Size));
+            buffer->Stream = Stream.get();
+            state.BindBufferRange(GL_UNIFORM_BUFFER, buffer->BoundIndex, Buffer, buffer->Offset, buffer->Size);
         }
     } catch (...) {
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        Stream.reset();
+        state.ForgetBuffer(Buffer);
         glDeleteBuffers(1, &Buffer);
         throw;
     }
 }
 
 TUniformBuffer::TUniformBuffer(TUniformBuffer &&src) noexcept
-    : Buffer(src.Buffer) {
+    : Buffer(src.Buffer)
+      , Bindings(std::move(src.Bindings))
+      , Stream(std::move(src.Stream)) {
     src.Buffer = 0;
 }
 
 TUniformBuffer::~TUniformBuffer() {
+    Stream.reset();
     if (Buffer != 0) {
+        TGlState::Get().ForgetBuffer(Buffer);
         glDeleteBuffers(1, &Buffer);
         TGlError::Skip();
     }
 }
+
+void TUniformBuffer::NextFrame() {
+    if (!Stream) return;
+    Stream->NextFrame();
+    size_t base = Stream->GetBase();
+    for (auto &buffer : Bindings) {
+        TGlState::Get().BindBufferRange(GL_UNIFORM_BUFFER, buffer->BoundIndex, Buffer, base + buffer->Offset,
+                                        buffer->Size);
+    }
+}
+
+TUniformRingBase::TUniformRingBase(size_t size, size_t capacity)
+    : TUniformBindingBase(size)
+      , Capacity(capacity) {
+    size_t align = Alignment();
+    Stride = (size + align - 1) / align * align;
+    BoundIndex = NextIndex();
+    Allocate();
+}
+
+TUniformRingBase::TUniformRingBase(TUniformRingBase &&src) noexcept
+    : TUniformBindingBase(src)
+      , Stride(src.Stride)
+      , Capacity(src.Capacity)
+      , Head(src.Head)
+      , Base(src.Base)
+      , Staging(std::move(src.Staging))
+      , Storage(std::move(src.Storage)) {
+    src.Buffer = 0;
+}
+
+TUniformRingBase::~TUniformRingBase() {
+    Release();
+}
+
+void TUniformRingBase::Allocate() {
+    GL_ASSERT(glGenBuffers(1, &Buffer));
+    try {
+        TGlState::Get().BindBuffer(GL_UNIFORM_BUFFER, Buffer);
+        Storage = std::make_unique<Impl::TFrameStorage>(Buffer, Capacity * Stride);
+    } catch (...) {
+        TGlState::Get().ForgetBuffer(Buffer);
+        glDeleteBuffers(1, &Buffer);
+        Buffer = 0;
+        throw;
+    }
+}
+
+void TUniformRingBase::Release() {
+    Storage.reset();
+    if (Buffer != 0) {
+        TGlState::Get().ForgetBuffer(Buffer);
+        glDeleteBuffers(1, &Buffer);
+        TGlError::Skip();
+        Buffer = 0;
+    }
+}
+
+void TUniformRingBase::Push(const void *record) {
+    size_t offset = Staging.size();
+    Staging.resize(offset + Stride);
+    std::memcpy(Staging.data() + offset, record, Size);
+}
+
+void TUniformRingBase::Upload() {
+    size_t count = Staging.size() / Stride;
+    if (count == 0) return;
+    if (Head + count > Capacity) {
+        // The frame outgrew its copy. Draws queued so far keep reading the old buffer, which
+        // GL deletes once they are done, and the rest of the frame goes to a larger one.
+        Capacity = std::max(2 * Capacity, count);
+        Release();
+        Allocate();
+        Head = 0;
+    }
+    Storage->Copy(Head * Stride, Staging.size(), Staging.data());
+    Base = Head;
+    Head += count;
+    Staging.clear();
+}
+
+void TUniformRingBase::NextFrame() {
+    Storage->NextFrame();
+    Head = 0;
+}
+
+void TUniformRingBase::Select(size_t index) const {
+    TGlState::Get().BindBufferRange(GL_UNIFORM_BUFFER, BoundIndex, Buffer,
+                                    Storage->GetBase() + (Base + index) * Stride, Size);
+}
@@ -1,5 +1,21 @@
 #pragma once
 #include "common.h"
+#include <memory>
+
+// How a uniform buffer takes the writes of its blocks.
+enum class EUniformUpdate {
+    // glBufferSubData into a single copy, which may stall while an earlier frame reads it.
+    Direct,
+    // Every frame in flight has its own copy of the blocks and writes are plain copies into
+    // the current one. With ARB_buffer_storage the copies stay mapped and a fence guards their
+    // reuse, otherwise the buffer is orphaned whenever the first copy comes round again.
+    Streaming,
+};
+
+namespace Impl {
+    class TFrameStorage;
+    class TUniformStream;
+}
 
 class TUniformBindingBase {
 private:
@@ -7,6 +23,7 @@ private:
     size_t Size;
     size_t Offset{};
     GLuint BoundIndex{};
+    Impl::TUniformStream *Stream{};
 
 public:
     explicit TUniformBindingBase(size_t size) : Size(size) {
@@ -15,6 +32,7 @@ public:
     void Write(const void* data);
 
     friend class TUniformBuffer;
+    friend class TUniformRingBase;
 };
 
 template<typename T>
@@ -36,15 +54,72 @@ public:
 };
 
 class TUniformBuffer {
+public:
+    static constexpr size_t Frames = 3;
+
 private:
     GLuint Buffer{};
+    std::vector<TUniformBindingBase *> Bindings;
+    std::unique_ptr<Impl::TUniformStream> Stream;
 
 public:
-    TUniformBuffer(std::initializer_list<TUniformBindingBase *> buffers);
+    TUniformBuffer(std::initializer_list<TUniformBindingBase *> buffers,
+                   EUniformUpdate update = EUniformUpdate::Direct);
     TUniformBuffer(TUniformBuffer&& src) noexcept;
     ~TUniformBuffer();
 
     TUniformBuffer(const TUniformBuffer&) = delete;
     TUniformBuffer& operator=(const TUniformBuffer&) = delete;
+
+    // Moves streamed blocks on to the next frame's copy, which starts out with their latest
+    // values. Call before the first write of a frame. Each block is written at most once per
+    // frame, a second write would change what earlier draws of the frame read.
+    void NextFrame();
+};
+
+// Per draw records streamed through a buffer of their own, each selected for the block with
+// glBindBufferRange. Every frame in flight has its own region of Capacity records, stored
+// like the copies of a streamed TUniformBuffer, and the batches of a frame follow each other
+// in it, so every record is written once and the GPU never waits for a write.
+class TUniformRingBase: public TUniformBindingBase {
+private:
+    size_t Stride;
+    size_t Capacity;
+    size_t Head{};
+    size_t Base{};
+    std::vector<uint8_t> Staging;
+    std::unique_ptr<Impl::TFrameStorage> Storage;
+
+    void Allocate();
+    void Release();
+
+protected:
+    void Push(const void *record);
+
+public:
+    TUniformRingBase(size_t size, size_t capacity);
+    TUniformRingBase(TUniformRingBase &&src) noexcept;
+    ~TUniformRingBase();
+
+    TUniformRingBase(const TUniformRingBase &) = delete;
+    TUniformRingBase &operator=(const TUniformRingBase &) = delete;
+
+    // Writes the records pushed since the last upload after the frame's earlier batches.
+    void Upload();
+    // Moves on to the next frame's region, call once per frame before the first upload.
+    void NextFrame();
+    // Binds a record of the last upload to the block.
+    void Select(size_t index) const;
+};
+
+template<typename T>
+class TUniformRing: public TUniformRingBase {
+public:
+    explicit TUniformRing(size_t capacity) : TUniformRingBase(sizeof(T), capacity) {
+    }
+
+    void Push(const T &record) {
+        TUniformRingBase::Push(&record);
+    }
 };
 
@@ -0,0 +1,66 @@
+#include "worker_pool.h"
+#include <algorithm>
+
+TWorkerPool::TWorkerPool(size_t threads) {
+    for (size_t i = 0; i < threads; ++i) {
+        Threads.emplace_back(&TWorkerPool::Work, this);
+    }
+}
+
+TWorkerPool::~TWorkerPool() {
+    {
+        std::lock_guard lock(Mutex);
+        Stop = true;
+    }
+    Wake.notify_all();
+    for (auto &thread : Threads) {
+        thread.join();
+    }
+}
+
+TWorkerPool &TWorkerPool::Get() {
+    static TWorkerPool pool(std::max(std::thread::hardware_concurrency(), 1U) - 1);
+    return pool;
+}
+
+void TWorkerPool::Work() {
+    std::unique_lock lock(Mutex);
+    while (true) {
+        Wake.wait(lock, [this] { return Stop || Next < Jobs; });
+        if (Stop) {
+            return;
+        }
+        Drain(lock);
+    }
+}
+
+void TWorkerPool::Drain(std::unique_lock<std::mutex> &lock) {
+    while (Next < Jobs) {
+        size_t index = Next++;
+        auto &job = *Job;
+        lock.unlock();
+        job(index);
+        lock.lock();
+        if (++Finished == Jobs) {
+            Done.notify_all();
+        }
+    }
+}
+
+void TWorkerPool::Run(size_t jobs, const std::function<void(size_t)> &job) {
+    if (jobs == 0) {
+        return;
+    }
+    std::lock_guard running(Running);
+    std::unique_lock lock(Mutex);
+    Job = &job;
+    Jobs = jobs;
+    Next = 0;
+    Finished = 0;
+    Wake.notify_all();
+    Drain(lock);
+    Done.wait(lock, [&] { return Finished == Jobs; });
+    Job = nullptr;
+    Jobs = 0;
+    Next = 0;
+}
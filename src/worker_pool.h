@@ -0,0 +1,44 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads started once and kept waiting for work, so splitting a loop costs a wake-up rather
+// than a thread start. Run hands out job indices to the workers and the calling thread alike
+// and returns when every job is done.
+class TWorkerPool {
+private:
+    std::vector<std::thread> Threads;
+    std::mutex Mutex;
+    // Serializes callers, a pool runs one batch at a time.
+    std::mutex Running;
+    std::condition_variable Wake;
+    std::condition_variable Done;
+    const std::function<void(size_t)> *Job{};
+    size_t Jobs = 0;
+    size_t Next = 0;
+    size_t Finished = 0;
+    bool Stop = false;
+
+    void Work();
+    // Runs jobs until none are left to take, the mutex is held on entry and exit.
+    void Drain(std::unique_lock<std::mutex> &lock);
+
+public:
+    explicit TWorkerPool(size_t threads);
+    TWorkerPool(const TWorkerPool &) = delete;
+    TWorkerPool &operator=(const TWorkerPool &) = delete;
+    ~TWorkerPool();
+
+    // Calls job(0) .. job(jobs - 1) spread over the pool and the calling thread.
+    void Run(size_t jobs, const std::function<void(size_t)> &job);
+
+    // Threads a batch runs on, the caller included.
+    [[nodiscard]] size_t GetSize() const { return Threads.size() + 1; }
+
+    // Pool shared by the per frame loops, one worker less than the hardware threads.
+    static TWorkerPool &Get();
+};